@@ -0,0 +1,133 @@
+#!/bin/sh
+#
+# Regression tests for TetGen.  Type "make check" in the parent directory,
+#   or run "tests/check.sh [path to tetgen]".  Each case runs TetGen on an
+#   input file of this directory in a temporary directory and checks the
+#   messages or the output files.
+
+TESTS=`cd \`dirname $0\` && pwd`
+TETGEN=${1:-$TESTS/../tetgen}
+case $TETGEN in
+  /*) ;;
+  *) TETGEN=`pwd`/$TETGEN ;;
+esac
+WORK=`mktemp -d /tmp/tetgen-check.XXXXXX`
+FAILED=0
+
+# pass NAME / fail NAME REASON
+pass() {
+  echo "ok      $1"
+}
+fail() {
+  echo "FAILED  $1: $2"
+  FAILED=`expr $FAILED + 1`
+}
+
+# A sequence of T44 flips cycled forever on this cone (on nearly coplanar
+#   points).  They must end by themselves, not be stopped by the limit of
+#   coplanar flips in flip().
+cd $WORK && cp $TESTS/cone.poly .
+if $TETGEN -pqCCV cone.poly > cone.log 2>&1 &&
+   grep "The mesh is conforming Delaunay" cone.log > /dev/null &&
+   ! grep "Stopped flipping\|!! !!" cone.log > /dev/null; then
+  pass cone
+else
+  fail cone "no conforming Delaunay mesh, or the flips were stopped"
+fi
+
+# Points far from the origin (at 1e13).  The cached circumspheres of '-k'
+#   once lost their precision there and gave a non-Delaunay mesh.
+cd $WORK && cp $TESTS/offset.node .
+if $TETGEN -kCC offset.node > offset.log 2>&1 &&
+   grep "The mesh is Delaunay" offset.log > /dev/null; then
+  pass offset
+else
+  fail offset "no Delaunay mesh with -k"
+fi
+
+# Each segment of a closed cube has exactly two subfaces.  A subface was
+#   once found twice if two of its edges were in the same hash entry.
+cd $WORK && cp $TESTS/cube.stl .
+if $TETGEN -pVV cube.stl > segs.log 2>&1 &&
+   grep "Identifying 2 segments" segs.log > /dev/null &&
+   ! grep "Identifying" segs.log | grep -v "Identifying 2 " > /dev/null; then
+  pass segments
+else
+  fail segments "a segment does not have two subfaces"
+fi
+
+# Write a mesh of a .stl file (numbered from zero) with -g (which numbers
+#   the points from one) and read it back.
+cd $WORK && cp $TESTS/cube.stl .
+if $TETGEN -pqQgb cube.stl > /dev/null 2>&1 &&
+   $TETGEN -rQ cube.1.tgb > tgb.log 2>&1; then
+  pass tgb
+else
+  fail tgb "cannot read back the .tgb file"
+fi
+
+# A truncated .tgb file must be rejected by its header, not be read.
+cd $WORK && head -c 100 cube.1.tgb > short.tgb
+if ! $TETGEN -rQ short.tgb > short.log 2>&1 &&
+   grep "shorter than its header" short.log > /dev/null; then
+  pass tgbshort
+else
+  fail tgbshort "a truncated .tgb file is not rejected"
+fi
+
+cd $WORK
+if $TETGEN -pqQgm cube.stl > /dev/null 2>&1 &&
+   $TETGEN -rQ cube.1.msh > msh.log 2>&1; then
+  pass msh
+else
+  fail msh "cannot read back the .msh file"
+fi
+
+# A .msh file with a huge node tag must be refused, not allocate memory for
+#   all the tags up to it.
+cd $WORK && cp $TESTS/sparse.msh .
+if $TETGEN -rQ sparse.msh > sparse.log 2>&1; then
+  fail sparse "the sparse node tags are accepted"
+elif grep "too sparse" sparse.log > /dev/null; then
+  pass sparse
+else
+  fail sparse "tetgen failed for another reason"
+fi
+
+# The output of '-t' (in a PTHREADS build) must be the same as the serial
+#   one.  The threads of the refinement once numbered the points wrongly.
+#   The encroached subfaces are split in parallel rounds, they're taken
+#   from the queues without '-R' and from the heaps with it.  The subfaces
+#   of lshape.poly were once listed in another order, since a subface freed
+#   by a thread of the surface triangulation was not reused.
+cd $WORK && cp $TESTS/box.poly $TESTS/lshape.poly .
+for input in box lshape; do
+  for switches in -pqQ -pqQR; do
+    rm -rf serial $input.1.*
+    if $TETGEN $switches $input.poly > /dev/null 2>&1 &&
+       mkdir serial && mv $input.1.* serial &&
+       $TETGEN ${switches}t4 $input.poly > /dev/null 2>&1; then
+      same=yes
+      for ext in node ele face; do
+        grep -v "^#" serial/$input.1.$ext > serial.$ext
+        grep -v "^#" $input.1.$ext > threads.$ext
+        cmp -s serial.$ext threads.$ext || same=no
+      done
+      if [ $same = yes ]; then
+        pass "threads $input $switches"
+      else
+        fail "threads $input $switches" \
+          "the output of -t4 differs from the serial one"
+      fi
+    else
+      fail "threads $input $switches" "tetgen failed"
+    fi
+  done
+done
+
+rm -rf $WORK
+if [ $FAILED -ne 0 ]; then
+  echo "$FAILED test(s) failed."
+  exit 1
+fi
+echo "All tests passed."
@@ -83,6 +83,9 @@ void tetgenio::initialize()
 
   regionlist = (REAL *) NULL;
   numberofregions = 0;
+
+  handover = 0;
+  visitor = (outputvisitor *) NULL;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -223,7 +226,7 @@ bool tetgenio::load_node_call(FILE* infile, int markers, char* infilename)
   for (i = 0; i < numberofpoints; i++) {
     stringptr = readnumberline(inputline, infile, infilename);
     if (i == 0) {
-      firstnode = (int) strtol (stringptr, &stringptr, 0);
+      firstnode = parseint(stringptr, &stringptr);
       if ((firstnode == 0) || (firstnode == 1)) {
         firstnumber = firstnode;
       }
@@ -233,19 +236,19 @@ bool tetgenio::load_node_call(FILE* infile, int markers, char* infilename)
       printf("Error:  Point %d has no x coordinate.\n", firstnumber + i);
       break;
     }
-    x = (REAL) strtod(stringptr, &stringptr);
+    x = parsereal(stringptr, &stringptr);
     stringptr = findnextnumber(stringptr);
     if (*stringptr == '\0') {
       printf("Error:  Point %d has no y coordinate.\n", firstnumber + i);
       break;
     }
-    y = (REAL) strtod(stringptr, &stringptr);
+    y = parsereal(stringptr, &stringptr);
     stringptr = findnextnumber(stringptr);
     if (*stringptr == '\0') {
       printf("Error:  Point %d has no z coordinate.\n", firstnumber + i);
       break;
     }
-    z = (REAL) strtod(stringptr, &stringptr);
+    z = parsereal(stringptr, &stringptr);
     pointlist[index++] = x;
     pointlist[index++] = y;
     pointlist[index++] = z;
@@ -255,7 +258,7 @@ bool tetgenio::load_node_call(FILE* infile, int markers, char* infilename)
       if (*stringptr == '\0') {
         attrib = 0.0;
       } else {
-        attrib = (REAL) strtod(stringptr, &stringptr);
+        attrib = parsereal(stringptr, &stringptr);
       }
       pointattributelist[attribindex++] = attrib;
     }
@@ -265,7 +268,7 @@ bool tetgenio::load_node_call(FILE* infile, int markers, char* infilename)
       if (*stringptr == '\0') {
         currentmarker = 0;
       } else {
-        currentmarker = (int) strtol (stringptr, &stringptr, 0);
+        currentmarker = parseint(stringptr, &stringptr);
       }
       pointmarkerlist[i] = currentmarker;
     }
@@ -319,24 +322,24 @@ bool tetgenio::load_node(char* filename)
   // Read number of points, number of dimensions, number of point
   //   attributes, and number of boundary markers.
   stringptr = readnumberline(inputline, infile, innodefilename);
-  numberofpoints = (int) strtol (stringptr, &stringptr, 0);
+  numberofpoints = parseint(stringptr, &stringptr);
   stringptr = findnextnumber(stringptr);
   if (*stringptr == '\0') {
     mesh_dim = 3;
   } else {
-    mesh_dim = (int) strtol (stringptr, &stringptr, 0);
+    mesh_dim = parseint(stringptr, &stringptr);
   }
   stringptr = findnextnumber(stringptr);
   if (*stringptr == '\0') {
     numberofpointattributes = 0;
   } else {
-    numberofpointattributes = (int) strtol (stringptr, &stringptr, 0);
+    numberofpointattributes = parseint(stringptr, &stringptr);
   }
   stringptr = findnextnumber(stringptr);
   if (*stringptr == '\0') {
     markers = 0;
   } else {
-    markers = (int) strtol (stringptr, &stringptr, 0);
+    markers = parseint(stringptr, &stringptr);
   }
 
   if (mesh_dim != 3) {
@@ -393,7 +396,7 @@ bool tetgenio::load_addnodes(char* filename)
 
   // Read the number of additional points.
   stringptr = readnumberline(inputline, infile, addnodefilename);
-  numberofaddpoints = (int) strtol (stringptr, &stringptr, 0);
+  numberofaddpoints = parseint(stringptr, &stringptr);
   if (numberofaddpoints == 0) {
     // It looks this file contains no point.
     fclose(infile);
@@ -415,19 +418,19 @@ bool tetgenio::load_addnodes(char* filename)
       printf("Error:  Point %d has no x coordinate.\n", firstnumber + i);
       break;
     }
-    x = (REAL) strtod(stringptr, &stringptr);
+    x = parsereal(stringptr, &stringptr);
     stringptr = findnextnumber(stringptr);
     if (*stringptr == '\0') {
       printf("Error:  Point %d has no y coordinate.\n", firstnumber + i);
       break;
     }
-    y = (REAL) strtod(stringptr, &stringptr);
+    y = parsereal(stringptr, &stringptr);
     stringptr = findnextnumber(stringptr);
     if (*stringptr == '\0') {
       printf("Error:  Point %d has no z coordinate.\n", firstnumber + i);
       break;
     }
-    z = (REAL) strtod(stringptr, &stringptr);
+    z = parsereal(stringptr, &stringptr);
     addpointlist[index++] = x;
     addpointlist[index++] = y;
     addpointlist[index++] = z;
@@ -497,24 +500,24 @@ bool tetgenio::load_poly(char* filename)
   // Read number of points, number of dimensions, number of point
   //   attributes, and number of boundary markers.
   stringptr = readnumberline(inputline, polyfile, inpolyfilename);
-  numberofpoints = (int) strtol (stringptr, &stringptr, 0);
+  numberofpoints = parseint(stringptr, &stringptr);
   stringptr = findnextnumber(stringptr);
   if (*stringptr == '\0') {
     mesh_dim = 3; // If it is not provided, set the default value.
   } else {
-    mesh_dim = (int) strtol (stringptr, &stringptr, 0);      
+    mesh_dim = parseint(stringptr, &stringptr);      
   }
   stringptr = findnextnumber(stringptr);
   if (*stringptr == '\0') {
     numberofpointattributes = 0; // The default value.
   } else {
-    numberofpointattributes = (int) strtol (stringptr, &stringptr, 0);
+    numberofpointattributes = parseint(stringptr, &stringptr);
   }
   stringptr = findnextnumber(stringptr);
   if (*stringptr == '\0') {
     markers = 0; // If it is not provided, set the default value.
   } else {
-    markers = (int) strtol (stringptr, &stringptr, 0);
+    markers = parseint(stringptr, &stringptr);
   }
   if (numberofpoints > 0) {
     readnodefile = 0;
@@ -542,24 +545,24 @@ bool tetgenio::load_poly(char* filename)
     // Read number of points, number of dimensions, number of point
     //   attributes, and number of boundary markers.
     stringptr = readnumberline(inputline, infile, innodefilename);
-    numberofpoints = (int) strtol (stringptr, &stringptr, 0);
+    numberofpoints = parseint(stringptr, &stringptr);
     stringptr = findnextnumber(stringptr);
     if (*stringptr == '\0') {
       mesh_dim = 3;
     } else {
-      mesh_dim = (int) strtol (stringptr, &stringptr, 0);
+      mesh_dim = parseint(stringptr, &stringptr);
     }
     stringptr = findnextnumber(stringptr);
     if (*stringptr == '\0') {
       numberofpointattributes = 0;
     } else {
-      numberofpointattributes = (int) strtol (stringptr, &stringptr, 0);
+      numberofpointattributes = parseint(stringptr, &stringptr);
     }
     stringptr = findnextnumber(stringptr);
     if (*stringptr == '\0') {
       markers = 0;
     } else {
-      markers = (int) strtol (stringptr, &stringptr, 0);
+      markers = parseint(stringptr, &stringptr);
     }
   }
 
@@ -586,12 +589,12 @@ bool tetgenio::load_poly(char* filename)
 
   // Read number of facets and number of boundary markers.
   stringptr = readnumberline(inputline, polyfile, inpolyfilename);
-  numberoffacets = (int) strtol (stringptr, &stringptr, 0);
+  numberoffacets = parseint(stringptr, &stringptr);
   stringptr = findnextnumber(stringptr);
   if (*stringptr == '\0') {
     markers = 0;
   } else {
-    markers = (int) strtol (stringptr, &stringptr, 0);
+    markers = parseint(stringptr, &stringptr);
   }
 
   if (numberoffacets <= 0) {
@@ -619,14 +622,14 @@ bool tetgenio::load_poly(char* filename)
       currentmarker = 0;
       // Read number of polygons, number of holes, and a boundary marker.
       stringptr = readnumberline(inputline, polyfile, inpolyfilename);
-      f->numberofpolygons = (int) strtol (stringptr, &stringptr, 0);
+      f->numberofpolygons = parseint(stringptr, &stringptr);
       stringptr = findnextnumber(stringptr);
       if (*stringptr != '\0') {
-        f->numberofholes = (int) strtol (stringptr, &stringptr, 0);
+        f->numberofholes = parseint(stringptr, &stringptr);
         if (markers == 1) {
           stringptr = findnextnumber(stringptr);
           if (*stringptr != '\0') {
-            currentmarker = (int) strtol(stringptr, &stringptr, 0);
+            currentmarker = parseint(stringptr, &stringptr);
           } 
         }
       } 
@@ -647,7 +650,7 @@ bool tetgenio::load_poly(char* filename)
         init(p);
         // Read number of vertices of this polygon.
         stringptr = readnumberline(inputline, polyfile, inpolyfilename);
-        p->numberofvertices = (int) strtol(stringptr, &stringptr, 0);
+        p->numberofvertices = parseint(stringptr, &stringptr);
         if (p->numberofvertices < 1) {
           printf("Error:  Wrong polygon %d in facet %d\n", j, i);
           break;
@@ -667,7 +670,7 @@ bool tetgenio::load_poly(char* filename)
               break;
             }
           }
-          p->vertexlist[k - 1] = (int) strtol (stringptr, &stringptr, 0);
+          p->vertexlist[k - 1] = parseint(stringptr, &stringptr);
         }
       } 
       if (j <= f->numberofpolygons) {
@@ -696,7 +699,7 @@ bool tetgenio::load_poly(char* filename)
               printf("Error:  Hole %d in facet %d has no coordinates", j, i);
               break;
             }
-            f->holelist[index++] = (REAL) strtod (stringptr, &stringptr);
+            f->holelist[index++] = parsereal(stringptr, &stringptr);
           }
           if (k <= 3) {
             // This must be caused by an error.
@@ -728,7 +731,7 @@ bool tetgenio::load_poly(char* filename)
       init(p);
       // Read number of vertices of this polygon.
       stringptr = readnumberline(inputline, polyfile, insmeshfilename);
-      p->numberofvertices = (int) strtol (stringptr, &stringptr, 0);
+      p->numberofvertices = parseint(stringptr, &stringptr);
       if (p->numberofvertices < 1) {
         printf("Error:  Wrong number of vertex in facet %d\n", i);
         break;
@@ -747,7 +750,7 @@ bool tetgenio::load_poly(char* filename)
             break;
           }
         }
-        p->vertexlist[k - 1] = (int) strtol (stringptr, &stringptr, 0);
+        p->vertexlist[k - 1] = parseint(stringptr, &stringptr);
       }
       if (k <= p->numberofvertices) {
         // This must be caused by an error.
@@ -759,7 +762,7 @@ bool tetgenio::load_poly(char* filename)
         if (*stringptr == '\0') {
           currentmarker = 0;
         } else {
-          currentmarker = (int) strtol(stringptr, &stringptr, 0);
+          currentmarker = parseint(stringptr, &stringptr);
         }
         facetmarkerlist[i - 1] = currentmarker;
       }
@@ -775,7 +778,7 @@ bool tetgenio::load_poly(char* filename)
   // Read the hole section.
   stringptr = readnumberline(inputline, polyfile, inpolyfilename);
   if (*stringptr != '\0') {
-    numberofholes = (int) strtol (stringptr, &stringptr, 0);
+    numberofholes = parseint(stringptr, &stringptr);
   } else {
     numberofholes = 0;
   }
@@ -789,21 +792,21 @@ bool tetgenio::load_poly(char* filename)
         printf("Error:  Hole %d has no x coord.\n", firstnumber + (i / 3));
         break;
       } else {
-        holelist[i] = (REAL) strtod(stringptr, &stringptr);
+        holelist[i] = parsereal(stringptr, &stringptr);
       }
       stringptr = findnextnumber(stringptr);
       if (*stringptr == '\0') {
         printf("Error:  Hole %d has no y coord.\n", firstnumber + (i / 3));
         break;
       } else {
-        holelist[i + 1] = (REAL) strtod(stringptr, &stringptr);
+        holelist[i + 1] = parsereal(stringptr, &stringptr);
       }
       stringptr = findnextnumber(stringptr);
       if (*stringptr == '\0') {
         printf("Error:  Hole %d has no z coord.\n", firstnumber + (i / 3));
         break;
       } else {
-        holelist[i + 2] = (REAL) strtod(stringptr, &stringptr);
+        holelist[i + 2] = parsereal(stringptr, &stringptr);
       }
     }
     if (i < 3 * numberofholes) {
@@ -831,7 +834,7 @@ bool tetgenio::load_poly(char* filename)
   } while ((*stringptr == '#') || (*stringptr == '\0'));
   
   if (stringptr != (char *) NULL && *stringptr != '\0') {
-    numberofregions = (int) strtol (stringptr, &stringptr, 0);
+    numberofregions = parseint(stringptr, &stringptr);
   } else {
     numberofregions = 0;
   }
@@ -846,34 +849,34 @@ bool tetgenio::load_poly(char* filename)
         printf("Error:  Region %d has no x coordinate.\n", firstnumber + i);
         break;
       } else {
-        regionlist[index++] = (REAL) strtod(stringptr, &stringptr);
+        regionlist[index++] = parsereal(stringptr, &stringptr);
       }
       stringptr = findnextnumber(stringptr);
       if (*stringptr == '\0') {
         printf("Error:  Region %d has no y coordinate.\n", firstnumber + i);
         break;
       } else {
-        regionlist[index++] = (REAL) strtod(stringptr, &stringptr);
+        regionlist[index++] = parsereal(stringptr, &stringptr);
       }
       stringptr = findnextnumber(stringptr);
       if (*stringptr == '\0') {
         printf("Error:  Region %d has no z coordinate.\n", firstnumber + i);
         break;
       } else {
-        regionlist[index++] = (REAL) strtod(stringptr, &stringptr);
+        regionlist[index++] = parsereal(stringptr, &stringptr);
       }
       stringptr = findnextnumber(stringptr);
       if (*stringptr == '\0') {
         printf("Error:  Region %d has no region attrib.\n", firstnumber + i);
         break;
       } else {
-        regionlist[index++] = (REAL) strtod(stringptr, &stringptr);
+        regionlist[index++] = parsereal(stringptr, &stringptr);
       }
       stringptr = findnextnumber(stringptr);
       if (*stringptr == '\0') {
         regionlist[index] = regionlist[index - 1];
       } else {
-        regionlist[index] = (REAL) strtod(stringptr, &stringptr);
+        regionlist[index] = parsereal(stringptr, &stringptr);
       }
       index++;
     }
@@ -977,7 +980,7 @@ bool tetgenio::load_off(char* filename)
           fclose(fp);
           return false;
         }
-        coord[i] = (REAL) strtod(bufferp, &bufferp);
+        coord[i] = parsereal(bufferp, &bufferp);
         bufferp = findnextnumber(bufferp);
       }
       iverts++;
@@ -991,7 +994,7 @@ bool tetgenio::load_off(char* filename)
       p = &f->polygonlist[0];
       init(p);
       // Read the number of vertices, it should be greater than 0.
-      p->numberofvertices = (int) strtol(bufferp, &bufferp, 0);
+      p->numberofvertices = parseint(bufferp, &bufferp);
       if (p->numberofvertices == 0) {
         printf("Syntax error reading polygon on line %d in file %s\n",
                line_count, infilename);
@@ -1008,7 +1011,7 @@ bool tetgenio::load_off(char* filename)
           fclose(fp);
           return false;
         }
-        p->vertexlist[i] = (int) strtol(bufferp, &bufferp, 0);
+        p->vertexlist[i] = parseint(bufferp, &bufferp);
       }
       ifaces++;
     } else {
@@ -1039,6 +1042,114 @@ bool tetgenio::load_off(char* filename)
   return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// Helpers for reading binary .ply files (see load_ply()).                   //
+//                                                                           //
+// The header of a .ply file lists its elements (e.g., "element vertex 8")   //
+// and the properties of each element (e.g., "property float x", "property   //
+// list uchar int vertex_indices").  In a binary file the elements follow    //
+// the header in the listed order.  Each item of an element is the values of //
+// its properties in the listed order, without separators.  A list property  //
+// is a count followed by that many values.                                  //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+// The types of the values of .ply properties.  Their sizes (in bytes) are
+//   given by 'plytypesizes'.
+enum plytype {PLYNONE, PLYINT8, PLYUINT8, PLYINT16, PLYUINT16, PLYINT32,
+              PLYUINT32, PLYFLOAT32, PLYFLOAT64};
+static int plytypesizes[9] = {0, 1, 1, 2, 2, 4, 4, 4, 8};
+
+// A property of an element.  'type' is the type of its value (or of the
+//   values of a list), 'counttype' is the type of the count of a list, it
+//   is PLYNONE if the property is not a list.  'role' tells how it is used:
+//   0 - skipped, 1, 2, 3 - the x, y, z coordinate of a vertex, 4 - the
+//   vertex indices of a face.
+typedef struct {
+  enum plytype type, counttype;
+  int role;
+} plyproperty;
+
+// An element.  'kind' is 1 for "vertex", 2 for "face", 0 for the others.
+enum {PLYMAXELEMENTS = 16, PLYMAXPROPERTIES = 64};
+typedef struct {
+  int kind, count;
+  plyproperty properties[PLYMAXPROPERTIES];
+  int numberofproperties;
+} plyelement;
+
+// A buffered reader of the binary part of a .ply file.
+typedef struct {
+  FILE *fp;
+  unsigned char buffer[65536];
+  int head, tail;
+} plyreader;
+
+static enum plytype plytypebyname(char* name)
+{
+  if (!strcmp(name, "char") || !strcmp(name, "int8")) return PLYINT8;
+  if (!strcmp(name, "uchar") || !strcmp(name, "uint8")) return PLYUINT8;
+  if (!strcmp(name, "short") || !strcmp(name, "int16")) return PLYINT16;
+  if (!strcmp(name, "ushort") || !strcmp(name, "uint16")) return PLYUINT16;
+  if (!strcmp(name, "int") || !strcmp(name, "int32")) return PLYINT32;
+  if (!strcmp(name, "uint") || !strcmp(name, "uint32")) return PLYUINT32;
+  if (!strcmp(name, "float") || !strcmp(name, "float32")) return PLYFLOAT32;
+  if (!strcmp(name, "double") || !strcmp(name, "float64")) return PLYFLOAT64;
+  return PLYNONE;
+}
+
+// Return a pointer to the next 'size' bytes, or NULL at the end of file.
+static unsigned char *plyread(plyreader* r, int size)
+{
+  unsigned char *bytes;
+
+  if (r->tail - r->head < size) {
+    // Move the remaining bytes to the front, and refill the buffer.
+    memmove(r->buffer, r->buffer + r->head, r->tail - r->head);
+    r->tail -= r->head;
+    r->head = 0;
+    r->tail += fread(r->buffer + r->tail, 1, sizeof(r->buffer) - r->tail,
+                     r->fp);
+    if (r->tail < size) return (unsigned char *) NULL;
+  }
+  bytes = r->buffer + r->head;
+  r->head += size;
+  return bytes;
+}
+
+// Read a value of 'type' into 'value'.  Its bytes are reversed if 'swap'
+//   is set.  Return false at the end of file.
+static bool plyvalue(plyreader* r, enum plytype type, int swap,
+                     double* value)
+{
+  unsigned char *bytes, raw[8];
+  short i16;
+  unsigned short u16;
+  int i32;
+  unsigned int u32;
+  float f32;
+  int size, i;
+
+  size = plytypesizes[type];
+  bytes = plyread(r, size);
+  if (bytes == (unsigned char *) NULL) return false;
+  for (i = 0; i < size; i++) {
+    raw[i] = swap ? bytes[size - 1 - i] : bytes[i];
+  }
+  switch (type) {
+  case PLYINT8: *value = (double) (signed char) raw[0]; break;
+  case PLYUINT8: *value = (double) raw[0]; break;
+  case PLYINT16: memcpy(&i16, raw, 2); *value = (double) i16; break;
+  case PLYUINT16: memcpy(&u16, raw, 2); *value = (double) u16; break;
+  case PLYINT32: memcpy(&i32, raw, 4); *value = (double) i32; break;
+  case PLYUINT32: memcpy(&u32, raw, 4); *value = (double) u32; break;
+  case PLYFLOAT32: memcpy(&f32, raw, 4); *value = (double) f32; break;
+  default: memcpy(value, raw, 8); break;
+  }
+  return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // load_ply()    Load a polyhedron described in a .ply file.                 //
@@ -1054,6 +1165,11 @@ bool tetgenio::load_off(char* filename)
 // format has exactly the same format for listing vertices and polygons as   //
 // off file format.                                                          //
 //                                                                           //
+// Binary files (little-endian or big-endian) are read as well.  Then the    //
+// properties listed in the header are used to locate the x, y and z of the  //
+// vertices and the list 'vertex_indices' of the faces, other properties and //
+// elements are skipped.                                                     //
+//                                                                           //
 // On completion, 'pointlist' and 'facetlist' together return the polyhedron.//
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
@@ -1067,10 +1183,17 @@ bool tetgenio::load_ply(char* filename)
   char buffer[INPUTLINESIZE];
   char *bufferp, *str;
   double *coord;
+  plyelement elements[PLYMAXELEMENTS], *elem;
+  plyproperty *prop;
+  plyreader reader;
+  char words[4][64], *name;
+  double value;
+  bool ok;
+  int numberofelements = 0, roles, swap, count, one;
   int endheader = 0, format = 0;
   int nverts = 0, iverts = 0;
   int nfaces = 0, ifaces = 0;
-  int line_count = 0, i;
+  int line_count = 0, i, j, k;
 
   strncpy(infilename, filename, FILENAMESIZE - 1);
   infilename[FILENAMESIZE - 1] = '\0';
@@ -1082,7 +1205,7 @@ bool tetgenio::load_ply(char* filename)
     strcat(infilename, ".ply");
   }
 
-  if (!(fp = fopen(infilename, "r"))) {
+  if (!(fp = fopen(infilename, "rb"))) {
     printf("Error:  Unable to open file %s\n", infilename);
     return false;
   }
@@ -1101,8 +1224,57 @@ bool tetgenio::load_ply(char* filename)
       if (str) {
         // This is the end of the header section.
         endheader = 1; 
+        // The binary data follow, they are read below.
+        if (format > 1) break;
         continue;
       }
+      // Record the elements and their properties.
+      if (!strncmp(bufferp, "element", 7)) {
+        if (numberofelements == PLYMAXELEMENTS) {
+          printf("Error:  Too many elements in file %s.\n", infilename);
+          fclose(fp);
+          return false;
+        }
+        elem = &elements[numberofelements++];
+        elem->count = 0;
+        elem->numberofproperties = 0;
+        words[0][0] = '\0';
+        sscanf(bufferp, "%*s %63s %d", words[0], &elem->count);
+        elem->kind = !strcmp(words[0], "vertex") ? 1 :
+                     (!strcmp(words[0], "face") ? 2 : 0);
+      } else if (!strncmp(bufferp, "property", 8) && (numberofelements > 0)) {
+        elem = &elements[numberofelements - 1];
+        if (elem->numberofproperties == PLYMAXPROPERTIES) {
+          printf("Error:  Too many properties in file %s.\n", infilename);
+          fclose(fp);
+          return false;
+        }
+        prop = &elem->properties[elem->numberofproperties++];
+        for (i = 0; i < 4; i++) words[i][0] = '\0';
+        sscanf(bufferp, "%*s %63s %63s %63s %63s", words[0], words[1],
+               words[2], words[3]);
+        if (!strcmp(words[0], "list")) {
+          // "property list <count type> <value type> <name>".
+          prop->counttype = plytypebyname(words[1]);
+          prop->type = plytypebyname(words[2]);
+          name = words[3];
+          if (prop->counttype == PLYNONE) prop->type = PLYNONE;
+        } else {
+          // "property <type> <name>".
+          prop->counttype = PLYNONE;
+          prop->type = plytypebyname(words[0]);
+          name = words[1];
+        }
+        prop->role = 0;
+        if ((elem->kind == 1) && (prop->counttype == PLYNONE)) {
+          if (!strcmp(name, "x")) prop->role = 1;
+          if (!strcmp(name, "y")) prop->role = 2;
+          if (!strcmp(name, "z")) prop->role = 3;
+        } else if ((elem->kind == 2) && (prop->counttype != PLYNONE)) {
+          if (!strcmp(name, "vertex_indices") ||
+              !strcmp(name, "vertex_index")) prop->role = 4;
+        }
+      }
       // Parse the number of vertices and the number of faces.
       if (nverts == 0 || nfaces == 0) {
         // Find if it si the keyword "element".
@@ -1128,7 +1300,7 @@ bool tetgenio::load_ply(char* filename)
                 fclose(fp);
                 return false;
               }
-              nverts = (int) strtol(bufferp, &bufferp, 0);
+              nverts = parseint(bufferp, &bufferp);
               // Allocate memory for 'tetgenio'
               if (nverts > 0) {
                 numberofpoints = nverts;
@@ -1149,7 +1321,7 @@ bool tetgenio::load_ply(char* filename)
                 fclose(fp);
                 return false;
               }
-              nfaces = (int) strtol(bufferp, &bufferp, 0);
+              nfaces = parseint(bufferp, &bufferp);
               // Allocate memory for 'tetgenio'
               if (nfaces > 0) {        
                 numberoffacets = nfaces;
@@ -1167,16 +1339,20 @@ bool tetgenio::load_ply(char* filename)
         if (str) {
           format = 1;
           bufferp = findnextfield(str);
-          // Find if it is the string "ascii".
+          // Find if it is the string "ascii", "binary_little_endian" or
+          //   "binary_big_endian".
           str = strstr(bufferp, "ascii");
           if (!str) str = strstr(bufferp, "ASCII");
           if (!str) {
-            printf("This routine only reads ascii format of ply files.\n");
-            printf("Hint: You can convert the binary to ascii format by\n");
-            printf("  using the provided ply tools:\n");
-            printf("  ply2ascii < %s > ascii_%s\n", infilename, infilename);
-            fclose(fp);
-            return false;
+            if (strstr(bufferp, "binary_little_endian")) {
+              format = 2;
+            } else if (strstr(bufferp, "binary_big_endian")) {
+              format = 3;
+            } else {
+              printf("Error:  Unknown format of file %s.\n", infilename);
+              fclose(fp);
+              return false;
+            }
           }
         }
       }
@@ -1190,7 +1366,7 @@ bool tetgenio::load_ply(char* filename)
           fclose(fp);
           return false;
         }
-        coord[i] = (REAL) strtod(bufferp, &bufferp);
+        coord[i] = parsereal(bufferp, &bufferp);
         bufferp = findnextnumber(bufferp);
       }
       iverts++;
@@ -1204,7 +1380,7 @@ bool tetgenio::load_ply(char* filename)
       p = &f->polygonlist[0];
       init(p);
       // Read the number of vertices, it should be greater than 0.
-      p->numberofvertices = (int) strtol(bufferp, &bufferp, 0);
+      p->numberofvertices = parseint(bufferp, &bufferp);
       if (p->numberofvertices == 0) {
         printf("Syntax error reading polygon on line %d in file %s\n",
                line_count, infilename);
@@ -1221,7 +1397,7 @@ bool tetgenio::load_ply(char* filename)
           fclose(fp);
           return false;
         }
-        p->vertexlist[i] = (int) strtol(bufferp, &bufferp, 0);
+        p->vertexlist[i] = parseint(bufferp, &bufferp);
       }
       ifaces++;
     } else {
@@ -1232,6 +1408,91 @@ bool tetgenio::load_ply(char* filename)
     }
   }
 
+  if (endheader && (format > 1)) {
+    // Read the binary data.  The bytes of each value are reversed if the
+    //   byte order of the file is not the one of this machine.
+    one = 1;
+    swap = (format == 3) == (* (char *) &one == 1);
+    reader.fp = fp;
+    reader.head = reader.tail = 0;
+    ok = true;
+    for (i = 0; (i < numberofelements) && ok; i++) {
+      elem = &elements[i];
+      roles = 0;
+      for (j = 0; j < elem->numberofproperties; j++) {
+        prop = &elem->properties[j];
+        if (prop->type == PLYNONE) {
+          printf("Error:  Unknown property type in file %s.\n", infilename);
+          fclose(fp);
+          return false;
+        }
+        if (prop->role > 0) roles |= 1 << prop->role;
+      }
+      if ((elem->kind == 1) &&
+          ((elem->count != nverts) || (roles != (2 | 4 | 8)))) {
+        printf("Error:  Unable to read the vertices in file %s.\n",
+               infilename);
+        fclose(fp);
+        return false;
+      }
+      if ((elem->kind == 2) && ((elem->count != nfaces) || (roles != 16))) {
+        printf("Error:  Unable to read the faces in file %s.\n",
+               infilename);
+        fclose(fp);
+        return false;
+      }
+      for (j = 0; (j < elem->count) && ok; j++) {
+        p = (tetgenio::polygon *) NULL;
+        for (k = 0; (k < elem->numberofproperties) && ok; k++) {
+          prop = &elem->properties[k];
+          if (prop->counttype == PLYNONE) {
+            ok = plyvalue(&reader, prop->type, swap, &value);
+            if ((prop->role > 0) && (prop->role < 4)) {
+              pointlist[iverts * 3 + prop->role - 1] = value;
+            }
+          } else if (prop->role == 4) {
+            // The vertices of a face.  Each facet has one polygon, no hole.
+            ok = plyvalue(&reader, prop->counttype, swap, &value);
+            count = (int) value;
+            if (!ok || (count < 1)) {
+              printf("Syntax error reading polygon %d in file %s\n",
+                     ifaces, infilename);
+              fclose(fp);
+              return false;
+            }
+            f = &facetlist[ifaces];
+            init(f);
+            f->numberofpolygons = 1;
+            f->polygonlist = new tetgenio::polygon[1];
+            p = &f->polygonlist[0];
+            init(p);
+            p->numberofvertices = count;
+            p->vertexlist = new int[count];
+            for (count = 0; (count < p->numberofvertices) && ok; count++) {
+              ok = plyvalue(&reader, prop->type, swap, &value);
+              if ((value < 0.0) || (value >= (double) nverts)) {
+                printf("Error:  Face %d has an invalid vertex in file %s.\n",
+                       ifaces, infilename);
+                fclose(fp);
+                return false;
+              }
+              p->vertexlist[count] = (int) value;
+            }
+          } else {
+            // Skip a list.
+            ok = plyvalue(&reader, prop->counttype, swap, &value);
+            for (count = (int) value; (count > 0) && ok; count--) {
+              ok = plyread(&reader, plytypesizes[prop->type]) != NULL;
+            }
+          }
+        }
+        if (!ok) break;
+        if (elem->kind == 1) iverts++;
+        if (p != (tetgenio::polygon *) NULL) ifaces++;
+      }
+    }
+  }
+
   // Close file
   fclose(fp);
 
@@ -1313,7 +1574,7 @@ bool tetgenio::load_medit(char* filename)
           // Read a non-empty line.
           bufferp = readline(buffer, fp, &line_count);
         }
-        nverts = (int) strtol(bufferp, &bufferp, 0);
+        nverts = parseint(bufferp, &bufferp);
         // Allocate memory for 'tetgenio'
         if (nverts > 0) {
           numberofpoints = nverts;
@@ -1338,7 +1599,7 @@ bool tetgenio::load_medit(char* filename)
               fclose(fp);
               return false;
             }
-            coord[j] = (REAL) strtod(bufferp, &bufferp);
+            coord[j] = parsereal(bufferp, &bufferp);
             bufferp = findnextnumber(bufferp);
           }
         }
@@ -1404,13 +1665,13 @@ bool tetgenio::load_medit(char* filename)
               fclose(fp);
               return false;
             }
-            p->vertexlist[j] = (int) strtol(bufferp, &bufferp, 0);
+            p->vertexlist[j] = parseint(bufferp, &bufferp);
             bufferp = findnextnumber(bufferp);
           }
           // Read the marker of the face if it exists.
           facetmarkerlist[i] = 0;
           if (*bufferp != '\0') {
-            facetmarkerlist[i] = (int) strtol(bufferp, &bufferp, 0);
+            facetmarkerlist[i] = parseint(bufferp, &bufferp);
           }
         }
         continue;
@@ -1427,158 +1688,961 @@ bool tetgenio::load_medit(char* filename)
 
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
-// load_gid()    Load a surface mesh described in .msh file.                 //
-//                                                                           //
-// 'filename' is the file name with extension .msh or without entension (The //
-// .msh will be added in this case). .msh is the file format of GID, a user- //
-// friendly interactive program.                                             //
+// Helpers for welding the corners of the triangles of a .stl file (see      //
+// load_stl()).                                                              //
 //                                                                           //
-// This routine ONLY reads the sections containing vertices and triangles,   //
-// other sections (such as tetrahedra, edges, ...) are ignored.              //
+// A .stl file lists each triangle with the coordinates of its own three     //
+// corners, the shared vertices are repeated.  They are welded through a     //
+// hash table keyed by the coordinates: corners with the same coordinates    //
+// become one point.  'table' is a power of two in size, an empty slot is    //
+// -1, and it is doubled when it is half full.                               //
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
-bool tetgenio::load_gid(char* filename)
-{ 
-  return true;
-}
+typedef struct {
+  REAL *points;
+  int numberofpoints, maxpoints;
+  int *table;
+  int tablesize;
+} stlwelder;
 
-///////////////////////////////////////////////////////////////////////////////
-//                                                                           //
-// load_plc()    Load a piecewise linear complex from file.                  //
-//                                                                           //
-// This is main entrance for loading plcs from different file formats into   //
-// tetgenio.  'filename' is the input file name without extention. 'object'  //
-// indicates which file format is used to describ the plc.                   //
-//                                                                           //
-///////////////////////////////////////////////////////////////////////////////
+static unsigned long long stlhash(REAL* xyz)
+{
+  unsigned long long bits[3], h;
 
-bool tetgenio::load_plc(char* filename, int object)
+  memcpy(bits, xyz, sizeof(bits));
+  h = bits[0] * 0x9e3779b97f4a7c15ULL;
+  h ^= bits[1] * 0xc2b2ae3d27d4eb4fULL;
+  h ^= bits[2] * 0x165667b19e3779f9ULL;
+  return h ^ (h >> 29);
+}
+
+// Return the index of the point at (x, y, z), add it if it is new.
+static int stlweld(stlwelder* w, REAL x, REAL y, REAL z)
 {
-  enum tetgenbehavior::objecttype type;
+  REAL xyz[3], *newpoints;
+  int *newtable, mask, slot, i;
+
+  // Adding 0.0 turns -0.0 into 0.0, so they are the same key.
+  xyz[0] = x + 0.0;
+  xyz[1] = y + 0.0;
+  xyz[2] = z + 0.0;
+  mask = w->tablesize - 1;
+  slot = (int) (stlhash(xyz) & mask);
+  while (w->table[slot] != -1) {
+    i = w->table[slot];
+    if ((w->points[3 * i] == xyz[0]) && (w->points[3 * i + 1] == xyz[1]) &&
+        (w->points[3 * i + 2] == xyz[2])) {
+      return i;
+    }
+    slot = (slot + 1) & mask;
+  }
+  // A new point.
+  if (w->numberofpoints == w->maxpoints) {
+    w->maxpoints *= 2;
+    newpoints = new REAL[w->maxpoints * 3];
+    memcpy(newpoints, w->points, w->numberofpoints * 3 * sizeof(REAL));
+    delete [] w->points;
+    w->points = newpoints;
+  }
+  i = w->numberofpoints++;
+  w->points[3 * i] = xyz[0];
+  w->points[3 * i + 1] = xyz[1];
+  w->points[3 * i + 2] = xyz[2];
+  w->table[slot] = i;
+  if (2 * w->numberofpoints > w->tablesize) {
+    // Double the table, and insert the points again.
+    w->tablesize *= 2;
+    newtable = new int[w->tablesize];
+    for (slot = 0; slot < w->tablesize; slot++) newtable[slot] = -1;
+    mask = w->tablesize - 1;
+    for (i = 0; i < w->numberofpoints; i++) {
+      slot = (int) (stlhash(&w->points[3 * i]) & mask);
+      while (newtable[slot] != -1) slot = (slot + 1) & mask;
+      newtable[slot] = i;
+    }
+    delete [] w->table;
+    w->table = newtable;
+    i = w->numberofpoints - 1;
+  }
+  return i;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// load_stl()    Load a surface mesh described in a .stl file.               //
+//                                                                           //
+// 'filename' is the file name with extension .stl or without extension (the //
+// .stl will be added in this case).  .stl is the stereolithography format,  //
+// a list of triangles.  Both the ASCII format ("solid", "facet normal",     //
+// "outer loop", three "vertex x y z", "endloop", "endfacet", ...) and the   //
+// binary format (an 80-byte header, the number of triangles, and for each   //
+// triangle 12 little-endian floats and a 2-byte attribute) are read.  The   //
+// file is binary if its size is 84 plus 50 times the number of triangles.   //
+//                                                                           //
+// The corners of the triangles are welded (see stlweld()), so 'pointlist'   //
+// holds each vertex once.  Each triangle becomes a facet with one polygon,  //
+// as in load_off().  Triangles with two welded corners are skipped.         //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+bool tetgenio::load_stl(char* filename)
+{
+  FILE *fp;
+  tetgenio::facet *f;
+  tetgenio::polygon *p;
+  stlwelder welder;
+  char infilename[FILENAMESIZE];
+  char buffer[INPUTLINESIZE];
+  char *bufferp, *str;
+  unsigned char header[84], *record, *records;
+  REAL xyz[3];
+  float value;
+  long filesize;
+  int *trilist, *newtrilist;
+  int ntris, maxtris, ncorners, nskips;
+  int line_count = 0, swap, one;
+  int i, j, k, l, m;
 
-  type = (enum tetgenbehavior::objecttype) object;
-  switch (type) {
-  case tetgenbehavior::NODES:
-    return load_node(filename);
-  case tetgenbehavior::POLY:
-    return load_poly(filename);
-  case tetgenbehavior::OFF:
-    return load_off(filename);
-  case tetgenbehavior::PLY:
-    return load_ply(filename);
-  case tetgenbehavior::MEDIT:
-    return load_medit(filename);
-  case tetgenbehavior::GID:
-    return load_gid(filename);
-  default:
-    return load_poly(filename);
+  strncpy(infilename, filename, FILENAMESIZE - 1);
+  infilename[FILENAMESIZE - 1] = '\0';
+  if (infilename[0] == '\0') {
+    printf("Error:  No filename.\n");
+    return false;
+  }
+  if (strcmp(&infilename[strlen(infilename) - 4], ".stl") != 0) {
+    strcat(infilename, ".stl");
+  }
+
+  if (!(fp = fopen(infilename, "rb"))) {
+    printf("File I/O Error:  Unable to open file %s\n", infilename);
+    return false;
+  }
+  printf("Opening %s.\n", infilename);
+
+  // The indices start from '0'.
+  firstnumber = 0;
+
+  fseek(fp, 0, SEEK_END);
+  filesize = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  ntris = 0;
+  if (fread(header, 1, 84, fp) == 84) {
+    ntris = (int) header[80] | ((int) header[81] << 8) |
+            ((int) header[82] << 16) | ((int) header[83] << 24);
+  }
+
+  welder.maxpoints = 1024;
+  welder.points = new REAL[welder.maxpoints * 3];
+  welder.numberofpoints = 0;
+  welder.tablesize = 2048;
+  welder.table = new int[welder.tablesize];
+  for (i = 0; i < welder.tablesize; i++) welder.table[i] = -1;
+
+  if ((filesize >= 84) && (ntris >= 0) &&
+      (filesize == 84 + 50 * (long) ntris)) {
+    // A binary file.  The floats are little-endian.
+    one = 1;
+    swap = (* (char *) &one != 1);
+    trilist = new int[ntris * 3 + 1];
+    records = new unsigned char[50 * 1024];
+    for (i = 0; i < ntris; i += 1024) {
+      m = ntris - i < 1024 ? ntris - i : 1024;
+      if (fread(records, 50, m, fp) != (size_t) m) {
+        printf("Error:  Unexpected end of file %s.\n", infilename);
+        delete [] records;
+        delete [] trilist;
+        delete [] welder.points;
+        delete [] welder.table;
+        fclose(fp);
+        return false;
+      }
+      for (j = 0; j < m; j++) {
+        // Skip the normal (12 bytes), read the three corners.
+        record = records + 50 * j + 12;
+        for (k = 0; k < 9; k++) {
+          if (swap) {
+            for (l = 0; l < 4; l++) {
+              ((unsigned char *) &value)[l] = record[4 * k + 3 - l];
+            }
+          } else {
+            memcpy(&value, record + 4 * k, 4);
+          }
+          xyz[k % 3] = (REAL) value;
+          if (k % 3 == 2) {
+            trilist[(i + j) * 3 + k / 3] = stlweld(&welder, xyz[0], xyz[1],
+                                                   xyz[2]);
+          }
+        }
+      }
+    }
+    delete [] records;
+  } else if ((filesize >= 5) && !strncmp((char *) header, "solid", 5)) {
+    // An ASCII file.  Only the "vertex" lines are used.
+    fseek(fp, 0, SEEK_SET);
+    maxtris = 1024;
+    trilist = new int[maxtris * 3];
+    ncorners = 0;
+    while ((bufferp = readline(buffer, fp, &line_count)) != NULL) {
+      if (strncmp(bufferp, "vertex", 6) != 0) continue;
+      bufferp = findnextnumber(bufferp);
+      for (k = 0; k < 3; k++) {
+        if (*bufferp == '\0') {
+          printf("Syntax error reading vertex coords on line %d in file %s\n",
+                 line_count, infilename);
+          delete [] trilist;
+          delete [] welder.points;
+          delete [] welder.table;
+          fclose(fp);
+          return false;
+        }
+        xyz[k] = parsereal(bufferp, &str);
+        bufferp = findnextnumber(str);
+      }
+      if (ncorners == maxtris * 3) {
+        maxtris *= 2;
+        newtrilist = new int[maxtris * 3];
+        memcpy(newtrilist, trilist, ncorners * sizeof(int));
+        delete [] trilist;
+        trilist = newtrilist;
+      }
+      trilist[ncorners++] = stlweld(&welder, xyz[0], xyz[1], xyz[2]);
+    }
+    if (ncorners % 3 != 0) {
+      printf("Error:  A triangle is not complete in file %s.\n", infilename);
+      delete [] trilist;
+      delete [] welder.points;
+      delete [] welder.table;
+      fclose(fp);
+      return false;
+    }
+    ntris = ncorners / 3;
+  } else {
+    printf("Error:  %s is not a .stl file.\n", infilename);
+    delete [] welder.points;
+    delete [] welder.table;
+    fclose(fp);
+    return false;
+  }
+  fclose(fp);
+  delete [] welder.table;
+
+  // Copy the welded points.
+  numberofpoints = welder.numberofpoints;
+  pointlist = new REAL[numberofpoints * 3];
+  memcpy(pointlist, welder.points, numberofpoints * 3 * sizeof(REAL));
+  delete [] welder.points;
+
+  // Create the facets, skip the degenerate triangles.
+  nskips = 0;
+  for (i = 0; i < ntris; i++) {
+    if ((trilist[i * 3] == trilist[i * 3 + 1]) ||
+        (trilist[i * 3 + 1] == trilist[i * 3 + 2]) ||
+        (trilist[i * 3 + 2] == trilist[i * 3])) {
+      nskips++;
+    }
+  }
+  numberoffacets = ntris - nskips;
+  facetlist = new tetgenio::facet[numberoffacets > 0 ? numberoffacets : 1];
+  j = 0;
+  for (i = 0; i < ntris; i++) {
+    if ((trilist[i * 3] == trilist[i * 3 + 1]) ||
+        (trilist[i * 3 + 1] == trilist[i * 3 + 2]) ||
+        (trilist[i * 3 + 2] == trilist[i * 3])) continue;
+    f = &facetlist[j++];
+    init(f);
+    // Each facet has one polygon, no hole.
+    f->numberofpolygons = 1;
+    f->polygonlist = new tetgenio::polygon[1];
+    p = &f->polygonlist[0];
+    init(p);
+    p->numberofvertices = 3;
+    p->vertexlist = new int[3];
+    for (k = 0; k < 3; k++) {
+      p->vertexlist[k] = trilist[i * 3 + k];
+    }
+  }
+  delete [] trilist;
+
+  if (nskips > 0) {
+    printf("Warning:  %d degenerate triangles in file %s are skipped.\n",
+           nskips, infilename);
   }
+  return true;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
-// load_tetmesh()    Load a tetrahedral mesh from files.                     //
+// Helpers for reading .msh files (see load_msh()).                          //
 //                                                                           //
-// 'filename' is the inputfile without suffix.  The nodes of the tetrahedral //
-// mesh is in "filename.node",  the elements is in "filename.ele", if the    //
-// "filename.face" and "filename.vol" exists, they will also be read.        //
+// A .msh file of Gmsh 4.1 is a sequence of sections, each starts with a     //
+// line "$Name" and ends with a line "$EndName".  In a binary file the data  //
+// of a section are raw ints, doubles and size_t's (of the size given in     //
+// $MeshFormat), in the byte order of the writer (an int 1 after the format  //
+// line tells it).  In an ASCII file the same values are separated by white  //
+// spaces.  The file is read through a 'plyreader' (see load_ply()), so the  //
+// text lines and the binary data can be read in turn.                       //
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
-bool tetgenio::load_tetmesh(char* filename)
+// The number of nodes of the Gmsh element types 1 to 19.
+static int mshtypenodes[20] = {0, 2, 3, 4, 4, 8, 6, 5, 3, 6, 9, 10, 27, 18,
+                               14, 1, 8, 20, 15, 13};
+
+// The kinds of the values in a .msh file.
+enum {MSHINT, MSHSIZE, MSHDOUBLE};
+
+typedef struct {
+  plyreader reader;
+  int binary, swap, datasize;
+} mshreader;
+
+static bool mshspace(unsigned char c)
 {
-  FILE *infile;
-  char innodefilename[FILENAMESIZE];
-  char inelefilename[FILENAMESIZE];
-  char infacefilename[FILENAMESIZE];
-  char involfilename[FILENAMESIZE];
-  char inputline[INPUTLINESIZE];
-  char *stringptr, *infilename;
-  REAL attrib, volume;
-  int volelements;
-  int markers, corner;
-  int index, attribindex;
-  int i, j;
+  return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+}
 
-  // Assembling the actual file names we want to open.
-  strcpy(innodefilename, filename);
-  strcpy(inelefilename, filename);
-  strcpy(infacefilename, filename);
-  strcpy(involfilename, filename);
-  strcat(innodefilename, ".node");
-  strcat(inelefilename, ".ele");
-  strcat(infacefilename, ".face");
-  strcat(involfilename, ".vol");
+// Read a nonempty line into 'line' (without the end of line).  Return false
+//   at the end of file.
+static bool mshline(mshreader* m, char* line, int size)
+{
+  unsigned char *c;
+  int n;
 
-  // Read the points from a .node file.
-  infilename = innodefilename;
-  printf("Opening %s.\n", infilename);
-  infile = fopen(infilename, "r");
-  if (infile == (FILE *) NULL) {
-    printf("File I/O Error:  Cannot access file %s.\n", infilename);
-    return false;
+  do {
+    n = 0;
+    while (((c = plyread(&m->reader, 1)) != NULL) && (*c != '\n')) {
+      if ((*c != '\r') && (n < size - 1)) line[n++] = (char) *c;
+    }
+    line[n] = '\0';
+    if ((c == NULL) && (n == 0)) return false;
+  } while (n == 0);
+  return true;
+}
+
+// Read a value of 'kind' into 'value'.  Return false (and a zero 'value')
+//   at the end of file.
+static bool mshvalue(mshreader* m, int kind, double* value)
+{
+  unsigned char *c, raw[8];
+  char word[64];
+  int i32;
+  unsigned int u32;
+  unsigned long long u64;
+  int size, n;
+
+  *value = 0.0;
+  if (!m->binary) {
+    // Skip the white spaces, then read a word.
+    while (((c = plyread(&m->reader, 1)) != NULL) && mshspace(*c));
+    n = 0;
+    while ((c != NULL) && !mshspace(*c)) {
+      if (n < 63) word[n++] = (char) *c;
+      c = plyread(&m->reader, 1);
+    }
+    word[n] = '\0';
+    if (n == 0) return false;
+    *value = strtod(word, (char **) NULL);
+    return true;
   }
-  // Read number of points, number of dimensions, number of point
-  //   attributes, and number of boundary markers.
-  stringptr = readnumberline(inputline, infile, infilename);
-  numberofpoints = (int) strtol (stringptr, &stringptr, 0);
-  stringptr = findnextnumber(stringptr);
-  if (*stringptr == '\0') {
-    mesh_dim = 3;
+  size = kind == MSHINT ? 4 : (kind == MSHSIZE ? m->datasize : 8);
+  c = plyread(&m->reader, size);
+  if (c == NULL) return false;
+  for (n = 0; n < size; n++) {
+    raw[n] = m->swap ? c[size - 1 - n] : c[n];
+  }
+  if (kind == MSHINT) {
+    memcpy(&i32, raw, 4);
+    *value = (double) i32;
+  } else if (kind == MSHDOUBLE) {
+    memcpy(value, raw, 8);
+  } else if (size == 4) {
+    memcpy(&u32, raw, 4);
+    *value = (double) u32;
   } else {
-    mesh_dim = (int) strtol (stringptr, &stringptr, 0);
+    memcpy(&u64, raw, 8);
+    *value = (double) u64;
   }
-  stringptr = findnextnumber(stringptr);
-  if (*stringptr == '\0') {
-    numberofpointattributes = 0;
-  } else {
-    numberofpointattributes = (int) strtol (stringptr, &stringptr, 0);
+  return true;
+}
+
+// Return the first physical tag of the entity 'tag', 'tags' holds pairs of
+//   an entity tag and its physical tag.
+static int mshphysical(int* tags, int numberoftags, int tag)
+{
+  int i;
+
+  for (i = 0; i < numberoftags; i++) {
+    if (tags[2 * i] == tag) return tags[2 * i + 1];
   }
-  stringptr = findnextnumber(stringptr);
-  if (*stringptr == '\0') {
-    markers = 0;  // Default value.
-  } else {
-    markers = (int) strtol (stringptr, &stringptr, 0);
+  return 0;
+}
+
+// Enlarge 'list' from 'oldsize' to 'newsize' ints.
+static int *mshgrow(int* list, int oldsize, int newsize)
+{
+  int *newlist;
+
+  newlist = new int[newsize > 0 ? newsize : 1];
+  if (oldsize > 0) {
+    memcpy(newlist, list, oldsize * sizeof(int));
   }
+  if (list != (int *) NULL) {
+    delete [] list;
+  }
+  return newlist;
+}
 
-  if (mesh_dim != 3) {
-    printf("Error:  load_tetmesh() only works for 3D points.\n");
-    fclose(infile);
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// load_msh()    Load a surface mesh or a tetrahedral mesh described in a    //
+//               .msh file.                                                  //
+//                                                                           //
+// 'filename' is the file name with extension .msh or without extension (the //
+// .msh will be added in this case).  .msh is the file format of Gmsh, only  //
+// version 4.1 (binary or ASCII) is read.  The sections $Entities, $Nodes    //
+// and $Elements are used, the others are skipped.                           //
+//                                                                           //
+// If 'mesh' is zero, the triangles and quadrangles become facets (with one  //
+// polygon each, as in load_medit()).  If 'mesh' is nonzero (-r), the        //
+// tetrahedra and triangles are returned in 'tetrahedronlist' and            //
+// 'trifacelist' (as load_tetmesh() does), second order elements are cut to  //
+// their corners.  Only the nodes of these elements are kept.  The markers   //
+// of the faces and the attributes of the tetrahedra are the first physical  //
+// tags of their entities (zero if none).  The tetrahedra have an attribute  //
+// only if a volume has a physical tag.                                      //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+bool tetgenio::load_msh(char* filename, int mesh)
+{
+  FILE *fp;
+  tetgenio::facet *f;
+  tetgenio::polygon *p;
+  mshreader m;
+  char infilename[FILENAMESIZE];
+  char line[INPUTLINESIZE], endline[INPUTLINESIZE];
+  const char *error;
+  unsigned char *bytes, raw[4];
+  double value, counts[4], version, mintag, maxtag;
+  int *surfacetags, *volumetags, *tagindex, *keep;
+  int *facelist, *facemarkers, *tetlist, *tetattribs;
+  int numberofsurfaces, numberofvolumes, volumemarkers;
+  int numberoffaces, numberoftets, numberofnodes;
+  int dim, tag, type, marker, nodes, corners, count, index;
+  int one, i, j, k;
+  bool ok;
+
+  strncpy(infilename, filename, FILENAMESIZE - 1);
+  infilename[FILENAMESIZE - 1] = '\0';
+  if (infilename[0] == '\0') {
+    printf("Error:  No filename.\n");
     return false;
   }
-  if (numberofpoints < 4) {
-    printf("File I/O error:  Input should has at least 4 points.\n");
-    fclose(infile);
-    return false;
+  if (strcmp(&infilename[strlen(infilename) - 4], ".msh") != 0) {
+    strcat(infilename, ".msh");
   }
 
-  // Load the list of nodes.
-  if (!load_node_call(infile, markers, infilename)) {
-    fclose(infile);
+  if (!(fp = fopen(infilename, "rb"))) {
+    printf("File I/O Error:  Unable to open file %s\n", infilename);
     return false;
   }
-
-  // Read the elements from a .ele file.
-  infilename = inelefilename;
   printf("Opening %s.\n", infilename);
-  infile = fopen(infilename, "r");
+
+  m.reader.fp = fp;
+  m.reader.head = m.reader.tail = 0;
+  m.binary = m.swap = 0;
+  m.datasize = 8;
+  surfacetags = volumetags = tagindex = (int *) NULL;
+  facelist = facemarkers = tetlist = tetattribs = (int *) NULL;
+  numberofsurfaces = numberofvolumes = volumemarkers = 0;
+  numberoffaces = numberoftets = numberofnodes = 0;
+  mintag = maxtag = 0.0;
+  error = (const char *) NULL;
+  ok = true;
+
+  while ((error == NULL) && mshline(&m, line, INPUTLINESIZE)) {
+    if (line[0] != '$') continue;
+    if (!strcmp(line, "$MeshFormat")) {
+      // "version file-type data-size".
+      version = 0.0;
+      i = j = 0;
+      if (mshline(&m, endline, INPUTLINESIZE)) {
+        sscanf(endline, "%lf %d %d", &version, &i, &j);
+      }
+      if ((version < 4.1) || (version >= 5.0)) {
+        error = "Only version 4.1 of .msh files can be read";
+        break;
+      }
+      m.binary = i;
+      m.datasize = j;
+      if (m.binary) {
+        if ((m.datasize != 4) && (m.datasize != 8)) {
+          error = "Unsupported data size";
+          break;
+        }
+        // An int 1 in the byte order of the file.
+        bytes = plyread(&m.reader, 4);
+        if (bytes == NULL) {
+          error = "Unexpected end of file";
+          break;
+        }
+        memcpy(&one, bytes, 4);
+        if (one != 1) {
+          // Try the reversed byte order.
+          for (i = 0; i < 4; i++) raw[i] = bytes[3 - i];
+          memcpy(&one, raw, 4);
+          if (one != 1) {
+            error = "Unknown byte order";
+            break;
+          }
+          m.swap = 1;
+        }
+      }
+    } else if (!strcmp(line, "$Entities")) {
+      for (i = 0; i < 4; i++) {
+        ok = mshvalue(&m, MSHSIZE, &counts[i]) && ok;
+      }
+      numberofsurfaces = (int) counts[2];
+      numberofvolumes = (int) counts[3];
+      surfacetags = new int[2 * numberofsurfaces + 1];
+      volumetags = new int[2 * numberofvolumes + 1];
+      // Points, curves, surfaces and volumes.
+      for (dim = 0; ok && (dim < 4); dim++) {
+        for (i = 0; ok && (i < (int) counts[dim]); i++) {
+          ok = mshvalue(&m, MSHINT, &value);
+          tag = (int) value;
+          // The coordinates of a point, or the bounding box.
+          for (k = 0; k < (dim == 0 ? 3 : 6); k++) {
+            ok = mshvalue(&m, MSHDOUBLE, &value) && ok;
+          }
+          ok = mshvalue(&m, MSHSIZE, &value) && ok;
+          count = (int) value;
+          marker = 0;
+          for (k = 0; ok && (k < count); k++) {
+            ok = mshvalue(&m, MSHINT, &value);
+            if (k == 0) marker = (int) value;
+          }
+          if (dim > 0) {
+            // Skip the bounding entities.
+            ok = mshvalue(&m, MSHSIZE, &value) && ok;
+            count = (int) value;
+            for (k = 0; ok && (k < count); k++) {
+              ok = mshvalue(&m, MSHINT, &value);
+            }
+          }
+          if (dim == 2) {
+            surfacetags[2 * i] = tag;
+            surfacetags[2 * i + 1] = marker;
+          } else if (dim == 3) {
+            volumetags[2 * i] = tag;
+            volumetags[2 * i + 1] = marker;
+            if (marker != 0) volumemarkers = 1;
+          }
+        }
+      }
+    } else if (!strcmp(line, "$Nodes")) {
+      // The number of blocks and nodes, the smallest and largest tags.
+      for (i = 0; i < 4; i++) {
+        ok = mshvalue(&m, MSHSIZE, &counts[i]) && ok;
+      }
+      numberofnodes = (int) counts[1];
+      mintag = counts[2];
+      maxtag = counts[3];
+      if (!ok || (numberofnodes < 1) || (mintag < 1.0) || (maxtag < mintag)) {
+        error = "Invalid $Nodes section";
+        break;
+      }
+      // The tags are mapped to the nodes by an array, whose size is given
+      //   by the range of the tags.  Don't let a few large tags blow it up.
+      if (maxtag - mintag >= 4.0 * numberofnodes) {
+        error = "Node tags are too sparse";
+        break;
+      }
+      pointlist = new REAL[numberofnodes * 3];
+      numberofpoints = numberofnodes;
+      // Map node tags to indices.
+      tagindex = new int[(int) (maxtag - mintag) + 1];
+      for (i = 0; i <= (int) (maxtag - mintag); i++) tagindex[i] = -1;
+      index = 0;
+      for (j = 0; ok && (error == NULL) && (j < (int) counts[0]); j++) {
+        ok = mshvalue(&m, MSHINT, &value);
+        dim = (int) value;
+        ok = mshvalue(&m, MSHINT, &value) && ok;
+        ok = mshvalue(&m, MSHINT, &value) && ok;
+        type = (int) value;  // Parametric coordinates follow.
+        ok = mshvalue(&m, MSHSIZE, &value) && ok;
+        count = (int) value;
+        if (index + count > numberofnodes) {
+          error = "Too many nodes";
+          break;
+        }
+        // First the tags, then the coordinates of the nodes.
+        for (i = 0; ok && (i < count); i++) {
+          ok = mshvalue(&m, MSHSIZE, &value);
+          if ((value < mintag) || (value > maxtag)) {
+            error = "Invalid node tag";
+            break;
+          }
+          tagindex[(int) (value - mintag)] = index + i;
+        }
+        for (i = 0; ok && (error == NULL) && (i < count); i++) {
+          for (k = 0; k < 3 + (type ? dim : 0); k++) {
+            ok = mshvalue(&m, MSHDOUBLE, &value) && ok;
+            if (k < 3) pointlist[(index + i) * 3 + k] = (REAL) value;
+          }
+        }
+        index += count;
+      }
+      if ((error == NULL) && ok && (index != numberofnodes)) {
+        error = "Invalid $Nodes section";
+      }
+    } else if (!strcmp(line, "$Elements")) {
+      if (tagindex == (int *) NULL) {
+        error = "$Elements before $Nodes";
+        break;
+      }
+      for (i = 0; i < 4; i++) {
+        ok = mshvalue(&m, MSHSIZE, &counts[i]) && ok;
+      }
+      for (j = 0; ok && (error == NULL) && (j < (int) counts[0]); j++) {
+        ok = mshvalue(&m, MSHINT, &value);
+        dim = (int) value;
+        ok = mshvalue(&m, MSHINT, &value) && ok;
+        tag = (int) value;
+        ok = mshvalue(&m, MSHINT, &value) && ok;
+        type = (int) value;
+        ok = mshvalue(&m, MSHSIZE, &value) && ok;
+        count = (int) value;
+        if ((type < 1) || (type > 19)) {
+          error = "Unknown element type";
+          break;
+        }
+        nodes = mshtypenodes[type];
+        // Which elements are kept, and how many of their nodes.
+        corners = 0;
+        if ((type == 2) || (type == 9)) {
+          corners = 3;                                 // Triangles.
+        } else if (!mesh && ((type == 3) || (type == 10) || (type == 16))) {
+          corners = 4;                                 // Quadrangles.
+        } else if (mesh && ((type == 4) || (type == 11))) {
+          corners = 4;                                 // Tetrahedra.
+        }
+        if (corners == 0) {
+          // Skip this block.
+          for (i = 0; ok && (i < count * (1 + nodes)); i++) {
+            ok = mshvalue(&m, MSHSIZE, &value);
+          }
+          continue;
+        }
+        if (dim == 3) {
+          marker = mshphysical(volumetags, numberofvolumes, tag);
+          tetlist = mshgrow(tetlist, numberoftets * 4,
+                            (numberoftets + count) * 4);
+          tetattribs = mshgrow(tetattribs, numberoftets,
+                               numberoftets + count);
+        } else {
+          marker = mshphysical(surfacetags, numberofsurfaces, tag);
+          facelist = mshgrow(facelist, numberoffaces * 4,
+                             (numberoffaces + count) * 4);
+          facemarkers = mshgrow(facemarkers, numberoffaces,
+                                numberoffaces + count);
+        }
+        for (i = 0; ok && (i < count); i++) {
+          // The element tag, then the node tags.
+          ok = mshvalue(&m, MSHSIZE, &value);
+          for (k = 0; ok && (k < nodes); k++) {
+            ok = mshvalue(&m, MSHSIZE, &value);
+            if (k >= corners) continue;
+            index = -1;
+            if ((value >= mintag) && (value <= maxtag)) {
+              index = tagindex[(int) (value - mintag)];
+            }
+            if (index < 0) {
+              error = "Invalid node tag";
+              break;
+            }
+            if (dim == 3) {
+              tetlist[(numberoftets + i) * 4 + k] = index;
+            } else {
+              facelist[(numberoffaces + i) * 4 + k] = index;
+            }
+          }
+          if (error != NULL) break;
+          if (dim == 3) {
+            tetattribs[numberoftets + i] = marker;
+          } else {
+            if (corners == 3) facelist[(numberoffaces + i) * 4 + 3] = -1;
+            facemarkers[numberoffaces + i] = marker;
+          }
+        }
+        if (dim == 3) {
+          numberoftets += count;
+        } else {
+          numberoffaces += count;
+        }
+      }
+    }
+    if (error == NULL) {
+      if (!ok) {
+        error = "Unexpected end of file";
+        break;
+      }
+      // Skip the rest of this section.
+      sprintf(endline, "$End%.*s", (int) sizeof(endline) - 5, &line[1]);
+      while (mshline(&m, line, INPUTLINESIZE) && strcmp(line, endline));
+    }
+  }
+  fclose(fp);
+
+  if ((error == NULL) && (numberofpoints == 0)) {
+    error = "No nodes";
+  }
+  if ((error == NULL) && (mesh ? numberoftets : numberoffaces) == 0) {
+    error = mesh ? "No tetrahedra" : "No triangles";
+  }
+
+  if (error == NULL) {
+    // Keep only the nodes of the elements, 'keep' maps their new indices.
+    keep = new int[numberofpoints];
+    for (i = 0; i < numberofpoints; i++) keep[i] = -1;
+    for (i = 0; i < numberoffaces * 4; i++) {
+      if (facelist[i] >= 0) keep[facelist[i]] = 0;
+    }
+    for (i = 0; i < numberoftets * 4; i++) {
+      keep[tetlist[i]] = 0;
+    }
+    j = 0;
+    for (i = 0; i < numberofpoints; i++) {
+      if (keep[i] < 0) continue;
+      keep[i] = j;
+      for (k = 0; k < 3; k++) {
+        pointlist[j * 3 + k] = pointlist[i * 3 + k];
+      }
+      j++;
+    }
+    numberofpoints = j;
+    // The tags of Gmsh start from '1'.
+    firstnumber = 1;
+    mesh_dim = 3;
+    if (mesh) {
+      numberoftetrahedra = numberoftets;
+      numberofcorners = 4;
+      tetrahedronlist = new int[numberoftets * 4];
+      for (i = 0; i < numberoftets * 4; i++) {
+        tetrahedronlist[i] = keep[tetlist[i]] + firstnumber;
+      }
+      if (volumemarkers) {
+        numberoftetrahedronattributes = 1;
+        tetrahedronattributelist = new REAL[numberoftets];
+        for (i = 0; i < numberoftets; i++) {
+          tetrahedronattributelist[i] = (REAL) tetattribs[i];
+        }
+      }
+      if (numberoffaces > 0) {
+        numberoftrifaces = numberoffaces;
+        trifacelist = new int[numberoffaces * 3];
+        trifacemarkerlist = new int[numberoffaces];
+        for (i = 0; i < numberoffaces; i++) {
+          for (k = 0; k < 3; k++) {
+            trifacelist[i * 3 + k] = keep[facelist[i * 4 + k]] + firstnumber;
+          }
+          trifacemarkerlist[i] = facemarkers[i];
+        }
+      }
+    } else {
+      numberoffacets = numberoffaces;
+      facetlist = new tetgenio::facet[numberoffacets];
+      facetmarkerlist = new int[numberoffacets];
+      for (i = 0; i < numberoffacets; i++) {
+        f = &facetlist[i];
+        init(f);
+        // Each facet has one polygon, no hole.
+        f->numberofpolygons = 1;
+        f->polygonlist = new tetgenio::polygon[1];
+        p = &f->polygonlist[0];
+        init(p);
+        p->numberofvertices = facelist[i * 4 + 3] < 0 ? 3 : 4;
+        p->vertexlist = new int[p->numberofvertices];
+        for (k = 0; k < p->numberofvertices; k++) {
+          p->vertexlist[k] = keep[facelist[i * 4 + k]] + firstnumber;
+        }
+        facetmarkerlist[i] = facemarkers[i];
+      }
+    }
+    delete [] keep;
+  } else {
+    printf("Error:  %s in file %s.\n", error, infilename);
+  }
+
+  if (surfacetags != (int *) NULL) delete [] surfacetags;
+  if (volumetags != (int *) NULL) delete [] volumetags;
+  if (tagindex != (int *) NULL) delete [] tagindex;
+  if (facelist != (int *) NULL) delete [] facelist;
+  if (facemarkers != (int *) NULL) delete [] facemarkers;
+  if (tetlist != (int *) NULL) delete [] tetlist;
+  if (tetattribs != (int *) NULL) delete [] tetattribs;
+  return error == NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// load_gid()    Load a surface mesh described in .msh file.                 //
+//                                                                           //
+// 'filename' is the file name with extension .msh or without entension (The //
+// .msh will be added in this case). .msh is the file format of GID, a user- //
+// friendly interactive program.                                             //
+//                                                                           //
+// This routine ONLY reads the sections containing vertices and triangles,   //
+// other sections (such as tetrahedra, edges, ...) are ignored.              //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+bool tetgenio::load_gid(char* filename)
+{ 
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// load_plc()    Load a piecewise linear complex from file.                  //
+//                                                                           //
+// This is main entrance for loading plcs from different file formats into   //
+// tetgenio.  'filename' is the input file name without extention. 'object'  //
+// indicates which file format is used to describ the plc.                   //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+bool tetgenio::load_plc(char* filename, int object)
+{
+  enum tetgenbehavior::objecttype type;
+
+  type = (enum tetgenbehavior::objecttype) object;
+  switch (type) {
+  case tetgenbehavior::NODES:
+    return load_node(filename);
+  case tetgenbehavior::POLY:
+    return load_poly(filename);
+  case tetgenbehavior::OFF:
+    return load_off(filename);
+  case tetgenbehavior::PLY:
+    return load_ply(filename);
+  case tetgenbehavior::MEDIT:
+    return load_medit(filename);
+  case tetgenbehavior::STL:
+    return load_stl(filename);
+  case tetgenbehavior::GID:
+    return load_gid(filename);
+  case tetgenbehavior::GMSH:
+    return load_msh(filename, 0);
+  default:
+    return load_poly(filename);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// load_tetmesh()    Load a tetrahedral mesh from files.                     //
+//                                                                           //
+// 'filename' is the inputfile without suffix.  The nodes of the tetrahedral //
+// mesh is in "filename.node",  the elements is in "filename.ele", if the    //
+// "filename.face" and "filename.vol" exists, they will also be read.        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+bool tetgenio::load_tetmesh(char* filename)
+{
+  FILE *infile;
+  char innodefilename[FILENAMESIZE];
+  char inelefilename[FILENAMESIZE];
+  char infacefilename[FILENAMESIZE];
+  char involfilename[FILENAMESIZE];
+  char inputline[INPUTLINESIZE];
+  char *stringptr, *infilename;
+  REAL attrib, volume;
+  int volelements;
+  int markers, corner;
+  int index, attribindex;
+  int i, j;
+
+  // Assembling the actual file names we want to open.
+  strcpy(innodefilename, filename);
+  strcpy(inelefilename, filename);
+  strcpy(infacefilename, filename);
+  strcpy(involfilename, filename);
+  strcat(innodefilename, ".node");
+  strcat(inelefilename, ".ele");
+  strcat(infacefilename, ".face");
+  strcat(involfilename, ".vol");
+
+  // Read the points from a .node file.
+  infilename = innodefilename;
+  printf("Opening %s.\n", infilename);
+  infile = fopen(infilename, "r");
+  if (infile == (FILE *) NULL) {
+    printf("File I/O Error:  Cannot access file %s.\n", infilename);
+    return false;
+  }
+  // Read number of points, number of dimensions, number of point
+  //   attributes, and number of boundary markers.
+  stringptr = readnumberline(inputline, infile, infilename);
+  numberofpoints = parseint(stringptr, &stringptr);
+  stringptr = findnextnumber(stringptr);
+  if (*stringptr == '\0') {
+    mesh_dim = 3;
+  } else {
+    mesh_dim = parseint(stringptr, &stringptr);
+  }
+  stringptr = findnextnumber(stringptr);
+  if (*stringptr == '\0') {
+    numberofpointattributes = 0;
+  } else {
+    numberofpointattributes = parseint(stringptr, &stringptr);
+  }
+  stringptr = findnextnumber(stringptr);
+  if (*stringptr == '\0') {
+    markers = 0;  // Default value.
+  } else {
+    markers = parseint(stringptr, &stringptr);
+  }
+
+  if (mesh_dim != 3) {
+    printf("Error:  load_tetmesh() only works for 3D points.\n");
+    fclose(infile);
+    return false;
+  }
+  if (numberofpoints < 4) {
+    printf("File I/O error:  Input should has at least 4 points.\n");
+    fclose(infile);
+    return false;
+  }
+
+  // Load the list of nodes.
+  if (!load_node_call(infile, markers, infilename)) {
+    fclose(infile);
+    return false;
+  }
+
+  // Read the elements from a .ele file.
+  infilename = inelefilename;
+  printf("Opening %s.\n", infilename);
+  infile = fopen(infilename, "r");
   if (infile != (FILE *) NULL) {
     // Read number of elements, number of corners (4 or 10), number of
     //   element attributes.
     stringptr = readnumberline(inputline, infile, infilename);
-    numberoftetrahedra = (int) strtol (stringptr, &stringptr, 0);
+    numberoftetrahedra = parseint(stringptr, &stringptr);
     stringptr = findnextnumber(stringptr);
     if (*stringptr == '\0') {
       numberofcorners = 4;  // Default read 4 nodes per element.
     } else {
-      numberofcorners = (int) strtol (stringptr, &stringptr, 0);
+      numberofcorners = parseint(stringptr, &stringptr);
     }
     stringptr = findnextnumber(stringptr);
     if (*stringptr == '\0') {
       numberoftetrahedronattributes = 0; // Default no attribute.
     } else {
-      numberoftetrahedronattributes = (int) strtol (stringptr, &stringptr, 0);
+      numberoftetrahedronattributes = parseint(stringptr, &stringptr);
     }
     if (numberofcorners != 4 && numberofcorners != 10) {
       printf("Error:  Wrong number of corners %d (should be 4 or 10).\n", 
@@ -1616,7 +2680,7 @@ bool tetgenio::load_tetmesh(char* filename)
                  i + firstnumber, j + 1, infilename);
           exit(1);
         }
-        corner = (int) strtol(stringptr, &stringptr, 0);
+        corner = parseint(stringptr, &stringptr);
         if (corner < firstnumber || corner >= numberofpoints + firstnumber) {
           printf("Error:  Tetrahedron %d has an invalid vertex index.\n",
                  i + firstnumber);
@@ -1630,7 +2694,7 @@ bool tetgenio::load_tetmesh(char* filename)
         if (*stringptr == '\0') {
           attrib = 0.0;
         } else {
-          attrib = (REAL) strtod(stringptr, &stringptr);
+          attrib = parsereal(stringptr, &stringptr);
         }
         tetrahedronattributelist[attribindex++] = attrib;
       }
@@ -1645,12 +2709,12 @@ bool tetgenio::load_tetmesh(char* filename)
     printf("Opening %s.\n", infilename);
     // Read number of faces, boundary markers.
     stringptr = readnumberline(inputline, infile, infilename);
-    numberoftrifaces = (int) strtol (stringptr, &stringptr, 0);
+    numberoftrifaces = parseint(stringptr, &stringptr);
     stringptr = findnextnumber(stringptr);
     if (*stringptr == '\0') {
       markers = 0;  // Default there is no marker per face.
     } else {
-      markers = (int) strtol (stringptr, &stringptr, 0);
+      markers = parseint(stringptr, &stringptr);
     }
     if (numberoftrifaces > 0) {
       trifacelist = new int[numberoftrifaces * 3];
@@ -1678,7 +2742,7 @@ bool tetgenio::load_tetmesh(char* filename)
                  i + firstnumber, j + 1, infilename);
           exit(1);
         }
-        corner = (int) strtol(stringptr, &stringptr, 0);
+        corner = parseint(stringptr, &stringptr);
         if (corner < firstnumber || corner >= numberofpoints + firstnumber) {
           printf("Error:  Face %d has an invalid vertex index.\n",
                  i + firstnumber);
@@ -1692,7 +2756,7 @@ bool tetgenio::load_tetmesh(char* filename)
         if (*stringptr == '\0') {
           attrib = 0.0;
         } else {
-          attrib = (REAL) strtod(stringptr, &stringptr);
+          attrib = parsereal(stringptr, &stringptr);
         }
         trifacemarkerlist[i] = (int) attrib;
       }
@@ -1707,7 +2771,7 @@ bool tetgenio::load_tetmesh(char* filename)
     printf("Opening %s.\n", infilename);
     // Read number of tetrahedra.
     stringptr = readnumberline(inputline, infile, infilename);
-    volelements = (int) strtol (stringptr, &stringptr, 0);
+    volelements = parseint(stringptr, &stringptr);
     if (volelements != numberoftetrahedra) {
       printf("Warning:  %s and %s disagree on number of tetrahedra.\n",
              inelefilename, involfilename);
@@ -1727,7 +2791,7 @@ bool tetgenio::load_tetmesh(char* filename)
       if (*stringptr == '\0') {
         volume = -1.0; // No constraint on this tetrahedron.
       } else {
-        volume = (REAL) strtod(stringptr, &stringptr);
+        volume = parsereal(stringptr, &stringptr);
       }
       tetrahedronvolumelist[i] = volume;
     }
@@ -1737,6 +2801,207 @@ bool tetgenio::load_tetmesh(char* filename)
   return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// load_binary()    Load a tetrahedral mesh from a binary .tgb file.         //
+//                                                                           //
+// 'filename' is the inputfile without suffix.  A .tgb file (written by      //
+// save_binary()) starts with the four characters "TGB1" and a header of 13  //
+// integers: a byte order mark (0x01020304), sizeof(REAL), 'firstnumber',    //
+// 'mesh_dim', 'numberofpoints', 'numberofpointattributes', a point marker   //
+// flag, 'numberoftetrahedra', 'numberofcorners',                            //
+// 'numberoftetrahedronattributes', 'numberoftrifaces', a face marker flag,  //
+// and a volume constraint flag.  Then follow the raw arrays 'pointlist',    //
+// 'pointattributelist', 'pointmarkerlist', 'tetrahedronlist',               //
+// 'tetrahedronattributelist', 'tetrahedronvolumelist', 'trifacelist', and   //
+// 'trifacemarkerlist' (an array is absent if its count or flag is zero).    //
+//                                                                           //
+// The arrays are stored in the byte order of the machine which wrote them   //
+// (little-endian on x86).  Each array is read with one fread(), no text is  //
+// parsed.  A file written with a different byte order or REAL is rejected.  //
+// So is a header with a negative count, an array size which overflows an   //
+// int, or arrays which do not fit in the rest of the file, before anything  //
+// is allocated.                                                             //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+bool tetgenio::load_binary(char* filename)
+{
+  FILE *infile;
+  char inbinfilename[FILENAMESIZE];
+  char magic[4];
+  int header[13];
+  int pointmarkers, facemarkers, volumes;
+  double items[8], bytes;
+  long start, filesize;
+  int itemsize[8];
+  int corner, i;
+
+  strcpy(inbinfilename, filename);
+  strcat(inbinfilename, ".tgb");
+
+  printf("Opening %s.\n", inbinfilename);
+  infile = fopen(inbinfilename, "rb");
+  if (infile == (FILE *) NULL) {
+    printf("File I/O Error:  Cannot access file %s.\n", inbinfilename);
+    return false;
+  }
+  if ((fread(magic, sizeof(char), 4, infile) != 4) ||
+      (fread(header, sizeof(int), 13, infile) != 13) ||
+      strncmp(magic, "TGB1", 4)) {
+    printf("File I/O Error:  %s is not a .tgb file.\n", inbinfilename);
+    fclose(infile);
+    return false;
+  }
+  if ((header[0] != 0x01020304) || (header[1] != (int) sizeof(REAL))) {
+    printf("File I/O Error:  %s was written on a different machine.\n",
+           inbinfilename);
+    fclose(infile);
+    return false;
+  }
+  firstnumber = header[2];
+  mesh_dim = header[3];
+  numberofpoints = header[4];
+  numberofpointattributes = header[5];
+  pointmarkers = header[6];
+  numberoftetrahedra = header[7];
+  numberofcorners = header[8];
+  numberoftetrahedronattributes = header[9];
+  numberoftrifaces = header[10];
+  facemarkers = header[11];
+  volumes = header[12];
+
+  if (mesh_dim != 3) {
+    printf("Error:  load_binary() only works for 3D points.\n");
+    fclose(infile);
+    return false;
+  }
+  if (numberofpoints < 4) {
+    printf("File I/O error:  Input should has at least 4 points.\n");
+    fclose(infile);
+    return false;
+  }
+  if ((numberoftetrahedra < 1) || (numberofcorners < 4)) {
+    printf("File I/O error:  %s has no tetrahedra.\n", inbinfilename);
+    fclose(infile);
+    return false;
+  }
+  if ((numberofpointattributes < 0) || (numberoftetrahedronattributes < 0)
+      || (numberoftrifaces < 0)) {
+    printf("File I/O Error:  %s has a negative count.\n", inbinfilename);
+    fclose(infile);
+    return false;
+  }
+
+  // The header is not trusted: the size of each array must fit in an int,
+  //   and all arrays must fit in the rest of the file.
+  items[0] = (double) numberofpoints * 3.0;
+  items[1] = (double) numberofpoints * (double) numberofpointattributes;
+  items[2] = pointmarkers ? (double) numberofpoints : 0.0;
+  items[3] = (double) numberoftetrahedra * (double) numberofcorners;
+  items[4] = (double) numberoftetrahedra *
+             (double) numberoftetrahedronattributes;
+  items[5] = volumes ? (double) numberoftetrahedra : 0.0;
+  items[6] = (double) numberoftrifaces * 3.0;
+  items[7] = facemarkers ? (double) numberoftrifaces : 0.0;
+  itemsize[0] = itemsize[1] = itemsize[4] = itemsize[5] = sizeof(REAL);
+  itemsize[2] = itemsize[3] = itemsize[6] = itemsize[7] = sizeof(int);
+  bytes = 0.0;
+  for (i = 0; i < 8; i++) {
+    if (items[i] > (double) INT_MAX) {
+      printf("File I/O Error:  %s has a count which is too large.\n",
+             inbinfilename);
+      fclose(infile);
+      return false;
+    }
+    bytes += items[i] * (double) itemsize[i];
+  }
+  start = ftell(infile);
+  fseek(infile, 0, SEEK_END);
+  filesize = ftell(infile);
+  fseek(infile, start, SEEK_SET);
+  if (bytes > (double) (filesize - start)) {
+    printf("File I/O Error:  %s is shorter than its header says.\n",
+           inbinfilename);
+    fclose(infile);
+    return false;
+  }
+
+  // Allocate all arrays before reading them.
+  pointlist = new REAL[numberofpoints * 3];
+  if (numberofpointattributes > 0) {
+    pointattributelist = new REAL[numberofpoints * numberofpointattributes];
+  }
+  if (pointmarkers) {
+    pointmarkerlist = new int[numberofpoints];
+  }
+  tetrahedronlist = new int[numberoftetrahedra * numberofcorners];
+  if (numberoftetrahedronattributes > 0) {
+    tetrahedronattributelist = new REAL[numberoftetrahedra *
+                                        numberoftetrahedronattributes];
+  }
+  if (volumes) {
+    tetrahedronvolumelist = new REAL[numberoftetrahedra];
+  }
+  if (numberoftrifaces > 0) {
+    trifacelist = new int[numberoftrifaces * 3];
+    if (facemarkers) {
+      trifacemarkerlist = new int[numberoftrifaces];
+    }
+  }
+
+  if ((fread(pointlist, sizeof(REAL), numberofpoints * 3, infile) !=
+       (size_t) (numberofpoints * 3)) ||
+      ((pointattributelist != (REAL *) NULL) &&
+       (fread(pointattributelist, sizeof(REAL), numberofpoints *
+              numberofpointattributes, infile) !=
+        (size_t) (numberofpoints * numberofpointattributes))) ||
+      ((pointmarkerlist != (int *) NULL) &&
+       (fread(pointmarkerlist, sizeof(int), numberofpoints, infile) !=
+        (size_t) numberofpoints)) ||
+      (fread(tetrahedronlist, sizeof(int), numberoftetrahedra *
+             numberofcorners, infile) !=
+       (size_t) (numberoftetrahedra * numberofcorners)) ||
+      ((tetrahedronattributelist != (REAL *) NULL) &&
+       (fread(tetrahedronattributelist, sizeof(REAL), numberoftetrahedra *
+              numberoftetrahedronattributes, infile) !=
+        (size_t) (numberoftetrahedra * numberoftetrahedronattributes))) ||
+      ((tetrahedronvolumelist != (REAL *) NULL) &&
+       (fread(tetrahedronvolumelist, sizeof(REAL), numberoftetrahedra,
+              infile) != (size_t) numberoftetrahedra)) ||
+      ((trifacelist != (int *) NULL) &&
+       (fread(trifacelist, sizeof(int), numberoftrifaces * 3, infile) !=
+        (size_t) (numberoftrifaces * 3))) ||
+      ((trifacemarkerlist != (int *) NULL) &&
+       (fread(trifacemarkerlist, sizeof(int), numberoftrifaces, infile) !=
+        (size_t) numberoftrifaces))) {
+    printf("File I/O Error:  %s is truncated.\n", inbinfilename);
+    fclose(infile);
+    return false;
+  }
+  fclose(infile);
+
+  // The indices were not parsed, check them once here.
+  for (i = 0; i < numberoftetrahedra * numberofcorners; i++) {
+    corner = tetrahedronlist[i];
+    if (corner < firstnumber || corner >= numberofpoints + firstnumber) {
+      printf("Error:  Tetrahedron %d has an invalid vertex index.\n",
+             i / numberofcorners + firstnumber);
+      return false;
+    }
+  }
+  for (i = 0; i < numberoftrifaces * 3; i++) {
+    corner = trifacelist[i];
+    if (corner < firstnumber || corner >= numberofpoints + firstnumber) {
+      printf("Error:  Face %d has an invalid vertex index.\n",
+             i / 3 + firstnumber);
+      return false;
+    }
+  }
+
+  return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // save_nodes()    Save points to a .node file.                              //
@@ -1749,29 +3014,33 @@ void tetgenio::save_nodes(char* filename)
 {
   FILE *fout;
   char outnodefilename[FILENAMESIZE];
+  char outputline[OUTPUTLINESIZE], *s;
   int i, j;
 
   sprintf(outnodefilename, "%s.node", filename);
   printf("Saving nodes to %s\n", outnodefilename);
   fout = fopen(outnodefilename, "w");
+  setvbuf(fout, (char *) NULL, _IOFBF, OUTPUTBUFFERSIZE);
   fprintf(fout, "%d  %d  %d  %d\n", numberofpoints, mesh_dim,
           numberofpointattributes, pointmarkerlist != NULL ? 1 : 0);
   for (i = 0; i < numberofpoints; i++) {
-    if (mesh_dim == 2) {
-      fprintf(fout, "%d  %.16g  %.16g", i + firstnumber, pointlist[i * 2],
-              pointlist[i * 2 + 1]);
-    } else {
-      fprintf(fout, "%d  %.16g  %.16g  %.16g", i + firstnumber,
-              pointlist[i * 3], pointlist[i * 3 + 1], pointlist[i * 3 + 2]);
+    s = formatint(outputline, "", i + firstnumber, 0);
+    for (j = 0; j < mesh_dim; j++) {
+      s = formatreal(s, "  ", pointlist[i * mesh_dim + j]);
     }
     for (j = 0; j < numberofpointattributes; j++) {
-      fprintf(fout, "  %.16g", 
-              pointattributelist[i * numberofpointattributes+j]);
+      if (s - outputline > OUTPUTLINESIZE - 64) {
+        fputs(outputline, fout);
+        s = outputline;
+      }
+      s = formatreal(s, "  ",
+                     pointattributelist[i * numberofpointattributes + j]);
     }
     if (pointmarkerlist != NULL) {
-      fprintf(fout, "  %d", pointmarkerlist[i]);
+      s = formatint(s, "  ", pointmarkerlist[i], 0);
     }
-    fprintf(fout, "\n");
+    strcpy(s, "\n");
+    fputs(outputline, fout);
   }
 
   fclose(fout);
@@ -1789,23 +3058,30 @@ void tetgenio::save_elements(char* filename)
 {
   FILE *fout;
   char outelefilename[FILENAMESIZE];
+  char outputline[OUTPUTLINESIZE], *s;
   int i, j;
 
   sprintf(outelefilename, "%s.ele", filename);
   printf("Saving elements to %s\n", outelefilename);
   fout = fopen(outelefilename, "w");
+  setvbuf(fout, (char *) NULL, _IOFBF, OUTPUTBUFFERSIZE);
   fprintf(fout, "%d  %d  %d\n", numberoftetrahedra, numberofcorners,
           numberoftetrahedronattributes);
   for (i = 0; i < numberoftetrahedra; i++) {
-    fprintf(fout, "%d", i + firstnumber);
+    s = formatint(outputline, "", i + firstnumber, 0);
     for (j = 0; j < numberofcorners; j++) {
-      fprintf(fout, "  %5d", tetrahedronlist[i * numberofcorners + j]);
+      s = formatint(s, "  ", tetrahedronlist[i * numberofcorners + j], 5);
     }
     for (j = 0; j < numberoftetrahedronattributes; j++) {
-      fprintf(fout, "  %g",
+      if (s - outputline > OUTPUTLINESIZE - 64) {
+        fputs(outputline, fout);
+        s = outputline;
+      }
+      s = formatreal(s, "  ",
         tetrahedronattributelist[i * numberoftetrahedronattributes + j]);
     }
-    fprintf(fout, "\n");
+    strcpy(s, "\n");
+    fputs(outputline, fout);
   }
 
   fclose(fout);
@@ -1823,20 +3099,25 @@ void tetgenio::save_faces(char* filename)
 {
   FILE *fout;
   char outfacefilename[FILENAMESIZE];
+  char outputline[OUTPUTLINESIZE], *s;
   int i;
 
   sprintf(outfacefilename, "%s.face", filename);
   printf("Saving faces to %s\n", outfacefilename);
   fout = fopen(outfacefilename, "w");
+  setvbuf(fout, (char *) NULL, _IOFBF, OUTPUTBUFFERSIZE);
   fprintf(fout, "%d  %d\n", numberoftrifaces, 
           trifacemarkerlist != NULL ? 1 : 0);
   for (i = 0; i < numberoftrifaces; i++) {
-    fprintf(fout, "%d  %5d  %5d  %5d", i + firstnumber, trifacelist[i * 3],
-            trifacelist[i * 3 + 1], trifacelist[i * 3 +2]);
+    s = formatint(outputline, "", i + firstnumber, 0);
+    s = formatint(s, "  ", trifacelist[i * 3], 5);
+    s = formatint(s, "  ", trifacelist[i * 3 + 1], 5);
+    s = formatint(s, "  ", trifacelist[i * 3 + 2], 5);
     if (trifacemarkerlist != NULL) {
-      fprintf(fout, "  %d", trifacemarkerlist[i]);
+      s = formatint(s, "  ", trifacemarkerlist[i], 0);
     }
-    fprintf(fout, "\n");
+    strcpy(s, "\n");
+    fputs(outputline, fout);
   }
 
   fclose(fout);
@@ -1854,19 +3135,23 @@ void tetgenio::save_edges(char* filename)
 {
   FILE *fout;
   char outedgefilename[FILENAMESIZE];
+  char outputline[OUTPUTLINESIZE], *s;
   int i;
 
   sprintf(outedgefilename, "%s.edge", filename);
   printf("Saving edges to %s\n", outedgefilename);
   fout = fopen(outedgefilename, "w");
+  setvbuf(fout, (char *) NULL, _IOFBF, OUTPUTBUFFERSIZE);
   fprintf(fout, "%d  %d\n", numberofedges, edgemarkerlist != NULL ? 1 : 0);
   for (i = 0; i < numberofedges; i++) {
-    fprintf(fout, "%d  %4d  %4d", i + firstnumber, edgelist[i * 2],
-            edgelist[i * 2 + 1]);
+    s = formatint(outputline, "", i + firstnumber, 0);
+    s = formatint(s, "  ", edgelist[i * 2], 4);
+    s = formatint(s, "  ", edgelist[i * 2 + 1], 4);
     if (edgemarkerlist != NULL) {
-      fprintf(fout, "  %d", edgemarkerlist[i]);
+      s = formatint(s, "  ", edgemarkerlist[i], 0);
     }
-    fprintf(fout, "\n");
+    strcpy(s, "\n");
+    fputs(outputline, fout);
   }
 
   fclose(fout);
@@ -1884,22 +3169,21 @@ void tetgenio::save_neighbors(char* filename)
 {
   FILE *fout;
   char outneighborfilename[FILENAMESIZE];
-  int i;
+  char outputline[OUTPUTLINESIZE], *s;
+  int i, j;
 
   sprintf(outneighborfilename, "%s.neigh", filename);
   printf("Saving neighbors to %s\n", outneighborfilename);
   fout = fopen(outneighborfilename, "w");
+  setvbuf(fout, (char *) NULL, _IOFBF, OUTPUTBUFFERSIZE);
   fprintf(fout, "%d  %d\n", numberoftetrahedra, mesh_dim + 1);
   for (i = 0; i < numberoftetrahedra; i++) {
-    if (mesh_dim == 2) {
-      fprintf(fout, "%d  %5d  %5d  %5d", i + firstnumber,  neighborlist[i * 3],
-              neighborlist[i * 3 + 1], neighborlist[i * 3 + 2]);
-    } else {
-      fprintf(fout, "%d  %5d  %5d  %5d  %5d", i + firstnumber,
-              neighborlist[i * 4], neighborlist[i * 4 + 1],
-              neighborlist[i * 4 + 2], neighborlist[i * 4 + 3]);
+    s = formatint(outputline, "", i + firstnumber, 0);
+    for (j = 0; j <= mesh_dim; j++) {
+      s = formatint(s, "  ", neighborlist[i * (mesh_dim + 1) + j], 5);
     }
-    fprintf(fout, "\n");
+    strcpy(s, "\n");
+    fputs(outputline, fout);
   }
 
   fclose(fout);
@@ -2007,6 +3291,256 @@ void tetgenio::save_poly(char* filename)
   fclose(fout);  
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// save_binary()    Save the mesh to a binary .tgb file.                     //
+//                                                                           //
+// 'filename' is a string containing the file name without suffix.  See      //
+// load_binary() for the layout of the file.                                 //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenio::save_binary(char* filename)
+{
+  FILE *fout;
+  char outbinfilename[FILENAMESIZE];
+  int header[13];
+
+  sprintf(outbinfilename, "%s.tgb", filename);
+  fout = fopen(outbinfilename, "wb");
+  if (fout == (FILE *) NULL) {
+    printf("File I/O Error:  Cannot create file %s.\n", outbinfilename);
+    return;
+  }
+
+  header[0] = 0x01020304;
+  header[1] = (int) sizeof(REAL);
+  header[2] = firstnumber;
+  header[3] = mesh_dim;
+  header[4] = numberofpoints;
+  header[5] = pointattributelist != NULL ? numberofpointattributes : 0;
+  header[6] = pointmarkerlist != NULL ? 1 : 0;
+  header[7] = tetrahedronlist != NULL ? numberoftetrahedra : 0;
+  header[8] = numberofcorners;
+  header[9] = (header[7] > 0) && (tetrahedronattributelist != NULL) ?
+    numberoftetrahedronattributes : 0;
+  header[10] = trifacelist != NULL ? numberoftrifaces : 0;
+  header[11] = trifacemarkerlist != NULL ? 1 : 0;
+  header[12] = (header[7] > 0) && (tetrahedronvolumelist != NULL) ? 1 : 0;
+  fwrite("TGB1", sizeof(char), 4, fout);
+  fwrite(header, sizeof(int), 13, fout);
+
+  fwrite(pointlist, sizeof(REAL), numberofpoints * mesh_dim, fout);
+  if (header[5] > 0) {
+    fwrite(pointattributelist, sizeof(REAL), numberofpoints * header[5],
+           fout);
+  }
+  if (header[6]) {
+    fwrite(pointmarkerlist, sizeof(int), numberofpoints, fout);
+  }
+  if (header[7] > 0) {
+    fwrite(tetrahedronlist, sizeof(int), header[7] * numberofcorners, fout);
+    if (header[9] > 0) {
+      fwrite(tetrahedronattributelist, sizeof(REAL), header[7] * header[9],
+             fout);
+    }
+    if (header[12]) {
+      fwrite(tetrahedronvolumelist, sizeof(REAL), header[7], fout);
+    }
+  }
+  if (header[10] > 0) {
+    fwrite(trifacelist, sizeof(int), header[10] * 3, fout);
+    if (header[11]) {
+      fwrite(trifacemarkerlist, sizeof(int), header[10], fout);
+    }
+  }
+
+  fclose(fout);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// save_msh()    Save the mesh to a binary .msh file.                        //
+//                                                                           //
+// 'filename' is a string containing the file name without suffix.  The file //
+// is in the binary format of Gmsh 4.1 (see load_msh()).  The faces with the //
+// same marker form a surface, the tetrahedra with the same first attribute  //
+// form a volume.  A nonzero marker or attribute becomes the physical tag of //
+// the surface or volume.  The nodes are numbered from 1.  The extra nodes   //
+// of second order tetrahedra are reordered to the numbering of Gmsh.        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenio::save_msh(char* filename)
+{
+  FILE *fout;
+  char outmshfilename[FILENAMESIZE];
+  double bbox[6], coord;
+  size_t sizes[4], tags[11];
+  int *surfaces, *volumes, *entities;
+  int numberofsurfaces, numberofvolumes, numberofelements;
+  int ints[3], one, marker, corners, type;
+  int i, j, k, l;
+  // The order of the Gmsh nodes of a 10-node tetrahedron in 'tetrahedronlist'.
+  int gmshorder[10] = {0, 1, 2, 3, 4, 5, 6, 7, 9, 8};
+
+  sprintf(outmshfilename, "%s.msh", filename);
+  fout = fopen(outmshfilename, "wb");
+  if (fout == (FILE *) NULL) {
+    printf("File I/O Error:  Cannot create file %s.\n", outmshfilename);
+    return;
+  }
+
+  // Collect the distinct face markers and tetrahedron attributes.  There is
+  //   at least one volume, it holds the nodes.
+  surfaces = new int[numberoftrifaces + 1];
+  volumes = new int[numberoftetrahedra + 1];
+  entities = new int[numberoftrifaces + numberoftetrahedra + 1];
+  numberofsurfaces = 0;
+  for (i = 0; i < numberoftrifaces; i++) {
+    marker = trifacemarkerlist != NULL ? trifacemarkerlist[i] : 0;
+    for (j = 0; (j < numberofsurfaces) && (surfaces[j] != marker); j++);
+    if (j == numberofsurfaces) surfaces[numberofsurfaces++] = marker;
+    entities[i] = j;
+  }
+  numberofvolumes = 0;
+  for (i = 0; i < numberoftetrahedra; i++) {
+    marker = (tetrahedronattributelist != NULL) &&
+      (numberoftetrahedronattributes > 0) ? (int)
+      tetrahedronattributelist[i * numberoftetrahedronattributes] : 0;
+    for (j = 0; (j < numberofvolumes) && (volumes[j] != marker); j++);
+    if (j == numberofvolumes) volumes[numberofvolumes++] = marker;
+    entities[numberoftrifaces + i] = j;
+  }
+  if (numberofvolumes == 0) {
+    volumes[numberofvolumes++] = 0;
+  }
+  corners = numberofcorners == 10 ? 10 : 4;
+  // Gmsh's types of 3-node triangles, 4-node and 10-node tetrahedra.
+  type = corners == 10 ? 11 : 4;
+
+  // The bounding box of the nodes, it is given to every entity.
+  for (k = 0; k < 3; k++) {
+    bbox[k] = bbox[3 + k] = numberofpoints > 0 ? pointlist[k] : 0.0;
+  }
+  for (i = 1; i < numberofpoints; i++) {
+    for (k = 0; k < 3; k++) {
+      if (pointlist[i * 3 + k] < bbox[k]) bbox[k] = pointlist[i * 3 + k];
+      if (pointlist[i * 3 + k] > bbox[3 + k]) {
+        bbox[3 + k] = pointlist[i * 3 + k];
+      }
+    }
+  }
+
+  fprintf(fout, "$MeshFormat\n4.1 1 %d\n", (int) sizeof(size_t));
+  one = 1;
+  fwrite(&one, sizeof(int), 1, fout);
+  fprintf(fout, "\n$EndMeshFormat\n");
+
+  // No points and curves, the surfaces and volumes.
+  fprintf(fout, "$Entities\n");
+  sizes[0] = sizes[1] = 0;
+  sizes[2] = (size_t) numberofsurfaces;
+  sizes[3] = (size_t) numberofvolumes;
+  fwrite(sizes, sizeof(size_t), 4, fout);
+  for (i = 0; i < numberofsurfaces + numberofvolumes; i++) {
+    marker = i < numberofsurfaces ? surfaces[i] :
+      volumes[i - numberofsurfaces];
+    ints[0] = (i < numberofsurfaces ? i : i - numberofsurfaces) + 1;
+    fwrite(ints, sizeof(int), 1, fout);
+    fwrite(bbox, sizeof(double), 6, fout);
+    // The physical tag, and no bounding entities.
+    sizes[0] = marker != 0 ? 1 : 0;
+    fwrite(sizes, sizeof(size_t), 1, fout);
+    if (marker != 0) {
+      fwrite(&marker, sizeof(int), 1, fout);
+    }
+    sizes[0] = 0;
+    fwrite(sizes, sizeof(size_t), 1, fout);
+  }
+  fprintf(fout, "\n$EndEntities\n");
+
+  // All nodes are in one block of the first volume.
+  fprintf(fout, "$Nodes\n");
+  sizes[0] = 1;
+  sizes[1] = (size_t) numberofpoints;
+  sizes[2] = 1;
+  sizes[3] = (size_t) numberofpoints;
+  fwrite(sizes, sizeof(size_t), 4, fout);
+  ints[0] = 3;
+  ints[1] = 1;
+  ints[2] = 0;
+  fwrite(ints, sizeof(int), 3, fout);
+  fwrite(&sizes[1], sizeof(size_t), 1, fout);
+  for (i = 0; i < numberofpoints; i++) {
+    tags[0] = (size_t) (i + 1);
+    fwrite(tags, sizeof(size_t), 1, fout);
+  }
+  for (i = 0; i < numberofpoints * 3; i++) {
+    coord = (double) pointlist[i];
+    fwrite(&coord, sizeof(double), 1, fout);
+  }
+  fprintf(fout, "\n$EndNodes\n");
+
+  // One block for each surface and volume.
+  fprintf(fout, "$Elements\n");
+  numberofelements = numberoftrifaces + numberoftetrahedra;
+  sizes[0] = (size_t) ((numberoftrifaces > 0 ? numberofsurfaces : 0) +
+                       (numberoftetrahedra > 0 ? numberofvolumes : 0));
+  sizes[1] = (size_t) numberofelements;
+  sizes[2] = 1;
+  sizes[3] = (size_t) numberofelements;
+  fwrite(sizes, sizeof(size_t), 4, fout);
+  tags[0] = 0;
+  for (i = 0; i < numberofsurfaces + numberofvolumes; i++) {
+    if (i < numberofsurfaces) {
+      j = i;
+      ints[0] = 2;
+      ints[2] = 2;
+    } else {
+      if (numberoftetrahedra == 0) break;
+      j = i - numberofsurfaces;
+      ints[0] = 3;
+      ints[2] = type;
+    }
+    ints[1] = j + 1;
+    fwrite(ints, sizeof(int), 3, fout);
+    // Count the elements of this entity.
+    sizes[0] = 0;
+    for (k = 0; k < numberofelements; k++) {
+      if ((k < numberoftrifaces) == (ints[0] == 2) && (entities[k] == j)) {
+        sizes[0]++;
+      }
+    }
+    fwrite(sizes, sizeof(size_t), 1, fout);
+    for (k = 0; k < numberofelements; k++) {
+      if ((k < numberoftrifaces) != (ints[0] == 2) || (entities[k] != j)) {
+        continue;
+      }
+      // The element tag, then the node tags.
+      tags[0]++;
+      if (ints[0] == 2) {
+        for (l = 0; l < 3; l++) {
+          tags[1 + l] = (size_t) (trifacelist[k * 3 + l] - firstnumber + 1);
+        }
+        fwrite(tags, sizeof(size_t), 4, fout);
+      } else {
+        for (l = 0; l < corners; l++) {
+          tags[1 + l] = (size_t) (tetrahedronlist[(k - numberoftrifaces) *
+            numberofcorners + gmshorder[l]] - firstnumber + 1);
+        }
+        fwrite(tags, sizeof(size_t), 1 + corners, fout);
+      }
+    }
+  }
+  fprintf(fout, "\n$EndElements\n");
+
+  fclose(fout);
+  delete [] surfaces;
+  delete [] volumes;
+  delete [] entities;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // readline()   Read a nonempty line from a file.                            //
@@ -2130,6 +3664,419 @@ char* tetgenio::findnextnumber(char *string)
   return result;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// decimal2double()    Convert 'mantissa' * 10^'exponent' into a double.     //
+//                                                                           //
+// Return true if 'result' is the correctly rounded value.  If both the      //
+// mantissa and 10^exponent are exact doubles, one division or multipli-     //
+// cation gives it.  Otherwise it is done in long double arithmetic (if long //
+// double is the x87 extended format with a 64-bit mantissa) and accepted    //
+// if it is not too close to the midpoint of two doubles.  Return false in   //
+// all other cases, the caller must use strtod().                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+// Exact powers of ten, 10^0, ..., 10^22 as doubles and 10^0, ..., 10^27 as
+//   long doubles.  They are initialized by initpowersof10().
+static double dpow10[23];
+static long double lpow10[28];
+static int pow10ready = 0, x87extended = 0;
+
+static void initpowersof10()
+{
+  unsigned long long lowbits;
+  long double value;
+  int e;
+
+  if (pow10ready) return;
+  dpow10[0] = 1.0;
+  for (e = 1; e < 23; e++) dpow10[e] = dpow10[e - 1] * 10.0;
+  lpow10[0] = 1.0L;
+  for (e = 1; e < 28; e++) lpow10[e] = lpow10[e - 1] * 10.0L;
+  // Is long double the x87 extended format, i.e., are its first eight bytes
+  //   the 64-bit mantissa (with the explicit leading bit)?
+  if ((LDBL_MANT_DIG == 64) && (sizeof(long double) >= 10)) {
+    value = 1.0L + ldexpl(1.0L, -63);
+    memcpy(&lowbits, &value, sizeof(lowbits));
+    x87extended = (lowbits == 0x8000000000000001ULL);
+  }
+  pow10ready = 1;
+}
+
+bool tetgenio::decimal2double(unsigned long long mantissa, int exponent,
+                              double* result)
+{
+  unsigned long long lowbits;
+  long double value;
+
+  initpowersof10();
+  if (mantissa == 0) {
+    *result = 0.0;
+    return true;
+  }
+  if ((mantissa <= 9007199254740992ULL) && (exponent >= -22) &&
+      (exponent <= 22)) {
+    if (exponent >= 0) {
+      *result = (double) mantissa * dpow10[exponent];
+    } else {
+      *result = (double) mantissa / dpow10[-exponent];
+    }
+    return true;
+  }
+  if (!x87extended || (exponent < -27) || (exponent > 27)) {
+    return false;
+  }
+  // One rounding in long double arithmetic.  The 11 mantissa bits which do
+  //   not fit into a double tell how close the value is to a midpoint
+  //   between two doubles (0x400).  Rounding it again to a double is
+  //   correct unless it is within two long double ulps of a midpoint.
+  if (exponent >= 0) {
+    value = (long double) mantissa * lpow10[exponent];
+  } else {
+    value = (long double) mantissa / lpow10[-exponent];
+  }
+  memcpy(&lowbits, &value, sizeof(lowbits));
+  lowbits &= 0x7ffULL;
+  if ((lowbits >= 0x3feULL) && (lowbits <= 0x402ULL)) {
+    return false;
+  }
+  *result = (double) value;
+  return true;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// parsereal()    Convert a decimal number string into a REAL.               //
+//                                                                           //
+// It returns the same value as strtod() does, but is much faster for the    //
+// numbers found in the input files.  The mantissa (up to 19 digits) is read //
+// into an integer and converted by decimal2double().  All other cases (too  //
+// many digits, inf, nan, hexadecimal numbers) are passed on to strtod().    //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+REAL tetgenio::parsereal(char* string, char** endptr)
+{
+  unsigned long long mantissa;
+  double result;
+  char *s;
+  int negative, anydigit, digits, exponent, expsign, expvalue;
+
+  s = string;
+  negative = 0;
+  if ((*s == '+') || (*s == '-')) {
+    negative = (*s == '-');
+    s++;
+  }
+  mantissa = 0;
+  anydigit = 0;
+  digits = 0;
+  exponent = 0;
+  // Leading zeros are not counted as digits of the mantissa.
+  while (*s == '0') {
+    anydigit = 1;
+    s++;
+  }
+  while ((*s >= '0') && (*s <= '9')) {
+    mantissa = mantissa * 10 + (*s - '0');
+    digits++;
+    s++;
+  }
+  if (*s == '.') {
+    s++;
+    if (digits == 0) {
+      while (*s == '0') {
+        anydigit = 1;
+        exponent--;
+        s++;
+      }
+    }
+    while ((*s >= '0') && (*s <= '9')) {
+      mantissa = mantissa * 10 + (*s - '0');
+      digits++;
+      exponent--;
+      s++;
+    }
+  }
+  if (!anydigit && (digits == 0)) {
+    // Not a decimal number (maybe "inf" or "nan").
+    return (REAL) strtod(string, endptr);
+  }
+  if ((*s == 'e') || (*s == 'E')) {
+    s++;
+    expsign = 1;
+    if ((*s == '+') || (*s == '-')) {
+      expsign = (*s == '-') ? -1 : 1;
+      s++;
+    }
+    if ((*s < '0') || (*s > '9')) {
+      return (REAL) strtod(string, endptr);
+    }
+    expvalue = 0;
+    while ((*s >= '0') && (*s <= '9')) {
+      if (expvalue < 10000) expvalue = expvalue * 10 + (*s - '0');
+      s++;
+    }
+    exponent += expsign * expvalue;
+  }
+  if ((*s == 'x') || (*s == 'X') || (digits > 19)) {
+    // A hexadecimal number, or the mantissa may have overflowed.
+    return (REAL) strtod(string, endptr);
+  }
+  if (!decimal2double(mantissa, exponent, &result)) {
+    return (REAL) strtod(string, endptr);
+  }
+  *endptr = s;
+  return (REAL) (negative ? -result : result);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// parseint()    Convert a decimal number string into an integer.            //
+//                                                                           //
+// It returns the same value as strtol(string, endptr, 0) for indices and    //
+// markers, but without its overhead.  Octal and hexadecimal numbers (with   //
+// a leading zero) and numbers which are too long are passed on to strtol(). //
+// Like strtol(), it stops at the first character which is not a digit, so   //
+// 'endptr' points to the '.' of a number like "3.5".                        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+int tetgenio::parseint(char* string, char** endptr)
+{
+  char *s;
+  long value;
+  int negative, digits;
+
+  s = string;
+  negative = 0;
+  if ((*s == '+') || (*s == '-')) {
+    negative = (*s == '-');
+    s++;
+  }
+  if ((*s < '0') || (*s > '9') ||
+      ((*s == '0') && (((s[1] >= '0') && (s[1] <= '9')) || (s[1] == 'x') ||
+                       (s[1] == 'X')))) {
+    return (int) strtol(string, endptr, 0);
+  }
+  value = 0;
+  digits = 0;
+  while ((*s >= '0') && (*s <= '9')) {
+    value = value * 10 + (*s - '0');
+    digits++;
+    s++;
+  }
+  if (digits > 9) {
+    return (int) strtol(string, endptr, 0);
+  }
+  *endptr = s;
+  return (int) (negative ? -value : value);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// formatreal()    Write 'prefix' and a REAL as the shortest string which    //
+//                 reads back to the same value.                             //
+//                                                                           //
+// The number is the first of sprintf()'s "%.15g", "%.16g", and "%.17g"      //
+// which reads back exactly, so it is exact and mostly shorter than "%.17g"  //
+// (e.g., "0.1" instead of "0.10000000000000001").  Its digits are computed  //
+// from the value scaled by an exact power of ten in long double arithmetic, //
+// and checked by decimal2double().  Zero, inf, nan, values which are too    //
+// small or too large, and values too close to a rounding tie are written by //
+// sprintf().  Unlike "%g", a large number is written without an exponent if //
+// that is shorter (e.g., "49714988400526220" instead of                     //
+// "4.971498840052622e+16").                                                 //
+//                                                                           //
+// 'string' must have space for 'prefix' plus 32 characters.  Return a       //
+// pointer to the end of the written string.                                 //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+char* tetgenio::formatreal(char* string, const char* prefix, REAL value)
+{
+  unsigned long long whole, mantissa, divisor, dropped;
+  long double scaled, frac, tie;
+  double x, ax, check;
+  char digits[24];
+  char *s, *mark;
+  int ndigits, precision, exponent, digitexp, power, exact, useexp, i;
+
+  initpowersof10();
+  while (*prefix != '\0') *string++ = *prefix++;
+  x = (double) value;
+  ax = fabs(x);
+  exact = x87extended && (ax >= 1e-10) && (ax <= 1e40);
+
+  if (exact) {
+    // Scale 'ax' to have 17 digits before the decimal point.  The decimal
+    //   exponent of the leading digit may be off by one at first.
+    exponent = (int) floor(log10(ax));
+    while (1) {
+      power = 16 - exponent;
+      if (power >= 0) {
+        scaled = (long double) ax * lpow10[power];
+      } else {
+        scaled = (long double) ax / lpow10[-power];
+      }
+      if (scaled >= (long double) dpow10[17]) {
+        exponent++;
+      } else if (scaled < (long double) dpow10[16]) {
+        exponent--;
+      } else {
+        break;
+      }
+    }
+    // 'scaled' is less than 10^17, its error is less than 2^-8.
+    whole = (unsigned long long) scaled;
+    frac = scaled - (long double) whole;
+    for (precision = 15; precision <= 17; precision++) {
+      // Round to 'precision' digits, unless the (exact) value is too close
+      //   to a tie.
+      divisor = (unsigned long long) dpow10[17 - precision];
+      mantissa = whole / divisor;
+      dropped = whole % divisor;
+      tie = (long double) dropped + frac - 0.5L * (long double) divisor;
+      if (fabsl(tie) < 0.015625L) {
+        exact = 0;
+        break;
+      }
+      if (tie > 0.0L) {
+        mantissa++;
+      }
+      digitexp = exponent;
+      if (mantissa == (unsigned long long) dpow10[precision]) {
+        // Rounded up to the next power of ten.
+        mantissa /= 10;
+        digitexp++;
+      }
+      if (precision == 17) break;
+      // Does it read back to the same value?
+      if (!decimal2double(mantissa, digitexp - precision + 1, &check)) {
+        exact = 0;
+        break;
+      }
+      if (check == ax) break;
+    }
+    exponent = digitexp;
+  }
+
+  if (!exact) {
+    for (precision = 15; precision < 17; precision++) {
+      sprintf(string, "%.*g", precision, x);
+      if (strtod(string, (char **) NULL) == x) break;
+    }
+    if (precision == 17) {
+      sprintf(string, "%.17g", x);
+    }
+    // Write a large number with its digits padded by zeros if that is
+    //   shorter than the exponent form.
+    mark = strchr(string, 'e');
+    if ((mark != (char *) NULL) && (mark[1] == '+')) {
+      exponent = atoi(mark + 2);
+      s = x < 0.0 ? string + 1 : string;
+      if (exponent + 1 < (int) strlen(s)) {
+        ndigits = 0;
+        for (; s < mark; s++) {
+          if (*s != '.') digits[ndigits++] = *s;
+        }
+        s = x < 0.0 ? string + 1 : string;
+        for (i = 0; i <= exponent; i++) {
+          *s++ = i < ndigits ? digits[i] : '0';
+        }
+        *s = '\0';
+        return s;
+      }
+    }
+    return string + strlen(string);
+  }
+
+  // Convert the mantissa into digits, drop trailing zeros.
+  ndigits = precision;
+  for (i = precision - 1; i >= 0; i--) {
+    digits[i] = (char) ('0' + (int) (mantissa % 10));
+    mantissa /= 10;
+  }
+  while ((ndigits > 1) && (digits[ndigits - 1] == '0')) ndigits--;
+
+  // Write it in the same style as "%g", but without the exponent if the
+  //   digits padded by zeros are shorter.  (A number less than 1 is never
+  //   shorter without it.)
+  useexp = (exponent < -4) || (exponent >= precision);
+  if (useexp && (exponent > 0)) {
+    useexp = exponent + 1 >= ndigits + (ndigits > 1 ? 1 : 0) + 4;
+  }
+  s = string;
+  if (x < 0.0) *s++ = '-';
+  if (useexp) {
+    *s++ = digits[0];
+    if (ndigits > 1) {
+      *s++ = '.';
+      for (i = 1; i < ndigits; i++) *s++ = digits[i];
+    }
+    *s++ = 'e';
+    *s++ = exponent < 0 ? '-' : '+';
+    if (exponent < 0) exponent = -exponent;
+    if (exponent >= 10) {
+      *s++ = (char) ('0' + exponent / 10);
+    } else {
+      *s++ = '0';
+    }
+    *s++ = (char) ('0' + exponent % 10);
+  } else if (exponent >= 0) {
+    for (i = 0; i <= exponent; i++) {
+      *s++ = i < ndigits ? digits[i] : '0';
+    }
+    if (ndigits > exponent + 1) {
+      *s++ = '.';
+      for (i = exponent + 1; i < ndigits; i++) *s++ = digits[i];
+    }
+  } else {
+    *s++ = '0';
+    *s++ = '.';
+    for (i = -1; i > exponent; i--) *s++ = '0';
+    for (i = 0; i < ndigits; i++) *s++ = digits[i];
+  }
+  *s = '\0';
+  return s;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// formatint()    Write 'prefix' and an integer right-aligned in a field of  //
+//                 'width' characters, as sprintf()'s "%*d" does.            //
+//                                                                           //
+// Return a pointer to the end of the written string.                        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+char* tetgenio::formatint(char* string, const char* prefix, int value,
+                          int width)
+{
+  char digits[12];
+  unsigned int u;
+  int ndigits;
+
+  while (*prefix != '\0') *string++ = *prefix++;
+  u = value < 0 ? 0u - (unsigned int) value : (unsigned int) value;
+  ndigits = 0;
+  do {
+    digits[ndigits++] = (char) ('0' + u % 10);
+    u /= 10;
+  } while (u > 0);
+  if (value < 0) digits[ndigits++] = '-';
+  while (width > ndigits) {
+    *string++ = ' ';
+    width--;
+  }
+  while (ndigits > 0) {
+    *string++ = digits[--ndigits];
+  }
+  *string = '\0';
+  return string;
+}
+
 //
 // End of class 'tetgenio' implementation
 //
@@ -2168,6 +4115,9 @@ tetgenbehavior::tetgenbehavior()
   meditview = 0;
   gidview = 0;
   geomview = 0;
+  binaryout = 0;
+  vtkview = 0;
+  gmshout = 0;
   order = 1;
   nobound = 0;
   nonodewritten = 0;
@@ -2178,8 +4128,14 @@ tetgenbehavior::tetgenbehavior()
   noflip = 0;
   nomerge = 0;
   docheck = 0;
+  prioritysubs = 0;
+  offcenter = 0;
+  steiner = -1;
+  cachesphere = 0;
+  maxtime = 0.0;
   quiet = 0;
   verbose = 0;
+  numthreads = 1;
   useshelles = 0;
   epsilon = 1.0e-8;
   object = NONE;
@@ -2208,10 +4164,16 @@ void tetgenbehavior::versioninfo()
 
 void tetgenbehavior::syntax()
 {
-  printf("  tetgen [-pq__a__Ars__iMT__dzo_fengGOBNEFICQVvh] input_file\n");
+  printf("  tetgen [-pq__RuS_w_ka__Ars__iMT__dzo_fengGObKmBNEFICt_QVvh] ");
+  printf("input_file\n");
   printf("    -p  Tetrahedralizes a piecewise linear complex.\n");
   printf("    -q  Quality mesh generation. A minimum radius-edge ratio may\n");
   printf("        be specified (default 2.0).\n");
+  printf("    -R  Splits the largest encroached subfaces first.\n");
+  printf("    -u  Splits encroached subfaces at off-centers.\n");
+  printf("    -S  Stops refining after adding a number of Steiner points.\n");
+  printf("    -w  Stops refining after a number of (wall-clock) seconds.\n");
+  printf("    -k  Caches circumspheres of tetrahedra for insphere tests.\n");
   printf("    -a  Applies a maximum tetrahedron volume constraint.\n");
   printf("    -A  Assigns attributes to identify tetrahedra in certain ");
   printf("regions.\n");
@@ -2231,12 +4193,16 @@ void tetgenbehavior::syntax()
   printf("    -g  Outputs mesh to .mesh file for viewing by Medit.\n");
   printf("    -G  Outputs mesh to .msh file for viewing by Gid.\n");
   printf("    -O  Outputs mesh to .off file for viewing by Geomview.\n");
+  printf("    -b  Outputs mesh to a binary .tgb file.\n");
+  printf("    -K  Outputs mesh to .vtu file for viewing by ParaView.\n");
+  printf("    -m  Outputs mesh to a binary .msh file for Gmsh.\n");
   printf("    -B  Suppresses output of boundary information.\n");
   printf("    -N  Suppresses output of .node file.\n");
   printf("    -E  Suppresses output of .ele file.\n");
   printf("    -F  Suppresses output of .face file.\n");
   printf("    -I  Suppresses mesh iteration numbers.\n");
   printf("    -C  Checks the consistency of the final mesh.\n");
+  printf("    -t  Uses a number of threads in some stages (default 1).\n");
   printf("    -Q  Quiet:  No terminal output except errors.\n");
   printf("    -V  Verbose:  Detailed information, more terminal output.\n");
   printf("    -v  Prints the version information.\n");
@@ -2443,6 +4409,12 @@ bool tetgenbehavior::parse_commandline(int argc, char **argv)
         gidview = 1;
       } else if (argv[i][j] == 'O') {
         geomview = 1;
+      } else if (argv[i][j] == 'b') {
+        binaryout = 1;
+      } else if (argv[i][j] == 'K') {
+        vtkview = 1;
+      } else if (argv[i][j] == 'm') {
+        gmshout = 1;
       } else if (argv[i][j] == 'B') {
         nobound = 1;
       } else if (argv[i][j] == 'N') {
@@ -2458,30 +4430,80 @@ bool tetgenbehavior::parse_commandline(int argc, char **argv)
           j++;
           order = 2;
         }
-      } else if (argv[i][j] == 'Y') {
-        noflip = 1; // nobisect++;
-      } else if (argv[i][j] == 'M') {
-        nomerge = 1;
-      } else if (argv[i][j] == 'T') {
+      } else if (argv[i][j] == 'Y') {
+        noflip = 1; // nobisect++;
+      } else if (argv[i][j] == 'M') {
+        nomerge = 1;
+      } else if (argv[i][j] == 'T') {
+        if (((argv[i][j + 1] >= '0') && (argv[i][j + 1] <= '9')) ||
+            (argv[i][j + 1] == '.')) {
+          k = 0;
+          while (((argv[i][j + 1] >= '0') && (argv[i][j + 1] <= '9')) ||
+                 (argv[i][j + 1] == '.') || (argv[i][j + 1] == 'e') ||
+                 (argv[i][j + 1] == '-') || (argv[i][j + 1] == '+')) {
+            j++;
+            workstring[k] = argv[i][j];
+            k++;
+          }
+          workstring[k] = '\0';
+          epsilon = (REAL) strtod(workstring, (char **) NULL);
+        } 
+        if (epsilon <= 0.0) {
+          printf("Error:  Number after -T must be greater than zero.\n");
+          return false;
+        }
+      } else if (argv[i][j] == 'C') {
+        docheck++;
+      } else if (argv[i][j] == 'R') {
+        prioritysubs = 1;
+      } else if (argv[i][j] == 'u') {
+        offcenter = 1;
+      } else if (argv[i][j] == 'k') {
+        cachesphere = 1;
+      } else if (argv[i][j] == 'S') {
+        steiner = 0;
+        if ((argv[i][j + 1] >= '0') && (argv[i][j + 1] <= '9')) {
+          k = 0;
+          while ((argv[i][j + 1] >= '0') && (argv[i][j + 1] <= '9')) {
+            j++;
+            workstring[k] = argv[i][j];
+            k++;
+          }
+          workstring[k] = '\0';
+          steiner = strtol(workstring, (char **) NULL, 10);
+        }
+      } else if (argv[i][j] == 'w') {
         if (((argv[i][j + 1] >= '0') && (argv[i][j + 1] <= '9')) ||
             (argv[i][j + 1] == '.')) {
           k = 0;
           while (((argv[i][j + 1] >= '0') && (argv[i][j + 1] <= '9')) ||
-                 (argv[i][j + 1] == '.') || (argv[i][j + 1] == 'e') ||
-                 (argv[i][j + 1] == '-') || (argv[i][j + 1] == '+')) {
+                 (argv[i][j + 1] == '.')) {
             j++;
             workstring[k] = argv[i][j];
             k++;
           }
           workstring[k] = '\0';
-          epsilon = (REAL) strtod(workstring, (char **) NULL);
-        } 
-        if (epsilon <= 0.0) {
-          printf("Error:  Number after -T must be greater than zero.\n");
+          maxtime = (REAL) strtod(workstring, (char **) NULL);
+        }
+        if (maxtime <= 0.0) {
+          printf("Error:  Number after -w must be greater than zero.\n");
+          return false;
+        }
+      } else if (argv[i][j] == 't') {
+        if ((argv[i][j + 1] >= '0') && (argv[i][j + 1] <= '9')) {
+          k = 0;
+          while ((argv[i][j + 1] >= '0') && (argv[i][j + 1] <= '9')) {
+            j++;
+            workstring[k] = argv[i][j];
+            k++;
+          }
+          workstring[k] = '\0';
+          numthreads = (int) strtol(workstring, (char **) NULL, 10);
+        }
+        if (numthreads <= 0) {
+          printf("Error:  Number after -t must be greater than zero.\n");
           return false;
         }
-      } else if (argv[i][j] == 'C') {
-        docheck++;
       } else if (argv[i][j] == 'Q') {
         quiet = 1;
       } else if (argv[i][j] == 'V') {
@@ -2528,10 +4550,17 @@ bool tetgenbehavior::parse_commandline(int argc, char **argv)
       infilename[strlen(infilename) - 4] = '\0';
       object = PLY;
       plc = 1;
-    } else if (!strcmp(&infilename[strlen(infilename) - 4], ".msh")) {
+    } else if (!strcmp(&infilename[strlen(infilename) - 4], ".stl")) {
       infilename[strlen(infilename) - 4] = '\0';
-      object = GID;
+      object = STL;
       plc = 1;
+    } else if (!strcmp(&infilename[strlen(infilename) - 4], ".msh")) {
+      infilename[strlen(infilename) - 4] = '\0';
+      object = GMSH;
+      // With -r the tetrahedra of the file are read.
+      if (!refine) {
+        plc = 1;
+      }
     } else if (!strcmp(&infilename[strlen(infilename) - 5], ".mesh")) {
       infilename[strlen(infilename) - 5] = '\0';
       object = MEDIT;
@@ -2540,9 +4569,19 @@ bool tetgenbehavior::parse_commandline(int argc, char **argv)
       infilename[strlen(infilename) - 4] = '\0';
       object = MESH;
       refine = 1;
+    } else if (!strcmp(&infilename[strlen(infilename) - 4], ".tgb")) {
+      infilename[strlen(infilename) - 4] = '\0';
+      object = BINMESH;
+      refine = 1;
     }
   }
   plc = plc || detectinter || checkclosure;
+#ifndef PTHREADS
+  if (numthreads > 1) {
+    printf("Warning:  TetGen was compiled without threads, -t is ignored.\n");
+    numthreads = 1;
+  }
+#endif
   useshelles = plc || refine || quality;
   goodratio = minratio;
   goodratio *= goodratio;
@@ -2628,7 +4667,7 @@ bool tetgenbehavior::parse_commandline(int argc, char **argv)
 static REAL PI = 3.14159265358979323846264338327950288419716939937510582;
 
 //
-// Begin of class 'list', 'memorypool' and 'link' implementation
+// Begin of class 'list', 'memorypool', 'link' and 'queue' implementation
 //
 
 // Following are predefined compare functions for primitive data types. 
@@ -3495,8 +5534,95 @@ int tetgenmesh::link::hasitem(void* checkitem)
   return -1;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// queueinit()    Initialize a queue for storing a data type.                //
+//                                                                           //
+// 'bytes' is the size of each item, 'count' is the number of items can be   //
+// stored before the buffer needs to be enlarged.                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::queue::queueinit(int bytes, int count)
+{
+  assert(bytes > 0);
+
+  itembytes = bytes;
+  maxitems = count > 0 ? count : 256;
+  base = (char *) malloc(maxitems * itembytes);
+  if (base == (char *) NULL) {
+    printf("Error:  Out of memory.\n");
+    exit(1);
+  }
+  head = items = 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// push()    Add a new item at the end of the queue.                         //
+//                                                                           //
+// If the buffer is full, it is doubled by reallocation,  the items wrapped  //
+// around the end of the old buffer are moved behind them so that they stay  //
+// in order.  If 'newitem' is not NULL, its contents will be copied into the //
+// new space.  Returns the pointer to the new space.                         //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void* tetgenmesh::queue::push(void* newitem)
+{
+  char *newbase, *newspace;
+  int tailidx;
+
+  // Do we have enough space?
+  if (items == maxitems) {
+    newbase = (char *) realloc(base, 2 * maxitems * itembytes);
+    if (newbase == (char *) NULL) {
+      printf("Error:  Out of memory.\n");
+      exit(1);
+    }
+    base = newbase;
+    // Move the items at [0, head) to [maxitems, maxitems + head).
+    if (head > 0) {
+      memcpy(base + maxitems * itembytes, base, head * itembytes);
+    }
+    maxitems *= 2;
+  }
+  tailidx = head + items;
+  if (tailidx >= maxitems) tailidx -= maxitems;
+  newspace = base + tailidx * itembytes;
+  if (newitem != (void *) NULL) {
+    memcpy(newspace, newitem, itembytes);
+  }
+  items++;
+  return (void *) newspace;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// pop()    Remove the item at the front of the queue.                       //
+//                                                                           //
+// Returns a pointer to the removed item, or NULL if the queue is empty. The //
+// item is not overwritten until the next push().                            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void* tetgenmesh::queue::pop()
+{
+  char *popitem;
+
+  if (items == 0) {
+    return (void *) NULL;
+  }
+  popitem = base + head * itembytes;
+  head++;
+  if (head == maxitems) head = 0;
+  items--;
+  if (items == 0) head = 0;
+  return (void *) popitem;
+}
+
 //
-// End of class 'list', 'memorypool' and 'link' implementation
+// End of class 'list', 'memorypool', 'link' and 'queue' implementation
 //
 
 //
@@ -3653,18 +5779,22 @@ inline tetgenmesh::point tetgenmesh::oppo(triface& t) {
 
 inline void tetgenmesh::setorg(triface& t, point pointptr) {
   t.tet[locver2org[t.loc][t.ver] + 4] = (tetrahedron) pointptr;
+  if (sphereindex > 0) ((REAL *) (t.tet))[sphereindex + 3] = -1.0;
 }
 
 inline void tetgenmesh::setdest(triface& t, point pointptr) {
   t.tet[locver2dest[t.loc][t.ver] + 4] = (tetrahedron) pointptr;
+  if (sphereindex > 0) ((REAL *) (t.tet))[sphereindex + 3] = -1.0;
 }
 
 inline void tetgenmesh::setapex(triface& t, point pointptr) {
   t.tet[locver2apex[t.loc][t.ver] + 4] = (tetrahedron) pointptr;
+  if (sphereindex > 0) ((REAL *) (t.tet))[sphereindex + 3] = -1.0;
 }
 
 inline void tetgenmesh::setoppo(triface& t, point pointptr) {
   t.tet[loc2oppo[t.loc] + 4] = (tetrahedron) pointptr;
+  if (sphereindex > 0) ((REAL *) (t.tet))[sphereindex + 3] = -1.0;
 }
 
 // These primitives were drived from Mucke's triangle-edge data structure
@@ -3782,6 +5912,13 @@ inline void tetgenmesh::setvolumebound(tetrahedron* ptr, REAL value) {
   ((REAL *) (ptr))[volumeboundindex] = value;
 }
 
+// Get the cached circumsphere of a tetrahedron ('-k' switch). It is four
+//   REALs: the center, and the squared radius (negative if it's not valid).
+
+inline REAL* tetgenmesh::tet2sphere(tetrahedron* ptr) {
+  return &(((REAL *) (ptr))[sphereindex]);
+}
+
 //
 // End of primitives for tetrahedra
 //
@@ -4076,6 +6213,10 @@ inline tetgenmesh::point tetgenmesh::getliftpoint(int facetmark) {
   return (point) &liftpointarray[(facetmark - 1) * 3];
 }
 
+inline int tetgenmesh::getliftaxis(int facetmark) {
+  return liftaxisarray[facetmark - 1];
+}
+
 //
 // End of primitives for points
 //
@@ -4988,6 +7129,111 @@ makesubfacemap(int*& idx2facelist, shellface**& facesperverlist)
   idx2facelist[0] = 0;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// edgemapindex()    Return the hash index of an edge (e1, e2) in the map    //
+//                   created by makeedgemap().                               //
+//                                                                           //
+// The index only depends on the (ordered) pair of the indices of e1 and e2, //
+// hence, (e1, e2) and (e2, e1) have the same index.                         //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+int tetgenmesh::edgemapindex(point e1, point e2, int mapsize)
+{
+  unsigned long i, j, k;
+
+  i = (unsigned long) pointmark(e1);
+  j = (unsigned long) pointmark(e2);
+  if (i > j) {
+    k = i; i = j; j = k;
+  }
+  return (int) (((i * 73856093ul) ^ (j * 19349663ul)) % mapsize);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// makeedgemap()    Create a map from edges (pairs of vertices) to subfaces  //
+//                  containing the same edges.                               //
+//                                                                           //
+// The map is a hash table with 'mapsize' entries, which has about one entry //
+// per edge.  It is stored in two arrays 'edge2facelist' and                 //
+// 'facesperedgelist' in the same way as in makesubfacemap(): the subfaces   //
+// of the i-th entry are from position edge2facelist[i] to position          //
+// edge2facelist[i + 1] - 1 in facesperedgelist.  Each subface is saved with //
+// the edge version (sorg(), sdest()) of that edge.  Different edges may     //
+// have the same entry, one has to check the endpoints of the subfaces.      //
+// Subfaces of each edge are saved in the same order as they are in          //
+// 'subfaces'.                                                               //
+//                                                                           //
+// Compared with makesubfacemap(), a search of the subfaces at an edge does  //
+// not depend on the number of subfaces at its endpoints, which is large at  //
+// the centers of fans (e.g., the apexes of cones and cylinders).            //
+//                                                                           //
+// NOTE: These two arrays will be created inside this routine, don't forget  //
+// to free them after using.  The map becomes invalid once subfaces are      //
+// changed (e.g., flipped).                                                  //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::
+makeedgemap(int& mapsize, int*& edge2facelist, face*& facesperedgelist)
+{
+  face sface;
+  int i, j, k;
+
+  if (b->verbose > 1) {
+    printf("  Constructing mapping from edges to subfaces.\n");
+  }
+
+  // Each edge is shared by (at least) two subfaces.
+  mapsize = (int) (subfaces->items * 3l / 2l) + 1;
+  // Create and initialize 'edge2facelist'.
+  edge2facelist = new int[mapsize + 1];
+  for (i = 0; i < mapsize + 1; i++) {
+    edge2facelist[i] = 0;
+  }
+
+  // Loop the set of subfaces once, counter the number of subfaces in each
+  //   entry. Edge versions 0, 2, 4 are the three edges of a subface.
+  subfaces->traversalinit();
+  sface.sh = shellfacetraverse(subfaces);
+  while (sface.sh != (shellface *) NULL) {
+    for (sface.shver = 0; sface.shver < 6; sface.shver += 2) {
+      j = edgemapindex(sorg(sface), sdest(sface), mapsize);
+      edge2facelist[j]++;
+    }
+    sface.sh = shellfacetraverse(subfaces);
+  }
+
+  // Calculate the total length of array 'facesperedgelist'.
+  j = edge2facelist[0];
+  edge2facelist[0] = 0;  // Array starts from 0 element.
+  for (i = 0; i < mapsize; i++) {
+    k = edge2facelist[i + 1];
+    edge2facelist[i + 1] = edge2facelist[i] + j;
+    j = k;
+  }
+  // The total length is in the last unit of edge2facelist.
+  facesperedgelist = new face[edge2facelist[i]];
+  // Loop the set of subfaces again, save the subfaces per entry.
+  subfaces->traversalinit();
+  sface.sh = shellfacetraverse(subfaces);
+  while (sface.sh != (shellface *) NULL) {
+    for (sface.shver = 0; sface.shver < 6; sface.shver += 2) {
+      j = edgemapindex(sorg(sface), sdest(sface), mapsize);
+      facesperedgelist[edge2facelist[j]] = sface;
+      edge2facelist[j]++;
+    }
+    sface.sh = shellfacetraverse(subfaces);
+  }
+  // Contents in 'edge2facelist' are shifted, now shift them back.
+  for (i = mapsize - 1; i >= 0; i--) {
+    edge2facelist[i + 1] = edge2facelist[i];
+  }
+  edge2facelist[0] = 0;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // maketetrahedronmap()    Create a map from vertices (their indices) to     //
@@ -5704,6 +7950,174 @@ triangle_triangle_inter(REAL* A, REAL* B, REAL* C, REAL* O, REAL* P, REAL* Q)
   return DISJOINT;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// triangle_triangles_filter()    Find the triangles in a batch which are    //
+//                                separated by the plane of a triangle (abc).//
+//                                                                           //
+// 'cands' holds the vertices of 'n' triangles (three pointers each).  For   //
+// each one, 'sepflags' is set to 1 if the triangle can not intersect abc:   //
+// its vertices not shared with abc are all strictly on one side of abc,     //
+// and it has less than three shared vertices.  Then it shares at most a     //
+// vertex or an edge with abc.  Otherwise, 'sepflags' is set to 0.           //
+//                                                                           //
+// The orientations are computed in floating-point arithmetic with the       //
+// normal of abc computed once for the batch.  A sign is trusted only if it  //
+// is larger than an error bound (the same kind of bound as the first stage  //
+// of orient3d()).  So a triangle is flagged only if it is truly separated,  //
+// uncertain ones are left to the exact test triangle_triangle_inter().      //
+//                                                                           //
+// Return the number of triangles which are not separated.                   //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+int tetgenmesh::triangle_triangles_filter(REAL* A, REAL* B, REAL* C,
+                                          REAL** cands, int n, int* sepflags)
+{
+  REAL *X;
+  REAL u[3], v[3], w[3], N[3], Nperm[3];
+  REAL det, permanent, errbound;
+  int shared, pos, neg, uncertain;
+  int remain, i, j;
+
+  for (j = 0; j < 3; j++) {
+    u[j] = B[j] - A[j];
+    v[j] = C[j] - A[j];
+  }
+  N[0] = u[1] * v[2] - u[2] * v[1];
+  N[1] = u[2] * v[0] - u[0] * v[2];
+  N[2] = u[0] * v[1] - u[1] * v[0];
+  Nperm[0] = fabs(u[1] * v[2]) + fabs(u[2] * v[1]);
+  Nperm[1] = fabs(u[2] * v[0]) + fabs(u[0] * v[2]);
+  Nperm[2] = fabs(u[0] * v[1]) + fabs(u[1] * v[0]);
+  errbound = 16.0 * macheps;
+
+  remain = 0;
+  for (i = 0; i < n; i++) {
+    shared = pos = neg = uncertain = 0;
+    for (j = 0; j < 3; j++) {
+      X = cands[3 * i + j];
+      if ((X == A) || (X == B) || (X == C)) {
+        shared++;
+        continue;
+      }
+      w[0] = X[0] - A[0];
+      w[1] = X[1] - A[1];
+      w[2] = X[2] - A[2];
+      det = w[0] * N[0] + w[1] * N[1] + w[2] * N[2];
+      permanent = fabs(w[0]) * Nperm[0] + fabs(w[1]) * Nperm[1]
+                + fabs(w[2]) * Nperm[2];
+      if (det > errbound * permanent) {
+        pos++;
+      } else if (-det > errbound * permanent) {
+        neg++;
+      } else {
+        uncertain++;
+      }
+    }
+    sepflags[i] = (shared < 3) && (uncertain == 0) &&
+                  ((pos == 0) || (neg == 0));
+    if (!sepflags[i]) remain++;
+  }
+  return remain;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// triangle_triangle_segment()    Get the segment where two intersecting     //
+//                                triangles (abc) and (opq) meet.            //
+//                                                                           //
+// Each triangle is cut by the plane of the other one into a segment (which  //
+// may be degenerate to a point).  Both segments lie on the line where the   //
+// two planes meet, the wanted segment is their overlap.  The sides of the   //
+// vertices are found by orient3d(), the cutting points are computed in      //
+// floating-point arithmetic.  The endpoints are returned in 'S1' and 'S2'.  //
+//                                                                           //
+// Return false (and 'S1', 'S2' are not set) if the two triangles are        //
+// coplanar or one of them does not cross the plane of the other one.        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+bool tetgenmesh::triangle_triangle_segment(REAL* A, REAL* B, REAL* C,
+                                           REAL* O, REAL* P, REAL* Q,
+                                           REAL* S1, REAL* S2)
+{
+  REAL *tri[2][3], cut[2][2][3];
+  REAL sign[2][3], n1[3], n2[3], d[3], v1[3], v2[3];
+  REAL t[2][2], tswap, w;
+  int cutnum, i, j, k, l;
+
+  tri[0][0] = A; tri[0][1] = B; tri[0][2] = C;
+  tri[1][0] = O; tri[1][1] = P; tri[1][2] = Q;
+  for (i = 0; i < 3; i++) {
+    sign[0][i] = orient3d(O, P, Q, tri[0][i]);
+    sign[1][i] = orient3d(A, B, C, tri[1][i]);
+  }
+
+  // The direction of the line where the two planes meet.
+  for (k = 0; k < 3; k++) {
+    v1[k] = B[k] - A[k];
+    v2[k] = C[k] - A[k];
+  }
+  cross(v1, v2, n1);
+  for (k = 0; k < 3; k++) {
+    v1[k] = P[k] - O[k];
+    v2[k] = Q[k] - O[k];
+  }
+  cross(v1, v2, n2);
+  cross(n1, n2, d);
+
+  for (l = 0; l < 2; l++) {
+    cutnum = 0;
+    for (i = 0; (i < 3) && (cutnum < 2); i++) {
+      j = (i + 1) % 3;
+      if (sign[l][i] == 0.0) {
+        // The vertex is on the plane.
+        for (k = 0; k < 3; k++) cut[l][cutnum][k] = tri[l][i][k];
+        cutnum++;
+      } else if (sign[l][i] * sign[l][j] < 0.0) {
+        // The edge crosses the plane.
+        w = sign[l][i] / (sign[l][i] - sign[l][j]);
+        for (k = 0; k < 3; k++) {
+          cut[l][cutnum][k] = tri[l][i][k] + w * (tri[l][j][k] -
+                                                  tri[l][i][k]);
+        }
+        cutnum++;
+      }
+    }
+    if ((cutnum == 0) ||
+        ((sign[l][0] == 0.0) && (sign[l][1] == 0.0) && (sign[l][2] == 0.0))) {
+      // Disjoint or coplanar.
+      return false;
+    }
+    if (cutnum == 1) {
+      for (k = 0; k < 3; k++) cut[l][1][k] = cut[l][0][k];
+    }
+    // Sort the two points along the line.
+    t[l][0] = dot(d, cut[l][0]);
+    t[l][1] = dot(d, cut[l][1]);
+    if (t[l][0] > t[l][1]) {
+      for (k = 0; k < 3; k++) {
+        tswap = cut[l][0][k];
+        cut[l][0][k] = cut[l][1][k];
+        cut[l][1][k] = tswap;
+      }
+      tswap = t[l][0];
+      t[l][0] = t[l][1];
+      t[l][1] = tswap;
+    }
+  }
+
+  // The overlap of the two segments.
+  i = (t[0][0] > t[1][0]) ? 0 : 1;
+  j = (t[0][1] < t[1][1]) ? 0 : 1;
+  for (k = 0; k < 3; k++) {
+    S1[k] = cut[i][0][k];
+    S2[k] = cut[j][1][k];
+  }
+  return true;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // iscollinear()    Check if three points are collinear with respect to a    //
@@ -6357,6 +8771,90 @@ circumsphere(REAL* pa, REAL* pb, REAL* pc, REAL* pd, REAL* cent, REAL* radius)
   return true;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// tetinsphere()    Test if a point lies inside the circumsphere of a tet.   //
+//                                                                           //
+// 'testtet' is positively oriented (its edge ring is CW), the result has    //
+// the same sign as insphere(org, dest, apex, oppo, testpt).                 //
+//                                                                           //
+// If '-k' switch is used, the circumsphere of 'testtet' is computed once and//
+// saved in it (until its vertices are changed).  The distance of 'testpt'   //
+// to the center is compared with the radius, only if the difference is too  //
+// small to be sure, the exact insphere() is called.  The error of the       //
+// center grows when the tet is flat (its volume is small compared with the  //
+// lengths of its edges), such tets are always tested by insphere().         //
+//                                                                           //
+// The center is saved relative to the first vertex of the tet (not of the   //
+// triface), and the distance is computed in the same frame.  Its error then //
+// only depends on the size of the tet, not on how far it is from the origin.//
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+REAL tetgenmesh::tetinsphere(triface* testtet, point testpt)
+{
+  point pa, pb, pc, pd, p0;
+  REAL *sphere, A[3][3], N[3][3];
+  REAL la, lb, lc, vol, radius;
+  REAL dist, err, d;
+  int i;
+
+  pa = org(*testtet);
+  pb = dest(*testtet);
+  pc = apex(*testtet);
+  pd = oppo(*testtet);
+  if (sphereindex == 0) {
+    return insphere(pa, pb, pc, pd, testpt);
+  }
+
+  sphere = tet2sphere(testtet->tet);
+  // The vertices in the order they're stored in the tet.  The saved center
+  //   is relative to 'p0'.  It doesn't depend on the version of 'testtet'.
+  p0 = (point) testtet->tet[4];
+  if (sphere[3] == -1.0) {
+    // Not computed yet.
+    for (i = 0; i < 3; i++) {
+      A[0][i] = ((point) testtet->tet[5])[i] - p0[i];
+      A[1][i] = ((point) testtet->tet[6])[i] - p0[i];
+      A[2][i] = ((point) testtet->tet[7])[i] - p0[i];
+    }
+    la = dot(A[0], A[0]);
+    lb = dot(A[1], A[1]);
+    lc = dot(A[2], A[2]);
+    cross(A[1], A[2], N[0]);
+    cross(A[2], A[0], N[1]);
+    cross(A[0], A[1], N[2]);
+    // 'vol' is six times the signed volume.
+    vol = dot(A[0], N[0]);
+    if (fabs(vol) > 1.0e-3 * sqrt(la * lb * lc)) {
+      // The center is p0 + (la * N0 + lb * N1 + lc * N2) / (2 * vol).
+      radius = 0.0;
+      for (i = 0; i < 3; i++) {
+        sphere[i] = (la * N[0][i] + lb * N[1][i] + lc * N[2][i]) / (2.0 * vol);
+        radius += sphere[i] * sphere[i];
+      }
+      sphere[3] = radius;
+    } else {
+      // It is flat. Don't use the cache.
+      sphere[3] = -2.0;
+    }
+  }
+
+  if (sphere[3] >= 0.0) {
+    radius = sqrt(sphere[3]);
+    dist = 0.0;
+    for (i = 0; i < 3; i++) {
+      d = (testpt[i] - p0[i]) - sphere[i];
+      dist += d * d;
+    }
+    // A bound of the rounding errors of the center and the distance.
+    err = 1.0e5 * macheps * (radius + sqrt(dist)) * (radius + sqrt(dist));
+    if (dist < sphere[3] - err) return 1.0;
+    if (dist > sphere[3] + err) return -1.0;
+  }
+  return insphere(pa, pb, pc, pd, testpt);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // inscribedsphere()    Compute the radius and center of the biggest         //
@@ -6815,8 +9313,9 @@ void tetgenmesh::initializepointpool()
 //                           subface data structures and initialize their    //
 //                           memory pools.                                   //
 //                                                                           //
-// This routine also computes the 'highorderindex', 'elemattribindex', and   //
-// 'volumeboundindex' indices used to find values within each tetrahedron.   //
+// This routine also computes the 'highorderindex', 'elemattribindex',       //
+// 'volumeboundindex' and 'sphereindex' indices used to find values within   //
+// each tetrahedron.                                                         //
 //                                                                           //
 // There are two types of boundary elements, whihc are subfaces and subsegs, //
 // they are stored in seperate pools. However, the data structures of them   //
@@ -6862,6 +9361,12 @@ void tetgenmesh::initializetetshpools()
   if (b->neighbors && (elesize < 8 * sizeof(tetrahedron))) {
     elesize = 8 * sizeof(tetrahedron);
   }
+  // If the circumspheres are cached (-k switch is used), four REALs are
+  //   allocated for the center and the squared radius.
+  if (b->cachesphere) {
+    sphereindex = (elesize + sizeof(REAL) - 1) / sizeof(REAL);
+    elesize = (sphereindex + 4) * sizeof(REAL);
+  }
   // Having determined the memory size of an element, initialize the pool.
   tetrahedrons = new memorypool(elesize, ELEPERBLOCK, POINTER, 8);
 
@@ -6928,6 +9433,14 @@ tetgenmesh::tetrahedron* tetgenmesh::tetrahedrontraverse()
 
 void tetgenmesh::shellfacedealloc(memorypool *pool, shellface *dyingsh)
 {
+  shellfaceevent event;
+
+  if (shellfacelog != (list *) NULL) {
+    event.pool = pool;
+    event.sh = dyingsh;
+    event.dealloc = 1;
+    shellfacelog->append(&event);
+  }
   // Set shellface's vertices to NULL. This makes it possible to detect dead
   //   shellfaces when traversing the list of all shellfaces.
   dyingsh[3] = (shellface) NULL;
@@ -7054,6 +9567,9 @@ void tetgenmesh::maketetrahedron(triface *newtet)
   if (b->varvolume) {
     setvolumebound(newtet->tet, -1.0);
   }
+  if (sphereindex > 0) {
+    tet2sphere(newtet->tet)[3] = -1.0;
+  }
   // Initialize the location and version to be Zero.
   newtet->loc = 0;
   newtet->ver = 0;
@@ -7068,7 +9584,15 @@ void tetgenmesh::maketetrahedron(triface *newtet)
 
 void tetgenmesh::makeshellface(memorypool *pool, face *newface)
 {
+  shellfaceevent event;
+
   newface->sh = (shellface *) pool->alloc();
+  if (shellfacelog != (list *) NULL) {
+    event.pool = pool;
+    event.sh = newface->sh;
+    event.dealloc = 0;
+    shellfacelog->append(&event);
+  }
   //Initialize the three adjoining subfaces to be the omnipresent subface.
   newface->sh[0] = (shellface) dummysh;
   newface->sh[1] = (shellface) dummysh;
@@ -8028,9 +10552,9 @@ enum tetgenmesh::fliptype tetgenmesh::categorizeface(triface& horiz)
 
 void tetgenmesh::enqueueflipface(triface& checkface, queue* flipqueue)
 {
-  badface *queface;
+  flipitem *queface;
 
-  queface = (badface *) flipqueue->push((void *) NULL);
+  queface = (flipitem *) flipqueue->push((void *) NULL);
   queface->tt = checkface;
   queface->forg = org(checkface);
   queface->fdest = dest(checkface);
@@ -8039,9 +10563,9 @@ void tetgenmesh::enqueueflipface(triface& checkface, queue* flipqueue)
 
 void tetgenmesh::enqueueflipedge(face& checkedge, queue* flipqueue)
 {
-  badface *queface;
+  flipitem *queface;
 
-  queface = (badface *) flipqueue->push((void *) NULL);
+  queface = (flipitem *) flipqueue->push((void *) NULL);
   queface->ss = checkedge;
   queface->forg = sorg(checkedge);
   queface->fdest = sdest(checkedge);
@@ -9013,33 +11537,43 @@ void tetgenmesh::unflipsos(triface* flipface, queue* flipqueue)
 // routine later for removing a newly inserted point because it encroaches   //
 // any subfaces or subsegments.                                              //
 //                                                                           //
-// If the quality mesh step is starting,  (indicated by pools 'encsubsegs',  //
-// 'encsubfaces' and 'badtetrahedrons' are not NULLs.)  we will check the    //
-// encroached subface or subsegments of a hull face, and queuing tetrahedra  //
-// for quality checking.                                                     //
-//                                                                           //
 // The return value is the total number of flips done during this invocation.//
 //                                                                           //
+// The coplanar cases (T22 and T44) are decided with a tolerance.  If four   //
+// points are only nearly coplanar, a 4-to-4 flip which makes the face abc   //
+// locally Delaunay may make the face on the other side of the plane (the    //
+// mirror face) non-locally Delaunay, and a sequence of such flips can go    //
+// around a set of nearly cospherical points forever.  When the points are   //
+// exactly coplanar, both sides agree (the test is the same incircle test in //
+// the plane).  So a T44 (or T22) is only done if the mirror face is not     //
+// locally Delaunay as well.  Otherwise, the face is classified again without//
+// tolerance (usually it is then a T23 or T32), it is left unflipped if it   //
+// is still coplanar (its four points are on one facet).                     //
+//                                                                           //
+// As a safeguard, at most 'maxflip22s' coplanar flips are done in one       //
+// invocation, the further ones are left unflipped.  This is reported, and   //
+// counted in 'flip22stops', which is an error of the mesh check (-C).       //
+//                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
 long tetgenmesh::flip(queue* flipqueue, flipstacker **plastflip)
 {
-  badface *qface;
+  flipitem *qface;
   flipstacker *newflip;
-  triface flipface, symface;
-  face checkseg, checksh;
+  triface flipface, symface, mirrorface;
   enum fliptype fc;
   bool flipped;
   REAL sign, bakepsilon;
-  long flipcount;
+  long flipcount, flip22count, maxflip22s;
   int epscount;
-  int i;
 
   if (b->verbose > 1) {
     printf("    Do flipface queue: %ld faces.\n", flipqueue->len());
   }
 
   flipcount = flip23s + flip32s + flip22s + flip44s;
+  flip22count = 0l;
+  maxflip22s = 1000l + 16l * flipqueue->len();
   
   if (plastflip != (flipstacker **) NULL) {
     // Initialize the stack of the flip sequence.
@@ -9048,7 +11582,7 @@ long tetgenmesh::flip(queue* flipqueue, flipstacker **plastflip)
   }
 
   // Loop until the queue is empty.
-  while ((qface = (badface *) flipqueue->pop()) != NULL) {
+  while ((qface = (flipitem *) flipqueue->pop()) != NULL) {
     // Get a face.
     flipface = qface->tt;
     // Check the validity of this face.
@@ -9063,8 +11597,7 @@ long tetgenmesh::flip(queue* flipqueue, flipstacker **plastflip)
     if (symface.tet != dummytet && oppo(symface) != (point) NULL) {
       // For positive orientation that insphere() test requires.
       adjustedgering(flipface, CW); 
-      sign = insphere(org(flipface), dest(flipface), apex(flipface),
-                      oppo(flipface), oppo(symface));
+      sign = tetinsphere(&flipface, oppo(symface));
     } else {
       sign = -1.0; // A hull face is locally Delaunay.
     }
@@ -9094,12 +11627,39 @@ long tetgenmesh::flip(queue* flipqueue, flipstacker **plastflip)
         fc = categorizeface(flipface);
         assert(fc != NONCONVEX);
       }
+      if ((fc == T22) || (fc == T44)) {
+        // Does the mirror face (abf of abdf and baef, the face opposite to
+        //   abc at edge ab) agree with the flip?  It is two faces away from
+        //   abc in the face ring of ab.  There is none at a T22.
+        mirrorface = flipface;
+        if (fnextself(mirrorface) && fnextself(mirrorface)) {
+          sym(mirrorface, symface);
+          if ((symface.tet != dummytet) && (oppo(symface) != (point) NULL)) {
+            adjustedgering(mirrorface, CW);
+            if (tetinsphere(&mirrorface, oppo(symface)) < 0.0) {
+              // The points are not exactly coplanar. Use the exact type.
+              bakepsilon = b->epsilon;
+              b->epsilon = 0.0;
+              fc = categorizeface(flipface);
+              b->epsilon = bakepsilon;
+              if ((fc == T22) || (fc == T44) || (fc == NONCONVEX)) {
+                fc = UNFLIPABLE;
+              }
+            }
+          }
+        }
+      }
+      if (((fc == T22) || (fc == T44)) && (flip22count >= maxflip22s)) {
+        // Too many coplanar flips, they may be cycling.
+        fc = UNFLIPABLE;
+      }
       switch (fc) {
       // The following face types are flipable.
       case T44:
       case T22:
         flip22(&flipface, flipqueue); 
         flipped = true;
+        flip22count++;
         break;
       case T23:
         flip23(&flipface, flipqueue); 
@@ -9138,33 +11698,20 @@ long tetgenmesh::flip(queue* flipqueue, flipstacker **plastflip)
         *plastflip = newflip;  
       }
     }
-    if (!flipped) {
-      // 'flipface' is locally Delaunay, or it is non-locally Delaunay but
-      //   not flipable because it is a subface or contains a subsegment.
-      if (encsubsegs != (memorypool *) NULL) {
-        // Check for encroaching subsegments, add them into list.
-        for (i = 0; i < 3; i++) {
-          tsspivot(&flipface, &checkseg);
-          if ((checkseg.sh != dummysh) && !sub2badface(checkseg)) {
-            checkseg4encroach(&checkseg, NULL, true);
-          }
-          enextself(flipface);
-        }
-      }
-      if (encsubfaces != (memorypool *) NULL) {
-        // Check for encroaching subface, add it into list.
-        tspivot(flipface, checksh);
-        if (checksh.sh != dummysh) {
-          doencchecktest(&checksh);
-        }
-      }
-    }
   }
 
   flipcount = flip23s + flip32s + flip22s + flip44s - flipcount;
   if (b->verbose > 1) {
     printf("    %ld flips.\n", flipcount);
   }
+  if (flip22count >= maxflip22s) {
+    if (!b->quiet) {
+      printf("Warning:  Stopped flipping coplanar faces after %ld flips.\n",
+             flip22count);
+      printf("  Some faces may be not locally Delaunay.\n");
+    }
+    flip22stops++;
+  }
 
   return flipcount;
 }
@@ -11247,8 +13794,7 @@ void tetgenmesh::collectcavtets(point newpoint, list* cavtetlist)
   if (neightet.tet != dummytet) {
     // For positive orientation that insphere() test requires.
     adjustedgering(neightet, CW);
-    sign = insphere(org(neightet), dest(neightet), apex(neightet),
-                    oppo(neightet), newpoint);
+    sign = tetinsphere(&neightet, newpoint);
     if (sign >= 0.0) {
       // Add neightet into list.
       infect(neightet);
@@ -11267,8 +13813,7 @@ void tetgenmesh::collectcavtets(point newpoint, list* cavtetlist)
       if ((neightet.tet != dummytet) && !infected(neightet)) {
         // For positive orientation that insphere() test requires.
         adjustedgering(neightet, CW);
-        sign = insphere(org(neightet), dest(neightet), apex(neightet),
-                        oppo(neightet), newpoint);
+        sign = tetinsphere(&neightet, newpoint);
         if (sign >= 0.0) {
           // Add neightet into list.
           infect(neightet);
@@ -11827,7 +14372,7 @@ long tetgenmesh::incrflipdelaunay()
   }
 
   // Initialize 'flipqueue'.
-  flipqueue = new queue(sizeof(badface));
+  flipqueue = new queue(sizeof(flipitem));
   // Create a queue for all inserting points.
   insertqueue = new queue(sizeof(point*), in->numberofpoints);
   // Create a 'hulllink' used in inserthullsite().
@@ -11911,6 +14456,72 @@ long tetgenmesh::incrflipdelaunay()
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// orientsub()    Orientation test of points in a facet.                     //
+//                                                                           //
+// Returns a value having the same sign as orient3d(pa, pb, pc, liftpoint).  //
+// 'axis' is the value of getliftaxis() of the facet containing pa, pb and   //
+// pc.  If it is 0, orient3d() is called.  Otherwise, the facet lies in a    //
+// coordinate plane, the test is done by orient2d() on the other two         //
+// coordinates.  Let k = |axis| - 1 be the dropped coordinate, the two       //
+// coordinates are (k + 1) % 3 and (k + 2) % 3. Since the points are exactly //
+// in the plane, orient3d(pa, pb, pc, liftpoint) equals to orient2d() times  //
+// (pa[k] - liftpoint[k]), the sign of 'axis' is the sign of the latter.     //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+REAL tetgenmesh::
+orientsub(point pa, point pb, point pc, point liftpoint, int axis)
+{
+  REAL pa2[2], pb2[2], pc2[2];
+  REAL ori;
+  int i, j;
+
+  if (axis == 0) {
+    return orient3d(pa, pb, pc, liftpoint);
+  }
+  i = (axis > 0 ? axis : -axis) % 3;
+  j = (i + 1) % 3;
+  pa2[0] = pa[i]; pa2[1] = pa[j];
+  pb2[0] = pb[i]; pb2[1] = pb[j];
+  pc2[0] = pc[i]; pc2[1] = pc[j];
+  ori = orient2d(pa2, pb2, pc2);
+  return axis > 0 ? ori : -ori;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// incirclesub()    Incircle test of points in a facet.                      //
+//                                                                           //
+// Returns a positive value if pd lies inside the circumcircle of pa, pb and //
+// pc, a negative value if it lies outside, and zero if the four points are  //
+// cocircular.  'liftpoint' and 'axis' are the same as in orientsub().  If   //
+// 'axis' is 0, the test is insphere(pa, pb, pc, liftpoint, pd) times        //
+// orient3d(pa, pb, pc, liftpoint), otherwise it is incircle() times         //
+// orient2d() on the two coordinates of the coordinate plane.                //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+REAL tetgenmesh::
+incirclesub(point pa, point pb, point pc, point pd, point liftpoint, int axis)
+{
+  REAL pa2[2], pb2[2], pc2[2], pd2[2];
+  int i, j;
+
+  if (axis == 0) {
+    return insphere(pa, pb, pc, liftpoint, pd) 
+         * orient3d(pa, pb, pc, liftpoint);
+  }
+  i = (axis > 0 ? axis : -axis) % 3;
+  j = (i + 1) % 3;
+  pa2[0] = pa[i]; pa2[1] = pa[j];
+  pb2[0] = pb[i]; pb2[1] = pb[j];
+  pc2[0] = pc[i]; pc2[1] = pc[j];
+  pd2[0] = pd[i]; pd2[1] = pd[j];
+  return incircle(pa2, pb2, pc2, pd2) * orient2d(pa2, pb2, pc2);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // locatesub()    Find a point in the surface mesh.                          //
@@ -11938,7 +14549,7 @@ locatesub(point searchpt, face* searchsh, point abovept)
   face backtracksh, checkedge;
   point forg, fdest, fapex, liftpoint;
   REAL orgori, destori;
-  int moveleft, i;
+  int moveleft, axis, i;
 
   if (searchsh->sh == dummysh) {
     searchsh->shver = 0;
@@ -11947,11 +14558,15 @@ locatesub(point searchpt, face* searchsh, point abovept)
   }
 
   // Set the liftpoint. (Note, the liftpoint is always above the face.)
+  //   The orientation tests below, e.g., orient3d(forg, fdest, liftpoint,
+  //   searchpt), are done by -orientsub(forg, fdest, searchpt, ...).
   if (abovept == (point) NULL) {
     liftpoint = getliftpoint(mark(*searchsh));
+    axis = getliftaxis(mark(*searchsh));
     adjustedgering(*searchsh, CCW);
   } else {
     liftpoint = abovept;
+    axis = 0;
     forg = sorg(*searchsh);
     fdest = sdest(*searchsh);
     fapex = sapex(*searchsh);
@@ -11968,7 +14583,7 @@ locatesub(point searchpt, face* searchsh, point abovept)
   for (i = 0; i < 3; i++) {
     forg = sorg(*searchsh);
     fdest = sdest(*searchsh);
-    if (orient3d(forg, fdest, liftpoint, searchpt) > 0.0) break;
+    if (orientsub(forg, fdest, searchpt, liftpoint, axis) < 0.0) break;
     senextself(*searchsh);
   }
   assert(i < 3);
@@ -11983,10 +14598,10 @@ locatesub(point searchpt, face* searchsh, point abovept)
     }
     // Does the point lie on the other side of the line defined by the
     //   triangle edge opposite the triangle's destination?
-    destori = orient3d(forg, fapex, liftpoint, searchpt);
+    destori = -orientsub(forg, fapex, searchpt, liftpoint, axis);
     // Does the point lie on the other side of the line defined by the
     //   triangle edge opposite the triangle's origin? 
-    orgori = orient3d(fapex, fdest, liftpoint, searchpt);
+    orgori = -orientsub(fapex, fdest, searchpt, liftpoint, axis);
     if (destori > 0.0) {
       moveleft = 1;
     } else {
@@ -12043,7 +14658,7 @@ locatesub(point searchpt, face* searchsh, point abovept)
 
 long tetgenmesh::flipsub(queue* flipqueue)
 {
-  badface *qedge;
+  flipitem *qedge;
   face flipedge, symedge, bdedge;
   point pa, pb, pc, pd, liftpoint;
   REAL sign;
@@ -12055,7 +14670,7 @@ long tetgenmesh::flipsub(queue* flipqueue)
 
   edgeflips = 0;
 
-  while ((qedge = (badface *) flipqueue->pop()) != NULL) {
+  while ((qedge = (flipitem *) flipqueue->pop()) != NULL) {
     flipedge = qedge->ss;
     if (flipedge.sh == dummysh) continue;
     if ((sorg(flipedge) != qedge->forg) || 
@@ -12070,8 +14685,7 @@ long tetgenmesh::flipsub(queue* flipqueue)
     pd = sapex(symedge);
     liftpoint = getliftpoint(mark(flipedge)); 
     // Check whether pd lies inside the circumcircle of pa, pb, pc or not.
-    sign = insphere(pa, pb, pc, liftpoint, pd) 
-         * orient3d(pa, pb, pc, liftpoint);
+    sign = incirclesub(pa, pb, pc, pd, liftpoint, getliftaxis(mark(flipedge)));
     if (sign > 0.0) {
       // Flip the non-Delaunay edge.
       flip22sub(&flipedge, flipqueue);
@@ -12099,6 +14713,11 @@ long tetgenmesh::flipsub(queue* flipqueue)
 // facet are collinear,  such point is found by lifting the centroid of the  //
 // set of vertices for a certain distance along the normal of this facet.    //
 //                                                                           //
+// If all vertices of the facet have the same x-, y-, or z-coordinate, i.e., //
+// the facet lies in a coordinate plane, its 'lift axis' is set to be a      //
+// nonzero value (see orientsub()), so that the 2D tests (orient2d() and     //
+// incircle()) rather than the 3D tests are used for this facet.             //
+//                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
 bool tetgenmesh::
@@ -12111,8 +14730,8 @@ incrflipinitsub(int facetidx, list* ptlist, point* idx2verlist)
   REAL v1[3], v2[3];
   REAL smallcos, cosa;
   REAL liftdist, len, vol;
-  int smallidx;
-  int idx, i;
+  int smallidx, axis;
+  int idx, i, k;
   
   if (ptlist->len() > 3) {
     // Find a (non-degenerate) vector from the vertex set.
@@ -12244,6 +14863,19 @@ incrflipinitsub(int facetidx, list* ptlist, point* idx2verlist)
   for (i = 0; i < 3; i++) {
     liftpoint[i] = cent[i] + liftdist * norm[i];
   }
+  // Check whether the facet lies in a coordinate plane.
+  axis = 0;
+  for (k = 0; (k < 3) && (axis == 0); k++) {
+    for (i = 0; i < ptlist->len(); i++) {
+      idx =  * (int *) (* ptlist)[i];
+      ptloop = idx2verlist[idx - in->firstnumber];
+      if (ptloop[k] != pt1[k]) break;
+    }
+    if ((i == ptlist->len()) && (liftpoint[k] != pt1[k])) {
+      axis = (pt1[k] > liftpoint[k]) ? (k + 1) : -(k + 1);
+    }
+  }
+  liftaxisarray[facetidx - 1] = axis;
 
   // Create the initial triangle. The liftpoint is above (pt1, pt2, pt3).
   makeshellface(subfaces, &newsh);
@@ -12277,8 +14909,10 @@ collectvisiblesubs(int facetidx, point inspoint, face* horiz, queue* flipqueue)
   face rightsh, leftsh, spinedge;
   point horg, hdest, liftpoint;
   bool aboveflag;
+  int axis;
 
   liftpoint = getliftpoint(facetidx); 
+  axis = getliftaxis(facetidx);
 
   // Create a new subface above 'horiz'.
   adjustedgering(*horiz, CCW);
@@ -12308,7 +14942,7 @@ collectvisiblesubs(int facetidx, point inspoint, face* horiz, queue* flipqueue)
     // Test whether 'inspoint' is visible from 'hullsh'.
     horg = sorg(hullsh);
     hdest = sdest(hullsh);
-    aboveflag = orient3d(horg, hdest, liftpoint, inspoint) < 0.0;
+    aboveflag = orientsub(horg, hdest, inspoint, liftpoint, axis) > 0.0;
     if (aboveflag) {
       // It's a visible hull edge.
       makeshellface(subfaces, &newsh);
@@ -12346,7 +14980,7 @@ collectvisiblesubs(int facetidx, point inspoint, face* horiz, queue* flipqueue)
     // Test whether 'inspoint' is visible from 'hullsh'.
     horg = sorg(hullsh);
     hdest = sdest(hullsh);
-    aboveflag = orient3d(horg, hdest, liftpoint, inspoint) < 0.0;
+    aboveflag = orientsub(horg, hdest, inspoint, liftpoint, axis) > 0.0;
     if (aboveflag) {
       // It's a visible hull edge.
       makeshellface(subfaces, &newsh);
@@ -13046,7 +15680,8 @@ void tetgenmesh::carveholessub(int holes, REAL* holelist)
 // segments, they should be empty on input and output.                       //
 //                                                                           //
 // On completion, the CDT of this facet is constructed in pool 'subfaces'.   //
-// Every isolated point on the facet will be set a type of FACETVERTEX.      //
+// Every isolated point on the facet will be set a type of FACETVERTEX (or   //
+// be saved in 'facetvertexlist' if it is not NULL).                         //
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -13125,8 +15760,13 @@ triangulatefacet(int facetidx, list* ptlist, list* conlist, point* idx2verlist,
               printf(" in facet %d.\n", facetidx);
             }
           } 
-          // Set the vertex type be 'FACETVERTEX'.
-          setpointtype(idx2verlist[end1 - in->firstnumber], FACETVERTEX);
+          // Set the vertex type be 'FACETVERTEX'.  A worker thread only
+          //   saves it, the type is set after all threads are done.
+          if (facetvertexlist != (list *) NULL) {
+            facetvertexlist->append(&idx2verlist[end1 - in->firstnumber]);
+          } else {
+            setpointtype(idx2verlist[end1 - in->firstnumber], FACETVERTEX);
+          }
         } 
       }
       if (p->numberofvertices == 2) {
@@ -13184,25 +15824,25 @@ triangulatefacet(int facetidx, list* ptlist, list* conlist, point* idx2verlist,
 // ones; and (2) create the face rings of the unified segments, hence, setup //
 // the facet connections.                                                    //
 //                                                                           //
+// The subfaces at a segment are found by the edge map ('mapsize',           //
+// 'edge2facelist', 'facesperedgelist') created by makeedgemap().            //
+//                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
-void tetgenmesh::unifysegments()
+void tetgenmesh::
+unifysegments(int mapsize, int* edge2facelist, face* facesperedgelist)
 {
   list *sfacelist;
-  shellface **facesperverlist;
   face subsegloop, testseg;
   face sface, sface1, sface2;
   point torg, tdest;
   REAL da1, da2;
-  int *idx2facelist;
   int idx, k, m;
 
   if (b->verbose) {
     printf("  Unifying segments.\n");
   }
 
-  // Compute a mapping from indices of vertices to subfaces.
-  makesubfacemap(idx2facelist, facesperverlist);
   // Initialize 'sfacelist' for constructing the face link of each segment.
   sfacelist = new list(sizeof(face), NULL); 
   
@@ -13212,16 +15852,20 @@ void tetgenmesh::unifysegments()
     subsegloop.shver = 0; // For sure.
     torg = sorg(subsegloop);
     tdest = sdest(subsegloop);
-    idx = pointmark(torg) - in->firstnumber;
-    // Loop through the set of subfaces containing 'torg'.  Get all the
-    //   subfaces containing the edge (torg, tdest). Save and order them
-    //   in 'sfacelist', the ordering is defined by the right-hand rule
+    idx = edgemapindex(torg, tdest, mapsize);
+    // Loop through the set of subfaces in the entry of (torg, tdest). Get
+    //   all the subfaces containing the edge (torg, tdest). Save and order
+    //   them in 'sfacelist', the ordering is defined by the right-hand rule
     //   with thumb points from torg to tdest.
-    for (k = idx2facelist[idx]; k < idx2facelist[idx + 1]; k++) {
-      sface.sh = facesperverlist[k];
-      sface.shver = 0;
+    for (k = edge2facelist[idx]; k < edge2facelist[idx + 1]; k++) {
+      sface = facesperedgelist[k];
       // sface may be died due to the removing of duplicated subfaces.
-      if (!isdead(&sface) && isfacehasedge(&sface, torg, tdest)) {
+      //   It is saved with the edge version of the edge it belongs to.
+      //   Only compare this edge, a subface may have another edge in the
+      //   same entry, it must not be found twice.
+      if (!isdead(&sface) &&
+          (((sorg(sface) == torg) && (sdest(sface) == tdest)) ||
+           ((sorg(sface) == tdest) && (sdest(sface) == torg)))) {
         // 'sface' contains this segment.
         findedge(&sface, torg, tdest);
         // Save it in 'sfacelist'.
@@ -13308,8 +15952,6 @@ void tetgenmesh::unifysegments()
     subsegloop.sh = shellfacetraverse(subsegs);
   }
 
-  delete [] idx2facelist;
-  delete [] facesperverlist;
   delete sfacelist;
 }
 
@@ -13323,18 +15965,24 @@ void tetgenmesh::unifysegments()
 // FACETVERTEX. Edge flips will be performed to ensure the Delaunay criteria //
 // of the triangulation of merged facets.                                    //
 //                                                                           //
+// The subfaces at a segment are found by the edge map ('mapsize',           //
+// 'edge2facelist', 'facesperedgelist') created by makeedgemap(). It stays   //
+// valid until the flips are performed.                                      //
+//                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
-void tetgenmesh::mergefacets(queue* flipqueue)
+void tetgenmesh::mergefacets(queue* flipqueue, int mapsize,
+                             int* edge2facelist, face* facesperedgelist)
 {
-  face parentsh, neighsh, neineighsh;
+  face parentsh, neighsh, sface;
   face segloop;
   point eorg, edest;
   REAL ori;
   bool mergeflag;
   int* segspernodelist;
   int fidx1, fidx2;
-  int i, j;
+  int facecount;
+  int i, j, k;
 
   if (b->verbose) {
     printf("  Merging coplanar facets.\n");
@@ -13363,10 +16011,22 @@ void tetgenmesh::mergefacets(queue* flipqueue)
   while (segloop.sh != (shellface *) NULL) {
     eorg = sorg(segloop);
     edest = sdest(segloop);
-    spivot(segloop, parentsh);
-    spivot(parentsh, neighsh);
-    spivot(neighsh, neineighsh);
-    if (parentsh.sh != neighsh.sh && parentsh.sh == neineighsh.sh) {
+    // Count the subfaces at this segment.
+    facecount = 0;
+    i = edgemapindex(eorg, edest, mapsize);
+    for (k = edge2facelist[i]; k < edge2facelist[i + 1]; k++) {
+      sface = facesperedgelist[k];
+      if (((sorg(sface) == eorg) && (sdest(sface) == edest)) ||
+          ((sorg(sface) == edest) && (sdest(sface) == eorg))) {
+        if (facecount == 0) {
+          neighsh = sface;
+        } else {
+          parentsh = sface;
+        }
+        facecount++;
+      }
+    }
+    if (facecount == 2) {
       // Exactly two subfaces at this segment.
       fidx1 = mark(parentsh) - 1;
       fidx2 = mark(neighsh) - 1;
@@ -13419,6 +16079,272 @@ void tetgenmesh::mergefacets(queue* flipqueue)
   delete [] segspernodelist;
 }
 
+#ifdef PTHREADS
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// triangulatefacetsthread()    Triangulate a range of facets in a thread.   //
+//                                                                           //
+// 'arg' is a pointer to a 'facetthread'.  The facets are triangulated into  //
+// the pools of its 'worker' mesh, which has its own working lists.          //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void* tetgenmesh::triangulatefacetsthread(void* arg)
+{
+  facetthread *ft;
+  tetgenmesh *m;
+  list *ptlist, *conlist;
+  queue *flipqueue;
+  int i;
+
+  ft = (facetthread *) arg;
+  m = ft->worker;
+  flipqueue = new queue(sizeof(flipitem));
+  ptlist = new list("int");
+  conlist = new list(sizeof(int) * 2, NULL);
+
+  for (i = ft->firstfacet; i < ft->lastfacet; i++) {
+    m->triangulatefacet(i + 1, ptlist, conlist, ft->idx2verlist, flipqueue);
+  }
+
+  delete flipqueue;
+  delete conlist;
+  delete ptlist;
+  return (void *) NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// initsurfaceworker()    Initialize a mesh object used by a thread for the  //
+//                        surface triangulation.                             //
+//                                                                           //
+// The worker shares the input, the points, 'dummytet', 'liftpointarray'     //
+// and 'liftaxisarray' with this mesh (they're only read, or written at      //
+// disjoint places).  It has its own pools of subfaces and subsegments, and  //
+// its own 'dummysh', since the surface triangulation uses dummysh[0] to     //
+// keep a hull subface.  It saves the isolated facet vertices in its         //
+// 'facetvertexlist' instead of setting their types in the shared points,    //
+// and logs the subfaces and subsegments it allocates and frees in its       //
+// 'shellfacelog'.                                                           //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::initsurfaceworker(tetgenmesh* worker)
+{
+  unsigned long alignptr;
+  int i;
+
+  worker->in = in;
+  worker->b = b;
+  worker->xmin = xmin;
+  worker->xmax = xmax;
+  worker->ymin = ymin;
+  worker->ymax = ymax;
+  worker->zmin = zmin;
+  worker->zmax = zmax;
+  worker->longest = longest;
+  worker->pointmarkindex = pointmarkindex;
+  worker->point2simindex = point2simindex;
+  worker->macheps = macheps;
+  worker->liftpointarray = liftpointarray;
+  worker->liftaxisarray = liftaxisarray;
+  worker->dummytet = dummytet;
+  worker->facetvertexlist = new list(sizeof(point), NULL);
+  worker->shellfacelog = new list(sizeof(shellfaceevent), NULL);
+
+  worker->subfaces = new memorypool(subfaces->itembytes, SUBPERBLOCK,
+                                    POINTER, 8);
+  worker->subsegs = new memorypool(subsegs->itembytes, SUBPERBLOCK,
+                                   POINTER, 8);
+  // Set up the worker's 'dummysh', a copy of this 'dummysh'.
+  worker->dummyshbase = (shellface *) new char[subfaces->itemwords *
+                          sizeof(shellface) + subfaces->alignbytes];
+  alignptr = (unsigned long) worker->dummyshbase;
+  worker->dummysh = (shellface *)
+    (alignptr + (unsigned long) subfaces->alignbytes
+     - (alignptr % (unsigned long) subfaces->alignbytes));
+  memcpy(worker->dummysh, dummysh, subfaces->itemwords * sizeof(shellface));
+  for (i = 0; i < 3; i++) {
+    worker->dummysh[i] = (shellface) worker->dummysh;
+    worker->dummysh[8 + i] = (shellface) worker->dummysh;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// transfersubfaces()    Move the subfaces and subsegments of a worker into  //
+//                       the pools 'subfaces' and 'subsegs'.                 //
+//                                                                           //
+// The allocations and deallocations logged by the worker are replayed on    //
+// 'subfaces' and 'subsegs' first, so the items get the same places (and     //
+// the freed places are reused in the same order) as in a serial run.  Each  //
+// worker item remembers the address of its copy in its (unused) badface     //
+// pointer.  Then the live items are copied, and the connections (to         //
+// subfaces and subsegments) of the copies are redirected to the copies,     //
+// and those to the worker's 'dummysh' are redirected to 'dummysh'.  The     //
+// connections to points and 'dummytet' need no change.                      //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::transfersubfaces(tetgenmesh* worker)
+{
+  memorypool *srcpool, *dstpool;
+  shellfaceevent *event;
+  shellface *srcsh, *newsh;
+  face checksh;
+  int i, j;
+
+  for (i = 0; i < worker->shellfacelog->len(); i++) {
+    event = (shellfaceevent *) (* worker->shellfacelog)[i];
+    dstpool = (event->pool == worker->subfaces) ? subfaces : subsegs;
+    if (event->dealloc) {
+      shellfacedealloc(dstpool, (shellface *) event->sh[11]);
+    } else {
+      event->sh[11] = (shellface) dstpool->alloc();
+    }
+  }
+
+  for (i = 0; i < 2; i++) {
+    srcpool = (i == 0) ? worker->subfaces : worker->subsegs;
+    srcpool->traversalinit();
+    srcsh = shellfacetraverse(srcpool);
+    while (srcsh != (shellface *) NULL) {
+      newsh = (shellface *) srcsh[11];
+      memcpy(newsh, srcsh, srcpool->itembytes);
+      newsh[11] = (shellface) NULL;
+      srcsh = shellfacetraverse(srcpool);
+    }
+  }
+
+  for (i = 0; i < 2; i++) {
+    srcpool = (i == 0) ? worker->subfaces : worker->subsegs;
+    srcpool->traversalinit();
+    srcsh = shellfacetraverse(srcpool);
+    while (srcsh != (shellface *) NULL) {
+      newsh = (shellface *) srcsh[11];
+      // Slots 0 - 2 are subfaces, slots 8 - 10 are subsegments.
+      for (j = 0; j < 11; j++) {
+        if (j == 3) j = 8;
+        sdecode(newsh[j], checksh);
+        if (checksh.sh == worker->dummysh) {
+          checksh.sh = dummysh;
+        } else if (checksh.sh != (shellface *) NULL) {
+          checksh.sh = (shellface *) checksh.sh[11];
+        }
+        newsh[j] = sencode(checksh);
+      }
+      srcsh = shellfacetraverse(srcpool);
+    }
+  }
+
+  // Let 'dummysh' hold the hull subface of the worker's last facet.
+  sdecode(worker->dummysh[0], checksh);
+  if ((checksh.sh != worker->dummysh) && (checksh.sh[3] != (shellface) NULL)) {
+    checksh.sh = (shellface *) checksh.sh[11];
+    dummysh[0] = sencode(checksh);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// triangulatefacetsparallel()    Triangulate all facets in 'b->numthreads'  //
+//                                threads.                                   //
+//                                                                           //
+// The facets are divided into ranges of consecutive facets having about the //
+// same number of polygon vertices.  Each thread triangulates one range into //
+// the pools of its own worker mesh.  On finish, the subfaces and            //
+// subsegments of the workers are moved into 'subfaces' and 'subsegs' in     //
+// facet order.                                                              //
+//                                                                           //
+// Facets are independent except they share vertices, which the threads     //
+// only read.  The types of the isolated facet vertices saved by the workers //
+// are set here after the threads are joined.                               //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::triangulatefacetsparallel(point* idx2verlist)
+{
+  facetthread *ftlist;
+  pthread_t *threads;
+  tetgenio::facet *f;
+  long totalweight, weight;
+  int numthreads, facetidx;
+  int i, j;
+
+  numthreads = b->numthreads;
+  if (numthreads > in->numberoffacets) {
+    numthreads = in->numberoffacets;
+  }
+  if (b->verbose) {
+    printf("  Triangulating %d facets in %d threads.\n", in->numberoffacets,
+           numthreads);
+  }
+
+  ftlist = new facetthread[numthreads];
+  threads = new pthread_t[numthreads];
+
+  // Divide the facets by the number of polygon vertices.
+  totalweight = 0l;
+  for (i = 0; i < in->numberoffacets; i++) {
+    f = &in->facetlist[i];
+    totalweight++;
+    for (j = 0; j < f->numberofpolygons; j++) {
+      totalweight += f->polygonlist[j].numberofvertices;
+    }
+  }
+  weight = 0l;
+  facetidx = 0;
+  for (i = 0; i < numthreads; i++) {
+    ftlist[i].firstfacet = facetidx;
+    while ((facetidx < in->numberoffacets) && 
+           ((weight < (totalweight * (i + 1)) / numthreads) ||
+            (facetidx == ftlist[i].firstfacet))) {
+      f = &in->facetlist[facetidx];
+      weight++;
+      for (j = 0; j < f->numberofpolygons; j++) {
+        weight += f->polygonlist[j].numberofvertices;
+      }
+      facetidx++;
+    }
+    if (i == numthreads - 1) {
+      facetidx = in->numberoffacets;
+    }
+    ftlist[i].lastfacet = facetidx;
+    ftlist[i].idx2verlist = idx2verlist;
+    ftlist[i].worker = new tetgenmesh();
+    initsurfaceworker(ftlist[i].worker);
+  }
+
+  for (i = 0; i < numthreads; i++) {
+    if (pthread_create(&threads[i], (pthread_attr_t *) NULL,
+                       triangulatefacetsthread, (void *) &ftlist[i]) != 0) {
+      printf("Error:  Unable to create a thread.\n");
+      exit(1);
+    }
+  }
+  for (i = 0; i < numthreads; i++) {
+    pthread_join(threads[i], (void **) NULL);
+  }
+
+  for (i = 0; i < numthreads; i++) {
+    for (j = 0; j < ftlist[i].worker->facetvertexlist->len(); j++) {
+      setpointtype(* (point *) (* ftlist[i].worker->facetvertexlist)[j],
+                   FACETVERTEX);
+    }
+    transfersubfaces(ftlist[i].worker);
+    // Don't let the worker free the shared objects.
+    ftlist[i].worker->liftpointarray = (REAL *) NULL;
+    ftlist[i].worker->liftaxisarray = (int *) NULL;
+    delete ftlist[i].worker;
+  }
+
+  delete [] threads;
+  delete [] ftlist;
+}
+
+#endif // PTHREADS
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // meshsurface()    Create a surface triangulation of a PLC.                 //
@@ -13435,6 +16361,9 @@ void tetgenmesh::mergefacets(queue* flipqueue)
 // subsegments are over-created.  Then, routine unifysegment() is called to  //
 // remove redundant subsegments and create the face ring around subsegments. //
 //                                                                           //
+// If TetGen is compiled with PTHREADS and '-t' is used, the CDTs of facets  //
+// are created in several threads by triangulatefacetsparallel().            //
+//                                                                           //
 // Return the number of (input) segments.                                    //
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
@@ -13444,6 +16373,9 @@ long tetgenmesh::meshsurface()
   list *ptlist, *conlist;
   queue *flipqueue;
   point *idx2verlist;
+  face *facesperedgelist;
+  int *edge2facelist;
+  int mapsize;
   int i;
 
   if (!b->quiet) {
@@ -13452,10 +16384,14 @@ long tetgenmesh::meshsurface()
 
   // Compute a mapping from indices to points.
   makeindex2pointmap(idx2verlist);
-  // Initialize 'liftpointarray'.
+  // Initialize 'liftpointarray' and 'liftaxisarray'.
   liftpointarray = new REAL[in->numberoffacets * 3];
+  liftaxisarray = new int[in->numberoffacets];
+  for (i = 0; i < in->numberoffacets; i++) {
+    liftaxisarray[i] = 0;
+  }
   // Initialize 'flipqueue'.
-  flipqueue = new queue(sizeof(badface));
+  flipqueue = new queue(sizeof(flipitem));
   // Two re-useable lists 'ptlist' and 'conlist'.
   ptlist = new list("int");
   conlist = new list(sizeof(int) * 2, NULL);
@@ -13463,19 +16399,35 @@ long tetgenmesh::meshsurface()
   // Loop the facet list, triangulate each facet. On finish, all subfaces
   //   are in 'subfaces', all segments are in 'subsegs' (Note: there exist
   //   duplicated segments).
+#ifdef PTHREADS
+  if (b->numthreads > 1) {
+    triangulatefacetsparallel(idx2verlist);
+  } else {
+    for (i = 0; i < in->numberoffacets; i++) {
+      triangulatefacet(i + 1, ptlist, conlist, idx2verlist, flipqueue);
+    }
+  }
+#else
   for (i = 0; i < in->numberoffacets; i++) {
     triangulatefacet(i + 1, ptlist, conlist, idx2verlist, flipqueue);
   }
+#endif
+
+  // Compute a mapping from edges to subfaces.  It is shared by the two
+  //   routines below.
+  makeedgemap(mapsize, edge2facelist, facesperedgelist);
 
   // Unify segments in 'subsegs', remove redundant segments.  Face links
   //   of segments are also built.
-  unifysegments();
+  unifysegments(mapsize, edge2facelist, facesperedgelist);
 
   if (!b->nomerge) {
     // Merge adjacent facets if they are coplanar.
-    mergefacets(flipqueue);
+    mergefacets(flipqueue, mapsize, edge2facelist, facesperedgelist);
   }
 
+  delete [] edge2facelist;
+  delete [] facesperedgelist;
   delete [] idx2verlist;
   delete flipqueue;
   delete conlist;
@@ -13490,175 +16442,403 @@ long tetgenmesh::meshsurface()
 
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
-// interecursive()    Recursively do intersection test on a set of triangles.//
+// buildbvh()    Build a bounding volume hierarchy (BVH) of a set of         //
+//               triangles.                                                  //
+//                                                                           //
+// The triangles are 'tris[first]', ..., 'tris[first + count - 1]', which    //
+// are indices of subfaces.  'triboxes' contains the bounding boxes of the   //
+// subfaces, the box of the i-th subface is in triboxes[6 * i], ...,         //
+// triboxes[6 * i + 5] (xmin, ymin, zmin, xmax, ymax, zmax).                 //
 //                                                                           //
-// Recursively split the set 'subfacearray' of subfaces into two sets using  //
-// a cut plane parallel to x-, or, y-, or z-axies.  The split criteria are   //
-// follows. Assume the cut plane is H, and H+ denotes the left halfspace of  //
-// H, and H- denotes the right halfspace of H; and s be a subface:           //
+// The node of the set is the 'nodeidx'-th entry of 'nodes', 'nodecount' is  //
+// the number of used entries of 'nodes'.  If the set has more than four     //
+// triangles, it is split into two halves at the median of the centers of    //
+// their boxes along the longest axis of the box of the centers, two entries //
+// are used for the children, and they are built recursively.  Hence a leaf  //
+// has at least two triangles (if 'count' > 1), and 'nodes' needs at most    //
+// 'count' entries.  The triangles of a leaf are continuous in 'tris'.       //
 //                                                                           //
-//    (1) If all points of s lie at H+, put it into left array;              //
-//    (2) If all points of s lie at H-, put it into right array;             //
-//    (3) If some points of s lie at H+ and some of lie at H-, or some       //
-//        points lie on H, put it into both arraies.                         //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::buildbvh(bvhnode* nodes, int nodeidx, int* nodecount,
+                          int* tris, REAL* triboxes, int first, int count)
+{
+  bvhnode *node;
+  REAL cmin[3], cmax[3], c, pivot;
+  int axis, child;
+  int lo, hi, mid, i, j, k;
+
+  node = &nodes[nodeidx];
+
+  // Get the bounding box of the set and the bounding box of the centers
+  //   (doubled) of the boxes of the triangles.
+  for (j = 0; j < 3; j++) {
+    node->bbox[j] = triboxes[6 * tris[first] + j];
+    node->bbox[3 + j] = triboxes[6 * tris[first] + 3 + j];
+    cmin[j] = cmax[j] = node->bbox[j] + node->bbox[3 + j];
+  }
+  for (i = first + 1; i < first + count; i++) {
+    for (j = 0; j < 3; j++) {
+      if (triboxes[6 * tris[i] + j] < node->bbox[j]) {
+        node->bbox[j] = triboxes[6 * tris[i] + j];
+      }
+      if (triboxes[6 * tris[i] + 3 + j] > node->bbox[3 + j]) {
+        node->bbox[3 + j] = triboxes[6 * tris[i] + 3 + j];
+      }
+      c = triboxes[6 * tris[i] + j] + triboxes[6 * tris[i] + 3 + j];
+      if (c < cmin[j]) cmin[j] = c;
+      if (c > cmax[j]) cmax[j] = c;
+    }
+  }
+
+  if (count <= 4) {
+    // Make a leaf.
+    node->index = first;
+    node->count = count;
+    return;
+  }
+
+  // Choose the longest axis of the box of the centers.
+  axis = 0;
+  for (j = 1; j < 3; j++) {
+    if ((cmax[j] - cmin[j]) > (cmax[axis] - cmin[axis])) axis = j;
+  }
+  // Partition the set at the median (the 'mid'-th triangle) of the centers
+  //   along 'axis' (by Hoare's selection).
+  mid = first + count / 2;
+  lo = first;
+  hi = first + count - 1;
+  while (lo < hi) {
+    k = tris[(lo + hi) / 2];
+    pivot = triboxes[6 * k + axis] + triboxes[6 * k + 3 + axis];
+    i = lo;
+    j = hi;
+    while (i <= j) {
+      while ((triboxes[6 * tris[i] + axis] + triboxes[6 * tris[i] + 3 + axis])
+             < pivot) i++;
+      while ((triboxes[6 * tris[j] + axis] + triboxes[6 * tris[j] + 3 + axis])
+             > pivot) j--;
+      if (i <= j) {
+        k = tris[i]; tris[i] = tris[j]; tris[j] = k;
+        i++;
+        j--;
+      }
+    }
+    if (mid <= j) {
+      hi = j;
+    } else if (mid >= i) {
+      lo = i;
+    } else {
+      break;
+    }
+  }
+
+  // Build the two children. They are next to each other in 'nodes'.
+  child = *nodecount;
+  *nodecount += 2;
+  node->index = child;
+  node->count = 0;
+  buildbvh(nodes, child, nodecount, tris, triboxes, first, mid - first);
+  buildbvh(nodes, child + 1, nodecount, tris, triboxes, mid,
+           first + count - mid);
+}
+
+///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
-// Partitions by x-axis if axis == '0'; by y-axis if axis == '1'; by z-axis  //
-// if axis == '2'. If current cut plane is parallel to the x-axis, the next  //
-// one will be parallel to y-axis, and the next one after the next is z-axis,//
-// and then alternately return back to x-axis.                               //
+// interfacepair()    Test whether two subfaces are intersecting.            //
 //                                                                           //
-// Stop splitting when the number of triangles of the input array is not     //
-// decreased anymore. Do tests on the current set.                           //
+// If they're intersecting or duplicated, the pair and the result of the     //
+// test are appended to 'interlist' (an 'interpair'), they are reported by   //
+// detectinterfaces().  This routine only reads the mesh, it can be called   //
+// in several threads.                                                       //
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
-void tetgenmesh::
-interecursive(shellface** subfacearray, int arraysize, int axis, REAL bxmin,
-              REAL bxmax, REAL bymin, REAL bymax, REAL bzmin, REAL bzmax,
-              int* internum)
+void tetgenmesh::interfacepair(face* sface1, face* sface2, list* interlist)
 {
-  shellface **leftarray, **rightarray;
-  face sface1, sface2;
-  point p1, p2, p3;
-  point p4, p5, p6;
+  interpair pair;
   enum intersectresult intersect;
-  REAL split;
-  bool toleft, toright;
-  int leftsize, rightsize;
-  int i, j;
 
-  if (b->verbose > 1) {
-    printf("  Recur %d faces. Bbox (%g, %g, %g),(%g, %g, %g). %s-axis\n",
-           arraysize, bxmin, bymin, bzmin, bxmax, bymax, bzmax,
-           axis == 0 ? "x" : (axis == 1 ? "y" : "z"));
+  intersect = triangle_triangle_inter((point) sface1->sh[3],
+    (point) sface1->sh[4], (point) sface1->sh[5], (point) sface2->sh[3],
+    (point) sface2->sh[4], (point) sface2->sh[5]);
+  if (intersect == INTERSECT || intersect == SHAREFACE) {
+    pair.sh[0] = sface1->sh;
+    pair.sh[1] = sface2->sh;
+    pair.type = intersect;
+    interlist->append(&pair);
   }
-    
-  leftarray = new shellface*[arraysize];
-  if (leftarray == NULL) {
-    printf("Error in interecursive():  Insufficient memory.\n");
-    exit(1);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// splitbvhpair()    Split a pair of nodes of a BVH into pairs of their      //
+//                   children.                                               //
+//                                                                           //
+// If 'node1' and 'node2' are the same interior node, there are three pairs: //
+// the two children with themselves and with each other.  If they are two    //
+// nodes with overlapping bounding boxes, and one of them is an interior     //
+// node, there are two pairs: the bigger interior node is replaced by its    //
+// two children.  The pairs are returned in 'pairs' (two entries per pair).  //
+//                                                                           //
+// Return the number of pairs, or 0 if both nodes are leaves (or the same    //
+// leaf), or -1 if the bounding boxes of the two nodes do not overlap.       //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+int tetgenmesh::splitbvhpair(bvhnode* nodes, int node1, int node2, int* pairs)
+{
+  bvhnode *n1, *n2;
+  REAL len1, len2;
+  int k;
+
+  n1 = &nodes[node1];
+  n2 = &nodes[node2];
+
+  if (node1 == node2) {
+    if (n1->count != 0) return 0;
+    // Pairs inside each child and the pair between the two children.
+    pairs[0] = pairs[1] = n1->index;
+    pairs[2] = pairs[3] = n1->index + 1;
+    pairs[4] = n1->index;
+    pairs[5] = n1->index + 1;
+    return 3;
   }
-  rightarray = new shellface*[arraysize];
-  if (rightarray == NULL) {
-    printf("Error in interecursive():  Insufficient memory.\n");
-    exit(1);
+
+  // Do the two bounding boxes overlap?
+  for (k = 0; k < 3; k++) {
+    if ((n1->bbox[k] > n2->bbox[3 + k]) || (n2->bbox[k] > n1->bbox[3 + k])) {
+      return -1;
+    }
   }
-  leftsize = rightsize = 0;
+  if ((n1->count != 0) && (n2->count != 0)) return 0;
 
-  if (axis == 0) {
-    // Split along x-axis.
-    split = 0.5 * (bxmin + bxmax);
-  } else if (axis == 1) {
-    // Split along y-axis.
-    split = 0.5 * (bymin + bymax);
+  // Go down the bigger (interior) node.
+  len1 = len2 = 0.0;
+  for (k = 0; k < 3; k++) {
+    len1 += n1->bbox[3 + k] - n1->bbox[k];
+    len2 += n2->bbox[3 + k] - n2->bbox[k];
+  }
+  if ((n2->count != 0) || ((n1->count == 0) && (len1 >= len2))) {
+    pairs[0] = n1->index;
+    pairs[2] = n1->index + 1;
+    pairs[1] = pairs[3] = node2;
   } else {
-    // Split along z-axis.
-    split = 0.5 * (bzmin + bzmax);
-  }
-
-  for (i = 0; i < arraysize; i++) {
-    sface1.sh = subfacearray[i];
-    p1 = (point) sface1.sh[3];
-    p2 = (point) sface1.sh[4];
-    p3 = (point) sface1.sh[5];
-    toleft = toright = false;
-    if (p1[axis] < split) {
-      toleft = true;
-      if (p2[axis] >= split || p3[axis] >= split) {
-        toright = true;
-      } 
-    } else if (p1[axis] > split) {
-      toright = true;
-      if (p2[axis] <= split || p3[axis] <= split) {
-        toleft = true;
-      } 
-    } else {
-      // p1[axis] == split;
-      toleft = true;
-      toright = true;
-    }
-    // At least one is true;
-    assert(!(toleft == false && toright == false));
-    if (toleft) {
-      leftarray[leftsize] = sface1.sh;
-      leftsize++;
-    }
-    if (toright) {
-      rightarray[rightsize] = sface1.sh;
-      rightsize++;
-    }
-  }
-
-  if (leftsize < arraysize && rightsize < arraysize) {
-    // Continue to partition the input set. Now 'subfacearray' has been
-    //   split into two sets, it's memory can be freed. 'leftarray' and
-    //   'rightarray' will be freed in the next recursive (after they're
-    //   partitioned again or performing tests).
-    delete [] subfacearray;
-    // Continue to split these two sets.
-    if (axis == 0) {
-      interecursive(leftarray, leftsize, 1, bxmin, split, bymin, bymax,
-                    bzmin, bzmax, internum);
-      interecursive(rightarray, rightsize, 1, split, bxmax, bymin, bymax,
-                    bzmin, bzmax, internum);
-    } else if (axis == 1) {
-      interecursive(leftarray, leftsize, 2, bxmin, bxmax, bymin, split,
-                    bzmin, bzmax, internum);
-      interecursive(rightarray, rightsize, 2, bxmin, bxmax, split, bymax,
-                    bzmin, bzmax, internum);
-    } else {
-      interecursive(leftarray, leftsize, 0, bxmin, bxmax, bymin, bymax,
-                    bzmin, split, internum);
-      interecursive(rightarray, rightsize, 0, bxmin, bxmax, bymin, bymax,
-                    split, bzmax, internum);
+    pairs[0] = pairs[2] = node1;
+    pairs[1] = n2->index;
+    pairs[3] = n2->index + 1;
+  }
+  return 2;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// interbvh()    Find the intersecting pairs of triangles of two nodes of a  //
+//               BVH built by buildbvh().                                    //
+//                                                                           //
+// If 'node1' and 'node2' are the same node, pairs of triangles in this node //
+// are tested.  Otherwise, pairs with one triangle from each node are tested.//
+// The nodes are split by splitbvhpair() until both are leaves,  nodes whose //
+// bounding boxes do not overlap are skipped.  A pair of triangles is only   //
+// tested if their bounding boxes overlap.  Hence each pair is tested at     //
+// most once.  The triangles of the other leaf are first tested in a batch   //
+// by triangle_triangles_filter(), most pairs are separated by the plane of  //
+// one of the triangles.  Only the rest are tested by interfacepair() with   //
+// exact arithmetic, the intersecting pairs are appended to 'interlist'.     //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::interbvh(bvhnode* nodes, int node1, int node2,
+                          shellface** subfacearray, int* tris,
+                          REAL* triboxes, list* interlist)
+{
+  bvhnode *n1, *n2;
+  face sface1, sface2;
+  REAL *box1, *box2;
+  REAL *cands[12];
+  bool overlap;
+  int candidx[4], sepflags[4];
+  int pairs[6];
+  int pairnum, candnum;
+  int i, j, k, start;
+
+  pairnum = splitbvhpair(nodes, node1, node2, pairs);
+  if (pairnum < 0) return;
+  if (pairnum > 0) {
+    for (i = 0; i < pairnum; i++) {
+      interbvh(nodes, pairs[2 * i], pairs[2 * i + 1], subfacearray, tris,
+               triboxes, interlist);
     }
-  } else {
-    if (b->verbose > 1) {
-      printf("  Checking intersecting faces.\n");
+    return;
+  }
+
+  // Both are leaves. Perform a brute-force compare on them.
+  n1 = &nodes[node1];
+  n2 = &nodes[node2];
+  for (i = n1->index; i < n1->index + n1->count; i++) {
+    box1 = &triboxes[6 * tris[i]];
+    sface1.sh = subfacearray[tris[i]];
+    // Collect the triangles (at most 4, see buildbvh()) whose boxes overlap.
+    candnum = 0;
+    start = (node1 == node2) ? i + 1 : n2->index;
+    for (j = start; j < n2->index + n2->count; j++) {
+      box2 = &triboxes[6 * tris[j]];
+      overlap = true;
+      for (k = 0; (k < 3) && overlap; k++) {
+        overlap = (box1[k] <= box2[3 + k]) && (box2[k] <= box1[3 + k]);
+      }
+      if (overlap) {
+        candidx[candnum] = tris[j];
+        for (k = 0; k < 3; k++) {
+          cands[3 * candnum + k] = (REAL *) subfacearray[tris[j]][3 + k];
+        }
+        candnum++;
+      }
     }
-    // Perform a brute-force compare on the set.
-    for (i = 0; i < arraysize; i++) {
-      sface1.sh = subfacearray[i];
-      p1 = (point) sface1.sh[3];
-      p2 = (point) sface1.sh[4];
-      p3 = (point) sface1.sh[5];
-      for (j = i + 1; j < arraysize; j++) {
-        sface2.sh = subfacearray[j];
-        p4 = (point) sface2.sh[3];
-        p5 = (point) sface2.sh[4];
-        p6 = (point) sface2.sh[5];
-        intersect = triangle_triangle_inter(p1, p2, p3, p4, p5, p6);
-        if (intersect == INTERSECT || intersect == SHAREFACE) {
-          if (!b->quiet) {
-            if (intersect == INTERSECT) {
-              printf("  Facet #%d intersects facet #%d at triangles:\n",
-                     mark(sface1), mark(sface2));
-              printf("    (%4d, %4d, %4d) and (%4d, %4d, %4d)\n",
-                     pointmark(p1), pointmark(p2), pointmark(p3),
-                     pointmark(p4), pointmark(p5), pointmark(p6));
-            } else {
-              printf("  Facet #%d duplicates facet #%d at triangle:\n",
-                     mark(sface1), mark(sface2));
-              printf("    (%4d, %4d, %4d)\n", pointmark(p1), pointmark(p2),
-                     pointmark(p3));
-            }
-          }
-          // Increase the number of intersecting pairs.
-          (*internum)++; 
-          // For output them, infect these two faces (although they may
-          //   already be infected).
-          sinfect(sface1);
-          sinfect(sface2);
+    if (candnum == 0) continue;
+    // Skip the triangles separated by the plane of sface1.
+    if (triangle_triangles_filter((point) sface1.sh[3], (point) sface1.sh[4],
+          (point) sface1.sh[5], cands, candnum, sepflags) == 0) continue;
+    for (j = 0; j < candnum; j++) {
+      if (sepflags[j]) continue;
+      // Is sface1 separated by the plane of this triangle?
+      if (triangle_triangles_filter(cands[3 * j], cands[3 * j + 1],
+            cands[3 * j + 2], (REAL **) &(sface1.sh[3]), 1, &sepflags[j])
+          == 0) continue;
+      sface2.sh = subfacearray[candidx[j]];
+      interfacepair(&sface1, &sface2, interlist);
+    }
+  }
+}
+
+#ifdef PTHREADS
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// interbvhthread()    Do a part of the tasks of the parallel detection of   //
+//                     intersecting facets in a thread.                      //
+//                                                                           //
+// 'arg' is a pointer to an 'interthread'.                                   //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void* tetgenmesh::interbvhthread(void* arg)
+{
+  interthread *it;
+  int *task;
+  int i;
+
+  it = (interthread *) arg;
+  for (i = it->firsttask; i < it->tasklist->len(); i += it->step) {
+    task = (int *) (* it->tasklist)[i];
+    it->mesh->interbvh(it->nodes, task[0], task[1], it->subfacearray,
+                       it->tris, it->triboxes, it->interlists[i]);
+  }
+  return (void *) NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// interbvhparallel()    Find the intersecting pairs of triangles of a BVH   //
+//                       in 'b->numthreads' threads.                         //
+//                                                                           //
+// The pair of the root with itself is split (by splitbvhpair()) level by    //
+// level into a list of tasks (pairs of nodes), until there are enough tasks //
+// to keep all threads busy.  The threads do the tasks by interbvh(), each   //
+// task saves its intersecting pairs in its own list.  Then the lists are    //
+// appended to 'interlist' in the order of the tasks, so the result does not //
+// depend on the scheduling of the threads.                                  //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::interbvhparallel(bvhnode* nodes, shellface** subfacearray,
+                                  int* tris, REAL* triboxes, list* interlist)
+{
+  interthread *itlist;
+  pthread_t *threads;
+  list *tasklist, *newtasklist, *swaplist;
+  list **interlists;
+  int *task;
+  int pairs[6];
+  int numthreads, pairnum, splitnum;
+  int i, j;
+
+  numthreads = b->numthreads;
+
+  // Split the root pair into tasks.
+  tasklist = new list(sizeof(int) * 2, NULL);
+  newtasklist = new list(sizeof(int) * 2, NULL);
+  pairs[0] = pairs[1] = 0;
+  tasklist->append(pairs);
+  do {
+    splitnum = 0;
+    for (i = 0; i < tasklist->len(); i++) {
+      task = (int *) (* tasklist)[i];
+      pairnum = splitbvhpair(nodes, task[0], task[1], pairs);
+      if (pairnum == 0) {
+        // Both are leaves, keep it.
+        newtasklist->append(task);
+      } else if (pairnum > 0) {
+        for (j = 0; j < pairnum; j++) {
+          newtasklist->append(&pairs[2 * j]);
         }
+        splitnum++;
       }
     }
-    // Don't forget to free all three arrays. No further partition.
-    delete [] leftarray;
-    delete [] rightarray;  
-    delete [] subfacearray;
+    swaplist = tasklist;
+    tasklist = newtasklist;
+    newtasklist = swaplist;
+    newtasklist->clear();
+  } while ((splitnum > 0) && (tasklist->len() < 16 * numthreads));
+  delete newtasklist;
+
+  if (b->verbose) {
+    printf("  Testing %d pairs of nodes in %d threads.\n", tasklist->len(),
+           numthreads);
+  }
+
+  interlists = new list*[tasklist->len()];
+  for (i = 0; i < tasklist->len(); i++) {
+    interlists[i] = new list(sizeof(interpair), NULL, 16);
+  }
+  itlist = new interthread[numthreads];
+  threads = new pthread_t[numthreads];
+  for (i = 0; i < numthreads; i++) {
+    itlist[i].mesh = this;
+    itlist[i].nodes = nodes;
+    itlist[i].subfacearray = subfacearray;
+    itlist[i].tris = tris;
+    itlist[i].triboxes = triboxes;
+    itlist[i].tasklist = tasklist;
+    itlist[i].interlists = interlists;
+    itlist[i].firsttask = i;
+    itlist[i].step = numthreads;
+    if (pthread_create(&threads[i], (pthread_attr_t *) NULL,
+                       interbvhthread, (void *) &itlist[i]) != 0) {
+      printf("Error:  Unable to create a thread.\n");
+      exit(1);
+    }
+  }
+  for (i = 0; i < numthreads; i++) {
+    pthread_join(threads[i], (void **) NULL);
+  }
+
+  // Collect the found pairs.
+  for (i = 0; i < tasklist->len(); i++) {
+    for (j = 0; j < interlists[i]->len(); j++) {
+      interlist->append((* interlists[i])[j]);
+    }
+    delete interlists[i];
   }
+
+  delete [] threads;
+  delete [] itlist;
+  delete [] interlists;
+  delete tasklist;
 }
 
+#endif // PTHREADS
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // detectinterfaces()    Detect intersecting triangles.                      //
@@ -13672,25 +16852,35 @@ interecursive(shellface** subfacearray, int arraysize, int axis, REAL bxmin,
 // simple and stable. It is based on geometric orientation test which uses   //
 // exact arithmetics.                                                        //
 //                                                                           //
-// Use divide-and-conquer algorithm for reducing the number of intersection  //
-// tests.  Start from the bounding box of the input point set, recursively   //
-// partition the box into smaller boxes, until the number of triangles in a  //
-// box is not decreased anymore. Then perform triangle-triangle tests on the //
-// remaining set of triangles.  The memory allocated in the input set is     //
-// freed immediately after it has been partitioned into two arrays.  So it   //
-// can be re-used for the consequent partitions.                             //
+// A bounding volume hierarchy (BVH) of the triangles is built for reducing  //
+// the number of intersection tests.  Each node of it has the bounding box   //
+// of its triangles. The two children of a node are the two halves of the    //
+// triangles split at the median along the longest axis, see buildbvh().     //
+// Then pairs of nodes with overlapping boxes are visited from the root,     //
+// pairs of triangles in leaves are tested if their boxes overlap, see       //
+// interbvh().  The nodes are stored in an array, a triangle is stored in    //
+// exactly one leaf.                                                         //
 //                                                                           //
-// On return, pool 'subfaces' will be cleared, and only the intersecting     //
-// triangles remain for output (to a .face file).                            //
+// If TetGen is compiled with PTHREADS and '-t' is used, the pairs of nodes  //
+// are tested in several threads by interbvhparallel().                      //
+//                                                                           //
+// The intersecting pairs are collected in 'interpairlist' (kept for the     //
+// outintersections()).  On return, pool 'subfaces' will be cleared, and     //
+// only the intersecting triangles remain for output (to a .face file).      //
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
 void tetgenmesh::detectinterfaces()
 {
   shellface **subfacearray;
-  face shloop;
-  int internum;
-  int i;
+  interpair *pair;
+  bvhnode *nodes;
+  face shloop, sface1, sface2;
+  point pt, p1, p2, p3, p4, p5, p6;
+  REAL *triboxes;
+  int *tris;
+  int internum, nodecount;
+  int i, j, k;
 
   if (!b->quiet) {
     printf("Detecting intersecting facets.\n");
@@ -13707,12 +16897,87 @@ void tetgenmesh::detectinterfaces()
     i++;
   }
 
+  // Compute the bounding boxes of the subfaces.
+  triboxes = new REAL[subfaces->items * 6];
+  tris = new int[subfaces->items];
+  for (i = 0; i < subfaces->items; i++) {
+    for (j = 0; j < 3; j++) {
+      pt = (point) subfacearray[i][3 + j];
+      for (k = 0; k < 3; k++) {
+        if ((j == 0) || (pt[k] < triboxes[6 * i + k])) {
+          triboxes[6 * i + k] = pt[k];
+        }
+        if ((j == 0) || (pt[k] > triboxes[6 * i + 3 + k])) {
+          triboxes[6 * i + 3 + k] = pt[k];
+        }
+      }
+    }
+    tris[i] = i;
+  }
+
+  // The found pairs are kept for outintersections().
+  if (interpairlist != (list *) NULL) {
+    delete interpairlist;
+  }
+  interpairlist = new list(sizeof(interpair), NULL);
+
   internum = 0;
-  // Recursively split the set of triangles into two sets using a cut plane
-  //   parallel to x-, or, y-, or z-axies.  Stop splitting when the number
-  //   of subfaces is not decreasing anymore. Do tests on the current set.
-  interecursive(subfacearray, subfaces->items, 0, xmin, xmax, ymin, ymax,
-                zmin, zmax, &internum);
+  if (subfaces->items > 0) {
+    // Build the BVH, then find the intersecting pairs of triangles in it.
+    nodes = new bvhnode[subfaces->items];
+    nodecount = 1;
+    buildbvh(nodes, 0, &nodecount, tris, triboxes, 0, (int) subfaces->items);
+    if (b->verbose) {
+      printf("  Built a bounding volume hierarchy of %d nodes.\n",
+             nodecount);
+    }
+#ifdef PTHREADS
+    if (b->numthreads > 1) {
+      interbvhparallel(nodes, subfacearray, tris, triboxes, interpairlist);
+    } else {
+      interbvh(nodes, 0, 0, subfacearray, tris, triboxes, interpairlist);
+    }
+#else
+    interbvh(nodes, 0, 0, subfacearray, tris, triboxes, interpairlist);
+#endif
+    delete [] nodes;
+  }
+
+  // Report the found pairs (already tested), infect them for output.
+  for (i = 0; i < interpairlist->len(); i++) {
+    pair = (interpair *) (* interpairlist)[i];
+    sface1.sh = pair->sh[0];
+    sface2.sh = pair->sh[1];
+    if (!b->quiet) {
+      p1 = (point) sface1.sh[3];
+      p2 = (point) sface1.sh[4];
+      p3 = (point) sface1.sh[5];
+      if (pair->type == INTERSECT) {
+        p4 = (point) sface2.sh[3];
+        p5 = (point) sface2.sh[4];
+        p6 = (point) sface2.sh[5];
+        printf("  Facet #%d intersects facet #%d at triangles:\n",
+               mark(sface1), mark(sface2));
+        printf("    (%4d, %4d, %4d) and (%4d, %4d, %4d)\n",
+               pointmark(p1), pointmark(p2), pointmark(p3),
+               pointmark(p4), pointmark(p5), pointmark(p6));
+      } else {
+        printf("  Facet #%d duplicates facet #%d at triangle:\n",
+               mark(sface1), mark(sface2));
+        printf("    (%4d, %4d, %4d)\n", pointmark(p1), pointmark(p2),
+               pointmark(p3));
+      }
+    }
+    internum++;
+    // For output them, infect these two faces (although they may
+    //   already be infected).
+    sinfect(sface1);
+    sinfect(sface2);
+  }
+
+  delete [] tris;
+  delete [] triboxes;
+  delete [] subfacearray;
 
   if (!b->quiet) {
     if (internum > 0) {
@@ -14467,6 +17732,175 @@ tetgenmesh::point tetgenmesh::getsplitpoint(face* splitseg, point refpoint)
   return splitpoint;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// collectstartets()    Collect the tetrahedra sharing a given vertex of the //
+//                      DT.                                                  //
+//                                                                           //
+// 'newpoint' is a vertex of the DT, 'searchtet' is a handle near to it (it  //
+// may be dead).  The tetrahedra sharing 'newpoint' are found by a breadth-  //
+// first search and returned in 'startetlist' (which is empty on input).     //
+// 'newpoint' is the origin of each of them.                                 //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::
+collectstartets(point newpoint, triface* searchtet, list* startetlist)
+{
+  triface starttet, neightet;
+  int i;
+
+  // Get a tetrahedron having 'newpoint' as a vertex.
+  starttet = *searchtet;
+  if (isdead(&starttet) || !findorg(&starttet, newpoint)) {
+    if (isdead(&starttet)) {
+      starttet.tet = dummytet;
+      starttet.loc = 0;
+      symself(starttet);
+    }
+    if (locate(newpoint, &starttet) != ONVERTEX) {
+      printf("Internal error in collectstartets():  Failed to locate\n");
+      printf("  point (%.12g, %.12g, %.12g) %d.\n", newpoint[0],
+             newpoint[1], newpoint[2], pointmark(newpoint));
+      internalerror();
+    }
+  }
+
+  infect(starttet);
+  startetlist->append(&starttet);
+  for (i = 0; i < startetlist->len(); i++) {
+    starttet = * (triface *)(* startetlist)[i];
+    for (starttet.loc = 0; starttet.loc < 4; starttet.loc++) {
+      sym(starttet, neightet);
+      if ((neightet.tet != dummytet) && !infected(neightet)) {
+        if (findorg(&neightet, newpoint)) {
+          infect(neightet);
+          startetlist->append(&neightet);
+        }
+      }
+    }
+  }
+
+  // Uninfect them before return.
+  for (i = 0; i < startetlist->len(); i++) {
+    starttet = * (triface *)(* startetlist)[i];
+    uninfect(starttet);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// markstarvertices()    Mark the vertices of the tetrahedra sharing a given //
+//                       vertex of the DT.                                   //
+//                                                                           //
+// 'newpoint' is a vertex of the DT, 'searchtet' is a handle near to it (it  //
+// may be dead).  'ptmarklist' is a list of integers indexed by the indices  //
+// of vertices (minus 'in->firstnumber'), it is enlarged to hold all the     //
+// vertices.  The entries of the vertices of the tetrahedra sharing          //
+// 'newpoint' (including itself) are set to be 'stamp'.  The indices of the  //
+// vertices which were not marked by 'stamp' before are appended to          //
+// 'markedlist'.                                                             //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::
+markstarvertices(point newpoint, triface* searchtet, list* ptmarklist,
+                 list* markedlist, int stamp)
+{
+  list *startetlist;
+  triface starttet;
+  point pt;
+  int *mark;
+  int zero, idx, i, j;
+
+  // Enlarge 'ptmarklist' if it is necessary.
+  zero = 0;
+  while (ptmarklist->len() < points->items) {
+    ptmarklist->append(&zero);
+  }
+
+  // Collect all tetrahedra sharing 'newpoint'.
+  startetlist = new list(sizeof(triface), NULL, 64);
+  collectstartets(newpoint, searchtet, startetlist);
+
+  // Mark their vertices.
+  for (i = 0; i < startetlist->len(); i++) {
+    starttet = * (triface *)(* startetlist)[i];
+    starttet.loc = 0;
+    starttet.ver = 0;
+    for (j = 0; j < 4; j++) {
+      if (j == 0) pt = org(starttet);
+      else if (j == 1) pt = dest(starttet);
+      else if (j == 2) pt = apex(starttet);
+      else pt = oppo(starttet);
+      idx = pointmark(pt) - in->firstnumber;
+      mark = (int *)(* ptmarklist)[idx];
+      if (*mark != stamp) {
+        *mark = stamp;
+        markedlist->append(&idx);
+      }
+    }
+  }
+
+  delete startetlist;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// addsegatvertex()    Add a segment to the segments at a vertex.            //
+//                                                                           //
+// 'segheads' is a list of integers indexed by the indices of vertices       //
+// (minus 'in->firstnumber'), the entry of a vertex is the index of its first//
+// segment in 'segrecs' (a list of 'segatvertex'), or -1.  'segheads' is     //
+// enlarged to hold 'pt'.                                                    //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::
+addsegatvertex(list* segheads, list* segrecs, point pt, shellface* sh)
+{
+  segatvertex rec;
+  int *head;
+  int none, idx;
+
+  idx = pointmark(pt) - in->firstnumber;
+  none = -1;
+  while (segheads->len() <= idx) {
+    segheads->append(&none);
+  }
+  head = (int *)(* segheads)[idx];
+  rec.sh = sh;
+  rec.next = *head;
+  *head = segrecs->len();
+  segrecs->append(&rec);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// replacesegatvertex()    Replace a segment at a vertex by another one.     //
+//                                                                           //
+// 'oldsh' must be a segment at 'pt' (added by addsegatvertex()).            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::
+replacesegatvertex(list* segheads, list* segrecs, point pt, shellface* oldsh,
+                   shellface* newsh)
+{
+  segatvertex *rec;
+  int i;
+
+  i = * (int *)(* segheads)[pointmark(pt) - in->firstnumber];
+  while (i != -1) {
+    rec = (segatvertex *)(* segrecs)[i];
+    if (rec->sh == oldsh) {
+      rec->sh = newsh;
+      return;
+    }
+    i = rec->next;
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // delaunizesegments()    Split segments repeatedly until they appear in a   //
@@ -14483,15 +17917,23 @@ tetgenmesh::point tetgenmesh::getsplitpoint(face* splitseg, point refpoint)
 // surface mesh F of X.  DT and F have exactly the same vertices.  They are  //
 // updated simultaneously with the newly inserted points.                    //
 //                                                                           //
-// Missing segments are found by looping the set S of segments, checking the //
-// existence of each segment in DT.  Once a segment is found missing in DT,  //
-// it is split into two subsegments by inserting a point into both DT and F, //
-// and S is updated accordingly.  However, the inserted point may cause some //
-// other existing segments be non-Delaunay,  hence are missing from the DT.  //
-// In order to force all segments to appear in DT, we have to loop S again   //
-// after some segments are split. (A little ugly method)  Use a handle to    //
-// remember the last segment be split in one loop, hence all segments after  //
-// it are existing and need not be checked.                                  //
+// Missing segments are found by a worklist of segments, which initially     //
+// contains all segments of the set S, checking the existence of each        //
+// segment in DT.  Once a segment is found missing in DT, it is split into   //
+// two subsegments by inserting a point into both DT and F, the two          //
+// subsegments are put at the end of the worklist.  Segments found in DT are //
+// not checked again, except the following case: the inserted point may      //
+// cause some other existing segments be non-Delaunay, hence are missing     //
+// from the DT.  Such a segment was an edge of the cavity of the point, both //
+// its endpoints are connected to the point after the insertion.  These      //
+// endpoints are marked by markstarvertices().  When the worklist is empty,  //
+// segments having both endpoints marked are put into it again.  Stop when   //
+// the worklist is empty and no point was inserted.                          //
+//                                                                           //
+// The pool 'subsegs' is only traversed once to fill the worklist.  To find  //
+// the segments having both endpoints marked, the segments at each vertex are//
+// kept (see addsegatvertex()), and only the segments at the vertices marked //
+// in the round are visited.                                                 //
 //                                                                           //
 // In priciple, a segment on the convex hull should exist in DT. However, if //
 // there are four coplanar points on the convex hull, and the DT only can    //
@@ -14506,16 +17948,20 @@ tetgenmesh::point tetgenmesh::getsplitpoint(face* splitseg, point refpoint)
 
 void tetgenmesh::delaunizesegments()
 {
-  queue *flipqueue;
+  queue *flipqueue, *segqueue;
+  list *ptmarklist, *markedlist;
+  list *segheads, *segrecs;
+  segatvertex *rec;
   triface searchtet;
-  face segloop, lastsplit;
-  face splitsh;
+  face segloop, newseg;
+  face splitsh, *pseg;
   point p1, p2;
   point tend, checkpoint;
   point refpoint, splitpoint; 
   enum finddirectionresult collinear;
   enum insertsiteresult success;
-  bool finish;
+  long splitcount, insertcount;
+  int idx1, idx2, round, i, j;
 
   if (!b->quiet) {
     printf("Delaunizing segments.\n");
@@ -14526,16 +17972,33 @@ void tetgenmesh::delaunizesegments()
   // Construct a map from points to tetrahedra for speeding point location.
   makepoint2tetmap();
   // Initialize a queue for returning non-Delaunay faces and edges.
-  flipqueue = new queue(sizeof(badface));
-  // 'lastsplit' is the last segment be split in one loop, all segments
-  //   after it are existing. At first, set it be NULL;
-  lastsplit.sh = (shellface *) NULL;
-
-  finish = false;
-  while (!finish) {
-    subsegs->traversalinit();
+  flipqueue = new queue(sizeof(flipitem));
+  // Initialize the worklist of segments to be checked, put all segments
+  //   into it.
+  segqueue = new queue(sizeof(face), (int) subsegs->items + 1);
+  // Initialize the lists of the segments at vertices.
+  segheads = new list((char *) "int", (int) points->items + 1);
+  segrecs = new list(sizeof(segatvertex), NULL, (int) subsegs->items * 2 + 1);
+  subsegs->traversalinit();
+  segloop.sh = shellfacetraverse(subsegs);
+  while (segloop.sh != (shellface *) NULL) {
+    segloop.shver = 0;
+    segqueue->push(&segloop);
+    addsegatvertex(segheads, segrecs, sorg(segloop), segloop.sh);
+    addsegatvertex(segheads, segrecs, sdest(segloop), segloop.sh);
     segloop.sh = shellfacetraverse(subsegs);
-    while (segloop.sh != (shellface *) NULL) {
+  }
+  // Initialize the list of marks of vertices, and the list of the vertices
+  //   marked in a round.
+  ptmarklist = new list((char *) "int", (int) points->items + 1);
+  markedlist = new list((char *) "int", 64);
+  round = 0;
+
+  do {
+    round++;
+    splitcount = insertcount = 0l;
+    while ((pseg = (face *) segqueue->pop()) != (face *) NULL) {
+      segloop = *pseg;
       // Search the segment in DT.
       p1 = sorg(segloop);
       p2 = sdest(segloop);
@@ -14577,29 +18040,75 @@ void tetgenmesh::delaunizesegments()
             setpoint2tet(splitpoint, encode(searchtet));
             // Maintain Delaunayness in DT.
             flip(flipqueue, NULL);
+            // Mark the vertices connected to 'splitpoint'.
+            markstarvertices(splitpoint, &searchtet, ptmarklist, markedlist,
+                             round);
+            insertcount++;
           }
         }
         // Insert 'splitpoint' into F.
         spivot(segloop, splitsh);
         splitsubedge(splitpoint, &splitsh, flipqueue);
         flipsub(flipqueue);
-        // Remember 'segloop'.
-        lastsplit = segloop;
-      } else {
-        // The segment exists.
-        if (segloop.sh == lastsplit.sh) {
-          finish = true;
-          break;
+        // 'segloop' is shrunk to (p1, splitpoint), the new subsegment
+        //   (splitpoint, p2) is bonded to it at their "fake" edges.
+        senext(segloop, newseg);
+        spivotself(newseg);
+        newseg.shver = 0;
+        if ((sorg(newseg) != splitpoint) || (sdest(newseg) != p2)) {
+          // The surface mesh around the segment is not a valid one, which
+          //   happens when facets intersect each other.
+          printf("Error:  Invalid PLC.\n");
+          printf("  Segment (%d, %d) can not be split at point %d,\n",
+                 pointmark(p1), pointmark(p2), pointmark(splitpoint));
+          printf("  some facets may intersect each other.\n");
+          printf("  Hint:  Use -d switch to find all intersecting facets.\n");
+          exit(1);
         }
+        // 'p2' is now an endpoint of 'newseg' instead of 'segloop', and
+        //   'splitpoint' is an endpoint of both.
+        replacesegatvertex(segheads, segrecs, p2, segloop.sh, newseg.sh);
+        addsegatvertex(segheads, segrecs, splitpoint, segloop.sh);
+        addsegatvertex(segheads, segrecs, splitpoint, newseg.sh);
+        // Check both of them later.
+        segqueue->push(&segloop);
+        segqueue->push(&newseg);
+        splitcount++;
       }
-      segloop.sh = shellfacetraverse(subsegs);
     }
-    if (lastsplit.sh == (shellface *) NULL) {
-      // No missing segment!
-      finish = true;
+    if (b->verbose > 1) {
+      printf("  Round %d: %ld segments are split, %ld points are inserted.\n",
+             round, splitcount, insertcount);
+    }
+    // Check again the segments which may be destroyed by the inserted
+    //   points, i.e., both their endpoints are marked in this round.  Each
+    //   one is found at its origin.
+    for (i = 0; i < markedlist->len(); i++) {
+      idx1 = * (int *)(* markedlist)[i];
+      if (idx1 >= segheads->len()) continue;
+      j = * (int *)(* segheads)[idx1];
+      while (j != -1) {
+        rec = (segatvertex *)(* segrecs)[j];
+        segloop.sh = rec->sh;
+        segloop.shver = 0;
+        if (pointmark(sorg(segloop)) - in->firstnumber == idx1) {
+          idx2 = pointmark(sdest(segloop)) - in->firstnumber;
+          if ((idx2 < ptmarklist->len()) &&
+              (* (int *)(* ptmarklist)[idx2] == round)) {
+            segqueue->push(&segloop);
+          }
+        }
+        j = rec->next;
+      }
     }
-  }
+    markedlist->clear();
+  } while (!segqueue->empty());
 
+  delete markedlist;
+  delete segrecs;
+  delete segheads;
+  delete ptmarklist;
+  delete segqueue;
   delete flipqueue;
 }
 
@@ -15391,7 +18900,7 @@ triangulatecavity(list* floorlist, list* ceillist, list* floorptlist,
   }
   
   // Initialize flipqueue;
-  flipqueue = new queue(sizeof(badface));
+  flipqueue = new queue(sizeof(flipitem));
   // Initialize 'frontlink', 'ptlink'.
   frontlink = new link(sizeof(triface), NULL, 256);
   ptlink = new link(sizeof(point), NULL, 256);
@@ -16973,6 +20482,9 @@ void tetgenmesh::carveholes()
 // Points which are not corners of tetrahedra will be inserted into the mesh.//
 // Return the number of faces on the hull after the reconstruction.          //
 //                                                                           //
+// If 'in->handover' is set, the input tetrahedra are freed once they are    //
+// created, before the (larger) maps for the connections are built.          //
+//                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
 long tetgenmesh::reconstructmesh()
@@ -17051,6 +20563,20 @@ long tetgenmesh::reconstructmesh()
     }
   }
 
+  if (in->handover) {
+    // The tetrahedra are handed over.  Free the input copy of them.
+    delete [] in->tetrahedronlist;
+    in->tetrahedronlist = (int *) NULL;
+    if (in->tetrahedronattributelist != (REAL *) NULL) {
+      delete [] in->tetrahedronattributelist;
+      in->tetrahedronattributelist = (REAL *) NULL;
+    }
+    if (in->tetrahedronvolumelist != (REAL *) NULL) {
+      delete [] in->tetrahedronvolumelist;
+      in->tetrahedronvolumelist = (REAL *) NULL;
+    }
+  }
+
   // Set the connection between tetrahedra.
   hullsize = 0l;
   // Create a map from nodes to tetrahedra.
@@ -17483,7 +21009,7 @@ void tetgenmesh::insertaddpoints()
     printf("Insert additional points into mesh.\n");
   }
   // Initialize 'flipqueue'.
-  flipqueue = new queue(sizeof(badface));
+  flipqueue = new queue(sizeof(flipitem));
   recenttet.tet = dummytet;
 
   index = 0;
@@ -17842,7 +21368,7 @@ void tetgenmesh::removeilltets()
   flipstackers = new memorypool(sizeof(flipstacker), FLIPSTACKERPERBLOCK,
                                 POINTER, 0);
   // Initialize 'flipqueue'.
-  flipqueue = new queue(sizeof(badface));  
+  flipqueue = new queue(sizeof(flipitem));  
 
   // Test all tetrahedra to see if they're slivers.
   tallilltets();
@@ -18221,6 +21747,138 @@ void tetgenmesh::tallencsubs()
   }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// checkstar4encroach()    Check the segments and subfaces on the cavity of  //
+//                         a newly inserted point for encroachment.          //
+//                                                                           //
+// After 'newpoint' is inserted and the flips are done, the new tetrahedra   //
+// are exactly the ones sharing 'newpoint'.  A segment (or subface) is only  //
+// tested against the apexes of the tetrahedra containing it, so only the    //
+// ones on the faces of these tetrahedra may change their states.  Each of   //
+// them is tested once (segments sharing 'newpoint' are not, they're tested  //
+// by the caller), the encroached ones are queued.  All the rest of the mesh //
+// is left untouched.                                                        //
+//                                                                           //
+// 'searchtet' is a handle near to 'newpoint'.  'cavtetlist' is used for     //
+// collecting the tetrahedra (by collectstartets()), it is empty on input,   //
+// and is cleared on return.                                                 //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::checkstar4encroach(point newpoint, triface* searchtet,
+                                   list* cavtetlist)
+{
+  triface starttet, linkface, neightet;
+  face checkseg, checksh;
+  int i, j;
+
+  collectstartets(newpoint, searchtet, cavtetlist);
+
+  for (i = 0; i < cavtetlist->len(); i++) {
+    starttet = * (triface *)(* cavtetlist)[i];
+    infect(starttet); // Indicate it has been tested.
+    // Get the face opposite to 'newpoint'.
+    linkface.tet = starttet.tet;
+    linkface.ver = 0;
+    for (linkface.loc = 0; linkface.loc < 4; linkface.loc++) {
+      if ((org(linkface) != newpoint) && (dest(linkface) != newpoint) &&
+          (apex(linkface) != newpoint)) break;
+    }
+    assert(linkface.loc < 4);
+    // Make the next faces (by fnext()) be in this tetrahedron.
+    adjustedgering(linkface, CCW);
+    if (encsubfaces != (memorypool *) NULL) {
+      tspivot(linkface, checksh);
+      if (checksh.sh != dummysh) {
+        doencchecktest(&checksh);
+      }
+    }
+    // Test the edges of linkface and the faces sharing them and 'newpoint'
+    //   which are not tested yet, i.e., the other tetrahedron sharing the
+    //   face is not tested.
+    for (j = 0; j < 3; j++) {
+      fnext(linkface, neightet);
+      if (encsubfaces != (memorypool *) NULL) {
+        tspivot(neightet, checksh);
+      } else {
+        checksh.sh = dummysh;
+      }
+      symself(neightet);
+      if ((neightet.tet == dummytet) || !infected(neightet)) {
+        if (checksh.sh != dummysh) {
+          doencchecktest(&checksh);
+        }
+        tsspivot(&linkface, &checkseg);
+        if ((checkseg.sh != dummysh) && !sub2badface(checkseg)) {
+          checkseg4encroach(&checkseg, NULL, true);
+        }
+      }
+      enextself(linkface);
+    }
+  }
+
+  // Uninfect all tetrahedra in the list.
+  for (i = 0; i < cavtetlist->len(); i++) {
+    starttet = * (triface *)(* cavtetlist)[i];
+    uninfect(starttet);
+  }
+  cavtetlist->clear();
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// wallclockseconds()    Return the wall-clock time in seconds.              //
+//                                                                           //
+// The time is read from the monotonic clock, which is not changed when the  //
+// system time is set.  Only the differences of the returned values are      //
+// meaningful.  If there is no monotonic clock, gettimeofday() is used.      //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+REAL tetgenmesh::wallclockseconds()
+{
+  struct timeval tv;
+#ifdef CLOCK_MONOTONIC
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+    return (REAL) ts.tv_sec + (REAL) ts.tv_nsec * 1.0e-9;
+  }
+#endif
+  gettimeofday(&tv, (struct timezone *) NULL);
+  return (REAL) tv.tv_sec + (REAL) tv.tv_usec * 1.0e-6;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// checkrefinebudget()    Check if the budget of refinement is used up.      //
+//                                                                           //
+// The budget is the number of Steiner points ('-S' switch) and the seconds  //
+// ('-w' switch) of the quality stage.  Once it is used up, 'refinestopped'  //
+// is set, the refinement stops and the remaining encroached subsegments and //
+// subfaces are left in the mesh.  Return true if it is used up.  The        //
+// seconds are wall-clock ones (see wallclockseconds()), so they do not run  //
+// faster with '-t'.                                                         //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+bool tetgenmesh::checkrefinebudget()
+{
+  if (!refinestopped) {
+    if ((b->steiner >= 0) && (points->items - refinepoints >= b->steiner)) {
+      refinestopped = 1;
+    } else if ((b->maxtime > 0.0) &&
+               (wallclockseconds() - refinestart >= b->maxtime)) {
+      refinestopped = 1;
+    }
+    if (refinestopped && b->verbose) {
+      printf("  Refinement budget is used up.\n");
+    }
+  }
+  return refinestopped != 0;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // splitencsegs()    Split all the encroached segments.                      //
@@ -18231,7 +21889,7 @@ void tetgenmesh::tallencsubs()
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
-void tetgenmesh::splitencsegs(queue* flipqueue)
+void tetgenmesh::splitencsegs(queue* flipqueue, list* cavtetlist)
 {
   badface *encloop;
   triface starttet;
@@ -18247,10 +21905,10 @@ void tetgenmesh::splitencsegs(queue* flipqueue)
   }
 
   // Loop until the list 'encsubsegs' is empty.
-  while (encsubsegs->items > 0) {
+  while ((encsubsegs->items > 0) && !checkrefinebudget()) {
     encsubsegs->traversalinit();
     encloop = badfacetraverse(encsubsegs);
-    while (encloop != (badface *) NULL) {
+    while ((encloop != (badface *) NULL) && !checkrefinebudget()) {
       splitseg = encloop->ss;
       // Every splitseg has a pointer to encloop, now clear it.
       assert(sub2badface(splitseg) == encloop);
@@ -18326,10 +21984,11 @@ void tetgenmesh::splitencsegs(queue* flipqueue)
       splitseg.shver = 0;
       checkseg4encroach(&splitseg, NULL, true);
 
-      // Recover Delaunay property by flipping. All existing segments which
-      //   are encroached by the new point will be discovered during flips
-      //   and be queued in list.
+      // Recover Delaunay property by flipping.
       flip(flipqueue, NULL);
+      // Queue the existing segments (and subfaces) which are encroached by
+      //   the new point, they're on the faces of the new tetrahedra.
+      checkstar4encroach(newpoint, &starttet, cavtetlist);
       
       // Remove this entry from list.
       badfacedealloc(encsubsegs, encloop);  
@@ -18900,6 +22559,7 @@ bool tetgenmesh::checksub4encroach(face* testsub, point testpt, bool enqflag)
     encsub->fdest = sdest(*testsub);
     encsub->fapex = sapex(*testsub);
     for (i = 0; i < 3; i++) encsub->cent[i] = cent[i];
+    encsub->key = radius;
     // Put encsub into the appropriate queue.
     quenumber = (int) ety;    
     if (b->verbose > 2) {
@@ -18909,25 +22569,177 @@ bool tetgenmesh::checksub4encroach(face* testsub, point testpt, bool enqflag)
     }
     // Let the subface remember the encsub.
     setsub2badface(encsub->ss, encsub);
-    // Queue elements are double-linked.
-    encsub->prevface = (badface *) NULL;
-    encsub->nextface = (badface *) NULL;
-    // Add the element to the end of a queue.
-    if (subquetail[quenumber] == (badface *) NULL) {
-      // This queue is empty.  It is the only element in the link.
-      subquefront[quenumber] = subquetail[quenumber] = encsub;
-    } else {
-      // Add it at the end of the queue.
-      assert(subquetail[quenumber]->nextface == (badface *) NULL);
-      subquetail[quenumber]->nextface = encsub;
-      encsub->prevface = subquetail[quenumber];
-      subquetail[quenumber] = encsub;
-    }
+    enqueueencsub(encsub, quenumber);
   }
 
   return enq;
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// enqueueencsub()    Add an encroached subface into a queue.                //
+//                                                                           //
+// 'quenumber' is the queue (the type of the subface).  By default, it is    //
+// added at the end of the queue.  If '-R' switch is used, it is added into  //
+// the heap (by its 'key', the circumradius of the subface).                 //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::enqueueencsub(badface* encsub, int quenumber)
+{
+  list *heap;
+  badface *parentsub;
+  int i, parent;
+
+  heap = subqueheap[quenumber];
+  if (heap != (list *) NULL) {
+    // Append it, then move it up until its parent is not smaller.
+    i = heap->len();
+    heap->append(&encsub);
+    while (i > 0) {
+      parent = (i - 1) / 2;
+      parentsub = * (badface **)(* heap)[parent];
+      if (parentsub->key >= encsub->key) break;
+      * (badface **)(* heap)[i] = parentsub;
+      parentsub->heapidx = i;
+      i = parent;
+    }
+    * (badface **)(* heap)[i] = encsub;
+    encsub->heapidx = i;
+    return;
+  }
+
+  // Queue elements are double-linked.
+  encsub->prevface = (badface *) NULL;
+  encsub->nextface = (badface *) NULL;
+  // Add the element to the end of a queue.
+  if (subquetail[quenumber] == (badface *) NULL) {
+    // This queue is empty.  It is the only element in the link.
+    subquefront[quenumber] = subquetail[quenumber] = encsub;
+  } else {
+    // Add it at the end of the queue.
+    assert(subquetail[quenumber]->nextface == (badface *) NULL);
+    subquetail[quenumber]->nextface = encsub;
+    encsub->prevface = subquetail[quenumber];
+    subquetail[quenumber] = encsub;
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// dequeueencsub()    Get and remove the next encroached subface.            //
+//                                                                           //
+// It is taken from the nonempty queue with the highest priority.  It is the //
+// first one in the queue, or the largest one if '-R' switch is used.  The   //
+// queue is returned in 'quenumber'.  Return NULL if all queues are empty.   //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+tetgenmesh::badface* tetgenmesh::dequeueencsub(int* quenumber)
+{
+  badface *encsub;
+
+  for (*quenumber = 0; *quenumber < 6; (*quenumber)++) {
+    if (subqueheap[*quenumber] != (list *) NULL) {
+      if (subqueheap[*quenumber]->len() > 0) {
+        encsub = * (badface **)(* subqueheap[*quenumber])[0];
+        removeencsub(encsub);
+        return encsub;
+      }
+    } else if (subquefront[*quenumber] != (badface *) NULL) {
+      encsub = subquefront[*quenumber];
+      removeencsub(encsub);
+      return encsub;
+    }
+  }
+  return (badface *) NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// removeencsub()    Remove an encroached subface from its queue.            //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::removeencsub(badface* encsub)
+{
+  list *heap;
+  badface *prevnode, *sucnode, *lastsub, *childsub;
+  int quenumber;
+  int i, child, last;
+
+  if (subqueheap[0] != (list *) NULL) {
+    // Find the heap containing it.
+    for (quenumber = 0; quenumber < 6; quenumber++) {
+      heap = subqueheap[quenumber];
+      if ((encsub->heapidx < heap->len()) &&
+          (* (badface **)(* heap)[encsub->heapidx] == encsub)) break;
+    }
+    assert(quenumber < 6);
+    // Replace it by the last one.
+    last = heap->len() - 1;
+    lastsub = * (badface **)(* heap)[last];
+    heap->del(last);
+    if (lastsub == encsub) return;
+    i = encsub->heapidx;
+    // Move lastsub up if it is larger than its parent.
+    while ((i > 0) &&
+           ((* (badface **)(* heap)[(i - 1) / 2])->key < lastsub->key)) {
+      childsub = * (badface **)(* heap)[(i - 1) / 2];
+      * (badface **)(* heap)[i] = childsub;
+      childsub->heapidx = i;
+      i = (i - 1) / 2;
+    }
+    // Move it down if it is smaller than one of its children.
+    while ((child = 2 * i + 1) < last) {
+      if ((child + 1 < last) && ((* (badface **)(* heap)[child + 1])->key >
+                                 (* (badface **)(* heap)[child])->key)) {
+        child++;
+      }
+      childsub = * (badface **)(* heap)[child];
+      if (childsub->key <= lastsub->key) break;
+      * (badface **)(* heap)[i] = childsub;
+      childsub->heapidx = i;
+      i = child;
+    }
+    * (badface **)(* heap)[i] = lastsub;
+    lastsub->heapidx = i;
+    return;
+  }
+
+  if (encsub->prevface == (badface *) NULL) {
+    // This is the first element of a queue. Find the quenumber.
+    for (quenumber = 0; quenumber < 6; quenumber++) {
+      if (subquefront[quenumber] == encsub) break;
+    }
+    assert(quenumber < 6);
+    sucnode = encsub->nextface;
+    if (sucnode == (badface *) NULL) {
+      // It is the only node in the queue. Empty the queue.
+      subquefront[quenumber] = subquetail[quenumber] = (badface *) NULL;
+    } else {
+      subquefront[quenumber] = sucnode;
+      sucnode->prevface = (badface *) NULL;
+    }
+  } else {
+    // It is not the first element. (Note, it may be the last one!)
+    prevnode = encsub->prevface;
+    sucnode = encsub->nextface;
+    prevnode->nextface = sucnode;
+    if (sucnode == (badface *) NULL) {
+      // This is the last node, update the pointer in subquetail[].
+      for (quenumber = 0; quenumber < 6; quenumber++) {
+        if (subquetail[quenumber] == encsub) break;
+      }
+      assert(quenumber < 6);
+      subquetail[quenumber] = prevnode;
+    } else {
+      // It is not the last node.
+      sucnode->prevface = prevnode;
+    } 
+  }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // doencchecktest()    Check if we need to do encroach test on 'testsub'.    //
@@ -18936,8 +22748,7 @@ bool tetgenmesh::checksub4encroach(face* testsub, point testpt, bool enqflag)
 
 void tetgenmesh::doencchecktest(face* testsub)
 {
-  badface *bface, *prevnode, *sucnode;
-  int quenumber;
+  badface *bface;
 
   // Is testsub in the queue?
   bface = sub2badface(*testsub);
@@ -18950,37 +22761,7 @@ void tetgenmesh::doencchecktest(face* testsub)
                (unsigned long) bface, pointmark(bface->forg),
                pointmark(bface->fdest), pointmark(bface->fapex));
       }
-      if (bface->prevface == (badface *) NULL) {
-        // This is the first element of a queue. Find the quenumber.
-        for (quenumber = 0; quenumber < 6; quenumber++) {
-          if (subquefront[quenumber] == bface) break;
-        }
-        assert(quenumber < 6);
-        sucnode = bface->nextface;
-        if (sucnode == (badface *) NULL) {
-          // It is the only node in the queue. Empty the queue.
-          subquefront[quenumber] = subquetail[quenumber] = (badface *) NULL;
-        } else {
-          subquefront[quenumber] = sucnode;
-          sucnode->prevface = (badface *) NULL;
-        }
-      } else {
-        // It is not the first element. (Note, it may be the last one!)
-        prevnode = bface->prevface;
-        sucnode = bface->nextface;
-        prevnode->nextface = sucnode;
-        if (sucnode == (badface *) NULL) {
-          // This is the last node, update the pointer in subquetail[].
-          for (quenumber = 0; quenumber < 6; quenumber++) {
-            if (subquetail[quenumber] == bface) break;
-          }
-          assert(quenumber < 6);
-          subquetail[quenumber] = prevnode;
-        } else {
-          // It is not the last node.
-          sucnode->prevface = prevnode;
-        } 
-      }
+      removeencsub(bface);
       // Clear the pointer in testsub.
       setsub2badface(*testsub, NULL);
       // Remove this badface from list.
@@ -18999,10 +22780,20 @@ void tetgenmesh::doencchecktest(face* testsub)
 //                                                                           //
 // calctynavnss()    Get the splitting point of an encroached subface.       //
 //                                                                           //
+// It is the circumcenter of the subface.  If '-u' switch is used, it is the //
+// off-center instead, if it is closer to the shortest edge ab.  It is the   //
+// point c on the bisector of ab such that the radius-edge ratio of abc is   //
+// just 'b->minratio'.  Off-centers create less Steiner points.              //
+//                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
 void tetgenmesh::calctynavnss(badface* bface, point newpoint)
 {
+  point pa, pb;
+  REAL mid[3], dir[3];
+  REAL minlen, len, dist, rad, offdist;
+  int i;
+
   if (b->verbose > 2) {
     printf("    NAVNSHARPS: (%d, %d, %d).\n", pointmark(bface->forg),
            pointmark(bface->fdest), pointmark(bface->fapex));
@@ -19013,6 +22804,44 @@ void tetgenmesh::calctynavnss(badface* bface, point newpoint)
   newpoint[2] = bface->cent[2];
   // There is no parent point available.
   setpoint2ppt(newpoint, NULL);
+
+  if (b->offcenter) {
+    // Let ab be the shortest edge of the subface.
+    pa = bface->forg;
+    pb = bface->fdest;
+    minlen = distance(pa, pb);
+    len = distance(bface->fdest, bface->fapex);
+    if (len < minlen) {
+      pa = bface->fdest;
+      pb = bface->fapex;
+      minlen = len;
+    }
+    len = distance(bface->fapex, bface->forg);
+    if (len < minlen) {
+      pa = bface->fapex;
+      pb = bface->forg;
+      minlen = len;
+    }
+    // The off-center c lies on the bisector of ab, between the midpoint
+    //   of ab and the circumcenter. The circumradius of abc is 'minratio'
+    //   times |ab|.  Use c if it is closer to ab than the circumcenter.
+    for (i = 0; i < 3; i++) {
+      mid[i] = 0.5 * (pa[i] + pb[i]);
+      dir[i] = bface->cent[i] - mid[i];
+    }
+    dist = sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+    rad = b->minratio * minlen;
+    if (rad > 0.5 * minlen) {
+      offdist = rad + sqrt(rad * rad - 0.25 * minlen * minlen);
+      if (offdist < dist) {
+        if (b->verbose > 2) {
+          printf("    Off-center at %g of the distance to circumcenter.\n",
+                 offdist / dist);
+        }
+        for (i = 0; i < 3; i++) newpoint[i] = mid[i] + offdist / dist * dir[i];
+      }
+    }
+  }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -19284,32 +23113,759 @@ void tetgenmesh::calctynavsharps(badface* bface, point newpoint)
       pc = sdest(rseg);
       rpc = rpcr;
     } else {
-      pb = sorg(lseg);
-      pc = sdest(lseg);
-      rpc = rpcl;
+      pb = sorg(lseg);
+      pc = sdest(lseg);
+      rpc = rpcl;
+    }
+  } else if (rsharp) {
+    pb = sorg(rseg);
+    pc = sdest(rseg);
+    rpc = rpcr;
+  } else {
+    assert(lsharp);
+    pb = sorg(lseg);
+    pc = sdest(lseg);
+    rpc = rpcl;
+  }
+
+  if (b->verbose > 2) {
+    printf("    NAVSHARPS: (%d, %d, %d) rpc = %d.\n", pointmark(bface->forg),
+           pointmark(bface->fdest), pointmark(bface->fapex), rpc);
+  }
+
+  edgeorthonormal(pb, pc, bface->fdest, orthonorm);
+  for (i = 0; i < 3; i++) newpoint[i] = pa[i] + rpc * orthonorm[i];
+  // a is the parent point of newpoint.
+  setpoint2ppt(newpoint, pa);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// calcsubsplitpoint()    Calculate the point for splitting an encroached    //
+//                        subface.                                           //
+//                                                                           //
+// 'encsub' is an encroached subface, 'quenumber' is its type.  Calculate a  //
+// point at or near the circumcenter of 'encsub' according to its type, and  //
+// save it in 'newpoint'.  Only the coordinates, attributes and the parent   //
+// point of 'newpoint' are set, it may be not a point of 'points'.           //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::calcsubsplitpoint(badface* encsub, int quenumber,
+  point newpoint)
+{
+  enum encsubtype ety;
+  int i;
+
+  // Initialize this field.
+  setpoint2ppt(newpoint, NULL);
+  // 'quenumber' implies the type of the encsub.
+  ety = (enum encsubtype) quenumber;
+  switch (ety) {
+  case ACUTEVSHARPS:
+    calctyacutevsharps(encsub, newpoint);
+    break;
+  case ACUTEV:
+    calctyacutev(encsub, newpoint);
+    break;
+  case SHARPS:
+    calctysharps(encsub, newpoint);
+    break;
+  case FSVSHARPS:
+    calctyfsvsharps(encsub, newpoint);
+    break;
+  case NAVSHARPS:
+    calctynavsharps(encsub, newpoint);
+    break;
+  default: // NAVNSHARPS
+    calctynavnss(encsub, newpoint);
+  }
+  // Not interpolate its attributes.
+  for (i = 0; i < in->numberofpointattributes; i++) newpoint[i + 3] = 0.0;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// getsubsplitpoint()    Create the point for splitting an encroached        //
+//                       subface.                                            //
+//                                                                           //
+// The point is calculated by calcsubsplitpoint().  It is a FREESUBVERTEX,   //
+// but it is not inserted into the mesh yet.                                 //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+tetgenmesh::point tetgenmesh::getsubsplitpoint(badface* encsub, int quenumber)
+{
+  point newpoint;
+  int ptidx;
+
+  newpoint = (point) points->alloc();
+  calcsubsplitpoint(encsub, quenumber, newpoint);
+  // Set the unique index of the new point
+  ptidx = (int) points->items - (in->firstnumber == 1 ? 0 : 1);
+  setpointmark(newpoint, ptidx);
+  // Set the type of the new point.
+  setpointtype(newpoint, FREESUBVERTEX);
+
+  return newpoint;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// insertsubsplitpoint()    Insert the splitting point of an encroached      //
+//                          subface into the mesh.                           //
+//                                                                           //
+// 'splitsub' is the encroached subface, 'starttet' is a tetrahedron which   //
+// has 'splitsub' as a face.  'newpoint' does not encroach upon any segment. //
+// It is located on the facet of 'splitsub' and inserted by splitting a face //
+// or an edge.  Then the Delaunay property is recovered by flips, and the    //
+// subsegments and subfaces encroached by the new point are repaired.        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::insertsubsplitpoint(face* splitsub, point newpoint,
+  triface* starttet, queue* flipqueue, list* cavtetlist)
+{
+  face neisplitsub;
+  face checksh, checkseg;
+  point checkpt;
+  point pa, pb;
+  enum locateresult loc;
+  REAL epspp;
+
+  // Remove the encroached subface by inserting the newpoint.
+  loc = locatesub(newpoint, splitsub, oppo(*starttet));
+  stpivot(*splitsub, *starttet);
+  if (starttet->tet == dummytet) {
+    sesymself(*splitsub);
+    stpivot(*splitsub, *starttet);
+  }
+  assert(starttet->tet != dummytet);
+  if (loc != ONVERTEX) {
+    // Adjust the location of newpoint wrt. starttet.
+    epspp = b->epsilon;
+    while (1) {
+      loc = adjustlocate(newpoint, starttet, ONFACE, epspp);
+      if (loc == ONVERTEX) {
+        checkpt = org(*starttet);
+        if ((newpoint[0] != checkpt[0]) || (newpoint[1] != checkpt[1])
+            || (newpoint[2] != checkpt[2])) {
+          epspp *= 1e-2;
+          continue;
+        }
+      }
+      break;
+    }
+  }
+  pa = org(*starttet);
+  pb = dest(*starttet);
+  findedge(splitsub, pa, pb);
+
+  // Let splitsub be face abc.  ab is the current edge.
+  if (loc == ONFACE) {
+    // Split the face abc into three faces abv, bcv, cav. 
+    splittetface(newpoint, starttet, flipqueue);
+    // Adjust splitsub be abv.
+    findedge(splitsub, pa, pb);
+    assert(sapex(*splitsub) == newpoint);
+    // Check the three new subfaces to see if they're encroached.
+    //   splitsub may be queued (it exists before split).
+    checksh = *splitsub;
+    doencchecktest(&checksh); // abv;
+    senext(*splitsub, checksh);
+    spivotself(checksh);
+    // It is a new created face and should not be infected.
+    assert(checksh.sh != dummysh && !sub2badface(checksh));
+    checksub4encroach(&checksh, NULL, true); // bcv
+    senext2(*splitsub, checksh);
+    spivotself(checksh);
+    // It is a new created face and should not be infected.
+    assert(checksh.sh != dummysh && !sub2badface(checksh));
+    checksub4encroach(&checksh, NULL, true); // cav
+  } else if (loc == ONEDGE) {
+    // Let the adjacent subface be bad.  ab is the spliting edge.
+    //   Split two faces abc, bad into 4 faces avc, vbc, avd, vbd.
+    sspivot(*splitsub, checkseg);
+    assert(checkseg.sh == dummysh);
+    // Remember the neighbor subface abd (going to be split also).
+    spivot(*splitsub, neisplitsub);
+    findedge(&neisplitsub, pa, pb);
+    // Split two faces abc, abd into four faces avc, vbc, avd, vbd.
+    splittetedge(newpoint, starttet, flipqueue);
+    // Adjust splitsub be avc, neisplitsub be avd.
+    findedge(splitsub, pa, newpoint);
+    findedge(&neisplitsub, pa, newpoint);
+    // Check the four new subfaces to see if they're encroached.
+    //   splitsub may be an infected one (it exists before split).
+    checksh = *splitsub;
+    doencchecktest(&checksh); // avc
+    //   Get vbc.
+    senext(*splitsub, checksh);
+    spivotself(checksh);
+    //   vbc is newly created.
+    assert(checksh.sh != dummysh && !sub2badface(checksh));
+    checksub4encroach(&checksh, NULL, true); // vbc
+    //   neisplitsub may be an infected one (it exists before split).
+    checksh = neisplitsub;
+    doencchecktest(&checksh); // avd
+    //   Get vbd.
+    senext(neisplitsub, checksh);
+    spivotself(checksh);
+    //   vbd is newly created.
+    assert(checksh.sh != dummysh && !sub2badface(checksh));
+    checksub4encroach(&checksh, NULL, true); // vbd
+  } else {
+    printf("Internal error in splitencsub():  Point %d locates %s.\n",
+      pointmark(newpoint), loc == ONVERTEX ? "on vertex" : "outside");
+    internalerror();
+  }
+
+  // Recover Delaunay property by flipping.
+  flip(flipqueue, NULL);
+  // Queue the existing subfaces which are encroached by the new
+  //   point, they're on the faces of the new tetrahedra.
+  checkstar4encroach(newpoint, starttet, cavtetlist);
+  if (encsubsegs->items > 0) {
+    // Segments encroached by the other vertices of the new
+    //   tetrahedra. Repair them.
+    splitencsegs(flipqueue, cavtetlist);
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// markroundtets()    Mark the tets of a cavity as changed in this round.    //
+//                                                                           //
+// In a round of splitencsubsparallel(), the tets in 'cavtetlist' are put    //
+// into the hash table 'roundtets'.  The table is doubled once it is half    //
+// full.                                                                     //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::markroundtets(list* cavtetlist)
+{
+  tetrahedron **oldtets;
+  tetrahedron *tptr;
+  unsigned long mask, slot, newslot;
+  int oldsize, i;
+
+  for (i = 0; i < cavtetlist->len(); i++) {
+    tptr = ((triface *)(* cavtetlist)[i])->tet;
+    if (2 * (roundtetcount + 1) > roundtetsize) {
+      // Enlarge the table and rehash the marked tets.
+      oldtets = roundtets;
+      oldsize = roundtetsize;
+      roundtetsize *= 2;
+      roundtets = new tetrahedron*[roundtetsize];
+      for (slot = 0; slot < (unsigned long) roundtetsize; slot++) {
+        roundtets[slot] = (tetrahedron *) NULL;
+      }
+      mask = (unsigned long) roundtetsize - 1;
+      for (slot = 0; slot < (unsigned long) oldsize; slot++) {
+        if (oldtets[slot] != (tetrahedron *) NULL) {
+          newslot = (((unsigned long) oldtets[slot] >> 4) * 2654435761ul)
+            & mask;
+          while (roundtets[newslot] != (tetrahedron *) NULL) {
+            newslot = (newslot + 1) & mask;
+          }
+          roundtets[newslot] = oldtets[slot];
+        }
+      }
+      delete [] oldtets;
+    }
+    mask = (unsigned long) roundtetsize - 1;
+    slot = (((unsigned long) tptr >> 4) * 2654435761ul) & mask;
+    while ((roundtets[slot] != (tetrahedron *) NULL) &&
+           (roundtets[slot] != tptr)) {
+      slot = (slot + 1) & mask;
+    }
+    if (roundtets[slot] == (tetrahedron *) NULL) {
+      roundtets[slot] = tptr;
+      roundtetcount++;
+    }
+  }
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// roundtetsmarked()    Check if a cavity has been changed in this round.    //
+//                                                                           //
+// Return true if a tet in 'cavtetlist' or a neighbor of it is in the table  //
+// 'roundtets' (see markroundtets()).  A cavity is changed if one of its tets//
+// is deleted, and it may grow if one of its neighbors is replaced.          //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+bool tetgenmesh::roundtetsmarked(list* cavtetlist)
+{
+  triface cavtet, neightet;
+  tetrahedron *tptr;
+  unsigned long mask, slot;
+  int i, j;
+
+  mask = (unsigned long) roundtetsize - 1;
+  for (i = 0; i < cavtetlist->len(); i++) {
+    cavtet = * (triface *)(* cavtetlist)[i];
+    for (j = 0; j < 5; j++) {
+      if (j < 4) {
+        cavtet.loc = j;
+        sym(cavtet, neightet);
+        tptr = neightet.tet;
+        if (tptr == dummytet) continue;
+      } else {
+        tptr = cavtet.tet;
+      }
+      slot = (((unsigned long) tptr >> 4) * 2654435761ul) & mask;
+      while (roundtets[slot] != (tetrahedron *) NULL) {
+        if (roundtets[slot] == tptr) return true;
+        slot = (slot + 1) & mask;
+      }
+    }
+  }
+  return false;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// splitencsub()    Split an encroached subface.                             //
+//                                                                           //
+// 'encsub' has been taken out of the queue of type 'quenumber'.  If the new //
+// point encroaches upon some subsegments, it is not inserted.  Instead, the //
+// encsub is put back into the queue, and the encroached subsegments are     //
+// split.  'encsub' is deleted unless it is put back.                        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::splitencsub(badface* encsub, int quenumber,
+  queue* flipqueue, list* cavtetlist)
+{
+  triface starttet;
+  face splitsub;
+  point newpoint;
+  bool enq, reject;
+
+  // Clear the pointer saved in encsub->ss. 
+  splitsub = encsub->ss;
+  setsub2badface(splitsub, NULL);
+  // The subface may be not the same one when it was determined to be
+  //   encroached.  If its adjacent encroached subface was split, the
+  //   consequent flips may change it into another subface.
+  enq = ((sorg(splitsub) == encsub->forg) &&
+         (sdest(splitsub) == encsub->fdest) &&
+         (sapex(splitsub) == encsub->fapex));
+  reject = false;
+  if (enq) {
+    // This subface is encroached, it should be split. Calculate a point
+    //   at or near the circumcenter of this subface.
+    newpoint = getsubsplitpoint(encsub, quenumber);
+
+    // Look if the newpoint encroaches upon some segments.
+    stpivot(splitsub, starttet);
+    if (starttet.tet == dummytet) {
+      sesymself(splitsub);
+      stpivot(splitsub, starttet);
+    }
+    assert(starttet.tet != dummytet);
+    recenttet = starttet;  // Used for the input of preciselocate().
+    collectcavtets(newpoint, cavtetlist);
+    assert(cavtetlist->len() > 0);
+    if (roundtets != (tetrahedron **) NULL) {
+      // In a parallel round, the cavity may be changed.
+      markroundtets(cavtetlist);
+    }
+    // Find encroaching segments from cavtetlist.
+    tallencsegs(newpoint, cavtetlist);
+    // Clear the list for the next use.
+    cavtetlist->clear();
+    reject = (encsubsegs->items > 0);
+    if (!reject) {
+      insertsubsplitpoint(&splitsub, newpoint, &starttet, flipqueue,
+                          cavtetlist);
+    } else {
+      // 'newpoint' is rejected.  Delete it.
+      pointdealloc(newpoint);
+
+      // Put 'encsub' back into the queue.
+      if (b->verbose > 2) {
+        printf("    Requeuing encsub x%lx.\n", (unsigned long) encsub);
+      }
+      setsub2badface(encsub->ss, encsub);
+      enqueueencsub(encsub, quenumber);
+
+      // Repair all the encroached segments.
+      splitencsegs(flipqueue, cavtetlist);
+    }
+  } else {
+    // It is changed. It may still be encroached.
+    checksub4encroach(&splitsub, NULL, true);
+  }
+
+  if (!enq || (enq && !reject)) {
+    // Remove this entry from list.
+    badfacedealloc(encsubfaces, encsub);
+  }
+}
+
+#ifdef PTHREADS
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// checkcav4encroach()    Collect the cavity of a point and check if the     //
+//                        point encroaches upon the segments of it.          //
+//                                                                           //
+// It is the same as collectcavtets() followed by tallencsegs(), except that //
+// it does not change the mesh:  the tets are not infected (the list itself  //
+// is searched instead), and the encroached segments are not queued.  So it  //
+// can be called by several threads at the same time.  'searchtet' is a tet  //
+// close to 'newpoint'.  Return true if a segment is encroached.             //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+bool tetgenmesh::checkcav4encroach(point newpoint, triface* searchtet,
+  list* cavtetlist)
+{
+  triface starttet, neightet, *cavtet;
+  face checkseg;
+  list *edgelist;
+  point edge[2], *tested;
+  REAL sign;
+  bool found, enc;
+  int i, j, k;
+
+  enc = false;
+  starttet = *searchtet;
+  preciselocate(newpoint, &starttet);
+  cavtetlist->append(&starttet);
+  sym(starttet, neightet);
+  if (neightet.tet != dummytet) {
+    adjustedgering(neightet, CW);
+    sign = insphere(org(neightet), dest(neightet), apex(neightet),
+                    oppo(neightet), newpoint);
+    if (sign >= 0.0) {
+      cavtetlist->append(&neightet);
+    }
+  }
+
+  for (i = 0; i < cavtetlist->len(); i++) {
+    starttet = * (triface *)(* cavtetlist)[i];
+    adjustedgering(starttet, CCW);
+    for (j = 0; j < 3; j++) {
+      fnext(starttet, neightet);
+      symself(neightet);
+      if (neightet.tet != dummytet) {
+        // Is it in the list already?
+        found = false;
+        for (k = 0; k < cavtetlist->len() && !found; k++) {
+          cavtet = (triface *)(* cavtetlist)[k];
+          found = (cavtet->tet == neightet.tet);
+        }
+        if (!found) {
+          adjustedgering(neightet, CW);
+          sign = insphere(org(neightet), dest(neightet), apex(neightet),
+                          oppo(neightet), newpoint);
+          if (sign >= 0.0) {
+            cavtetlist->append(&neightet);
+          }
+        }
+      }
+      enextself(starttet);
+    }
+  }
+
+  // Check the segments at the edges of the cavity. Since there is no
+  //   queued segment, it is no need to skip any of them.  The edges of
+  //   the four faces of a tet are visited.  An edge is in two faces and
+  //   shared by several tets, remember the tested ones in 'edgelist'.
+  edgelist = new list(sizeof(point) * 2, NULL, 256);
+  for (i = 0; i < cavtetlist->len() && !enc; i++) {
+    starttet = * (triface *)(* cavtetlist)[i];
+    for (starttet.loc = 0; starttet.loc < 4 && !enc; starttet.loc++) {
+      adjustedgering(starttet, CCW);
+      for (j = 0; j < 3 && !enc; j++) {
+        edge[0] = org(starttet);
+        edge[1] = dest(starttet);
+        if (edge[0] > edge[1]) {
+          edge[0] = edge[1];
+          edge[1] = org(starttet);
+        }
+        found = false;
+        for (k = 0; k < edgelist->len() && !found; k++) {
+          tested = (point *)(* edgelist)[k];
+          found = ((tested[0] == edge[0]) && (tested[1] == edge[1]));
+        }
+        if (!found) {
+          edgelist->append(edge);
+          tsspivot(&starttet, &checkseg);
+          if (checkseg.sh != dummysh) {
+            enc = checkseg4encroach(&checkseg, newpoint, false);
+          }
+        }
+        enextself(starttet);
+      }
+    }
+  }
+  delete edgelist;
+  return enc;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// splitencsubsthread()    Check a part of the candidates of a round of the  //
+//                         parallel splitting of encroached subfaces.        //
+//                                                                           //
+// 'arg' is a pointer to a 'cavitythread'.                                   //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void* tetgenmesh::splitencsubsthread(void* arg)
+{
+  cavitythread *ct;
+  int i;
+
+  ct = (cavitythread *) arg;
+  for (i = ct->firstone; i < ct->number; i += ct->step) {
+    ct->rejects[i] = ct->mesh->checkcav4encroach(ct->newpoints[i],
+      &(ct->starttets[i]), ct->cavtetlists[i]) ? 1 : 0;
+  }
+  return (void *) NULL;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// splitencsubsparallel()    Do a round of splitting encroached subfaces     //
+//                           with 'b->numthreads' threads.                   //
+//                                                                           //
+// A round plans a batch of encsubs and then splits them as splitencsubs()   //
+// does without threads, so the mesh is exactly the same as without '-t'.    //
+//                                                                           //
+// The batch is taken from the queue which is dequeued next (its first ones, //
+// or the ones at the top of the heap if '-R' switch is used).  Their points //
+// are calculated, then the threads find the cavities of the points and if   //
+// they encroach upon segments (by checkcav4encroach()), without changing    //
+// the mesh.  This is the costly part of splitting a subface.                //
+//                                                                           //
+// Then the encsubs are dequeued one by one in the usual order.  A planned   //
+// one is split without searching its cavity again if the plan is still      //
+// valid:  its point is not rejected, the subface and its point are the same,//
+// and neither its cavity nor a tet adjoining it has been changed in this    //
+// round.  The cavities of all the points inserted in this round are marked  //
+// in 'roundtets' (see markroundtets()).  A point inserted by Delaunay flips //
+// only replaces the tets of its cavity.  The others (including the not      //
+// planned ones) are split by splitencsub().  Once a segment is split, the   //
+// mesh may be changed anywhere, the remaining plans are void and the round  //
+// ends.                                                                     //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::splitencsubsparallel(queue* flipqueue, list* cavtetlist)
+{
+  cavitythread *ctlist;
+  pthread_t *threads;
+  badface **encsubs, *plans, *encsub;
+  point *newpoints, checkpt, newpoint;
+  REAL *pointbuf;
+  triface *starttets, starttet;
+  face splitsub;
+  list **cavtetlists;
+  int *rejects;
+  long segnum;
+  bool valid;
+  int numthreads, maxnumber, number, pointwords, tetnum;
+  int quenumber, planquenumber, left, usednum;
+  int i;
+
+  numthreads = b->numthreads;
+  maxnumber = 16 * numthreads;
+  encsubs = new badface*[maxnumber];
+  plans = new badface[maxnumber];
+  newpoints = new point[maxnumber];
+  starttets = new triface[maxnumber];
+  cavtetlists = new list*[maxnumber];
+  rejects = new int[maxnumber];
+  // Space for the planned points (and one to check them), each one has
+  //   the size of a point of 'points'.
+  pointwords = points->itembytes / sizeof(REAL) + 1;
+  pointbuf = new REAL[(maxnumber + 1) * pointwords];
+  checkpt = (point) &pointbuf[maxnumber * pointwords];
+
+  // Find the queue which is dequeued next.
+  for (planquenumber = 0; planquenumber < 6; planquenumber++) {
+    if (subqueheap[planquenumber] != (list *) NULL) {
+      if (subqueheap[planquenumber]->len() > 0) break;
+    } else if (subquefront[planquenumber] != (badface *) NULL) {
+      break;
+    }
+  }
+  // Take a batch of it.  The changed subfaces are not planned.
+  number = 0;
+  encsub = (badface *) NULL;
+  if (planquenumber < 6) {
+    if (subqueheap[planquenumber] == (list *) NULL) {
+      encsub = subquefront[planquenumber];
+    }
+  }
+  for (i = 0; (planquenumber < 6) && (number < maxnumber); i++) {
+    if (subqueheap[planquenumber] != (list *) NULL) {
+      if (i >= subqueheap[planquenumber]->len()) break;
+      encsub = * (badface **)(* subqueheap[planquenumber])[i];
+    } else {
+      if (i > 0) encsub = encsub->nextface;
+      if (encsub == (badface *) NULL) break;
+    }
+    splitsub = encsub->ss;
+    if ((sorg(splitsub) != encsub->forg) || (sdest(splitsub) != encsub->fdest)
+        || (sapex(splitsub) != encsub->fapex)) continue;
+    encsubs[number] = encsub;
+    // Remember the subface (the badface may be reused after it is deleted).
+    plans[number] = *encsub;
+    newpoints[number] = (point) &pointbuf[number * pointwords];
+    calcsubsplitpoint(encsub, planquenumber, newpoints[number]);
+    stpivot(splitsub, starttets[number]);
+    if (starttets[number].tet == dummytet) {
+      sesymself(splitsub);
+      stpivot(splitsub, starttets[number]);
+    }
+    assert(starttets[number].tet != dummytet);
+    number++;
+  }
+
+  tetnum = 0;
+  if (number > 0) {
+    // Find the cavities in threads.
+    for (i = 0; i < number; i++) {
+      cavtetlists[i] = new list(sizeof(triface), NULL, 64);
+    }
+    if (numthreads > number) {
+      numthreads = number;
+    }
+    ctlist = new cavitythread[numthreads];
+    threads = new pthread_t[numthreads];
+    for (i = 0; i < numthreads; i++) {
+      ctlist[i].mesh = this;
+      ctlist[i].newpoints = newpoints;
+      ctlist[i].starttets = starttets;
+      ctlist[i].cavtetlists = cavtetlists;
+      ctlist[i].rejects = rejects;
+      ctlist[i].number = number;
+      ctlist[i].firstone = i;
+      ctlist[i].step = numthreads;
+      if (pthread_create(&threads[i], (pthread_attr_t *) NULL,
+                         splitencsubsthread, (void *) &ctlist[i]) != 0) {
+        printf("Error:  Unable to create a thread.\n");
+        exit(1);
+      }
+    }
+    for (i = 0; i < numthreads; i++) {
+      pthread_join(threads[i], (void **) NULL);
+    }
+    delete [] threads;
+    delete [] ctlist;
+    for (i = 0; i < number; i++) {
+      tetnum += cavtetlists[i]->len();
+    }
+  }
+
+  // The table of changed tets.  A cavity marks its tets and their
+  //   neighbors, it is enlarged by markroundtets() if necessary.
+  roundtetsize = 1024;
+  while (roundtetsize < 20 * tetnum) roundtetsize *= 2;
+  roundtets = new tetrahedron*[roundtetsize];
+  for (i = 0; i < roundtetsize; i++) roundtets[i] = (tetrahedron *) NULL;
+  roundtetcount = 0;
+
+  // Split the encsubs in the usual order.  'rejects[i]' is set to -1 once
+  //   the i-th one is dequeued.
+  segnum = subsegs->items;
+  left = number;
+  usednum = 0;
+  do {
+    encsub = dequeueencsub(&quenumber);
+    assert(encsub != (badface *) NULL);
+    if (b->verbose > 2) {
+      printf("    Dequeuing encsub x%lx (%d, %d, %d).\n",
+             (unsigned long) encsub, pointmark(encsub->forg),
+             pointmark(encsub->fdest), pointmark(encsub->fapex));
+    }
+    valid = false;
+    for (i = 0; i < number; i++) {
+      if ((rejects[i] >= 0) && (encsubs[i] == encsub)) break;
+    }
+    if (i < number) {
+      valid = (rejects[i] == 0) && (quenumber == planquenumber);
+      rejects[i] = -1;
+      left--;
+    }
+    if (valid) {
+      // Is it still the planned subface?
+      splitsub = encsub->ss;
+      valid = (splitsub.sh == plans[i].ss.sh) &&
+        (encsub->forg == plans[i].forg) && (sorg(splitsub) == encsub->forg)
+        && (encsub->fdest == plans[i].fdest) &&
+        (sdest(splitsub) == encsub->fdest) &&
+        (encsub->fapex == plans[i].fapex) &&
+        (sapex(splitsub) == encsub->fapex);
+    }
+    if (valid) {
+      valid = !roundtetsmarked(cavtetlists[i]);
+    }
+    if (valid) {
+      // The point must be the same one.
+      calcsubsplitpoint(encsub, quenumber, checkpt);
+      valid = (checkpt[0] == newpoints[i][0]) &&
+        (checkpt[1] == newpoints[i][1]) && (checkpt[2] == newpoints[i][2]);
+    }
+    if (valid) {
+      // Split it as splitencsub() does.  The cavity of the point is known,
+      //   and the point does not encroach upon any segment.
+      splitsub = encsub->ss;
+      setsub2badface(splitsub, NULL);
+      newpoint = getsubsplitpoint(encsub, quenumber);
+      // stpivot() does not set the version.  Start from 0 as a new triface
+      //   in splitencsub() does, the flips depend on it.
+      starttet.ver = 0;
+      stpivot(splitsub, starttet);
+      if (starttet.tet == dummytet) {
+        sesymself(splitsub);
+        stpivot(splitsub, starttet);
+      }
+      assert(starttet.tet != dummytet);
+      recenttet = starttet;
+      markroundtets(cavtetlists[i]);
+      insertsubsplitpoint(&splitsub, newpoint, &starttet, flipqueue,
+                          cavtetlist);
+      badfacedealloc(encsubfaces, encsub);
+      usednum++;
+    } else {
+      splitencsub(encsub, quenumber, flipqueue, cavtetlist);
     }
-  } else if (rsharp) {
-    pb = sorg(rseg);
-    pc = sdest(rseg);
-    rpc = rpcr;
-  } else {
-    assert(lsharp);
-    pb = sorg(lseg);
-    pc = sdest(lseg);
-    rpc = rpcl;
-  }
+    if (subsegs->items != segnum) {
+      // Some segments are split.  The remaining plans are void.
+      left = 0;
+    }
+  } while ((left > 0) && (encsubfaces->items > 0) && !checkrefinebudget());
 
-  if (b->verbose > 2) {
-    printf("    NAVSHARPS: (%d, %d, %d) rpc = %d.\n", pointmark(bface->forg),
-           pointmark(bface->fdest), pointmark(bface->fapex), rpc);
+  if (b->verbose > 1) {
+    printf("  Split a round of %d planned encsubs, %d plans are used.\n",
+           number, usednum);
   }
 
-  edgeorthonormal(pb, pc, bface->fdest, orthonorm);
-  for (i = 0; i < 3; i++) newpoint[i] = pa[i] + rpc * orthonorm[i];
-  // a is the parent point of newpoint.
-  setpoint2ppt(newpoint, pa);
+  delete [] roundtets;
+  roundtets = (tetrahedron **) NULL;
+  roundtetsize = roundtetcount = 0;
+  for (i = 0; i < number; i++) {
+    delete cavtetlists[i];
+  }
+  delete [] pointbuf;
+  delete [] rejects;
+  delete [] cavtetlists;
+  delete [] starttets;
+  delete [] newpoints;
+  delete [] plans;
+  delete [] encsubs;
 }
 
+#endif // #ifdef PTHREADS
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // splitencsubs()    Split all the encroached subfaces.                      //
@@ -19320,244 +23876,43 @@ void tetgenmesh::calctynavsharps(badface* bface, point newpoint)
 // are split.  Newly inserted vertex may encroach upon other existing        //
 // subsegments and subfaces; these are also repaired.                        //
 //                                                                           //
+// The encroached subfaces are taken by dequeueencsub() in the order of their//
+// types.  Within a type, they're taken in the queued order, or the largest  //
+// (by circumradius) first if '-R' switch is used.  Splitting a big subface  //
+// often removes the encroachment of its smaller neighbors at once.          //
+//                                                                           //
+// If TetGen is compiled with PTHREADS and '-t' is used, they are split in   //
+// rounds by splitencsubsparallel().  The mesh is the same.                  //
+//                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
 void tetgenmesh::splitencsubs(queue* flipqueue, list* cavtetlist)
 {
   badface *encsub;
-  triface starttet;
-  face splitsub, neisplitsub;
-  face checksh, checkseg;
-  point newpoint, checkpt;
-  point pa, pb;
-  enum encsubtype ety;
-  enum locateresult loc;
-  REAL epspp;
-  bool enq, reject;
   int quenumber;
-  int ptidx, i;
 
   if (b->verbose > 1) {
     printf("  Splitting encroached subsegments.\n");
   }
 
   // Loop until the list 'encsubfaces' is empty.
-  while (encsubfaces->items > 0) {
-    // Look for an encsub from a nonempty queue. Remember the quenumber.
-    encsub = (badface *) NULL;
-    for (quenumber = 0; quenumber < 6; quenumber++) {
-      encsub = subquefront[quenumber];
-      if (encsub != (badface *) NULL) {
-        // Remove the encsub from the queue.
-        subquefront[quenumber] = encsub->nextface;
-        if (subquefront[quenumber] != (badface *) NULL) {
-          // The nextface exist! It becomes the first node.
-          subquefront[quenumber]->prevface = (badface *) NULL;
-        } else {
-          // encsub is the last one. The queue is empty.
-          subquetail[quenumber] = (badface *) NULL;
-        }
-        break;
-      }
+  while ((encsubfaces->items > 0) && !checkrefinebudget()) {
+#ifdef PTHREADS
+    if (b->numthreads > 1) {
+      // Split a round of encsubs with the help of threads.
+      splitencsubsparallel(flipqueue, cavtetlist);
+      continue;
     }
+#endif
+    // Get an encsub from a nonempty queue. Remember the quenumber.
+    encsub = dequeueencsub(&quenumber);
     assert(encsub != (badface *) NULL);
     if (b->verbose > 2) {
       printf("    Dequeuing encsub x%lx (%d, %d, %d).\n",
              (unsigned long) encsub, pointmark(encsub->forg),
              pointmark(encsub->fdest), pointmark(encsub->fapex));
     }
-
-    // Clear the pointer saved in encsub->ss. 
-    splitsub = encsub->ss;
-    setsub2badface(splitsub, NULL);
-    // The subface may be not the same one when it was determined to be
-    //   encroached.  If its adjacent encroached subface was split, the
-    //   consequent flips may change it into another subface.
-    enq = ((sorg(splitsub) == encsub->forg) &&
-           (sdest(splitsub) == encsub->fdest) &&
-           (sapex(splitsub) == encsub->fapex));
-    if (enq) {
-      // This subface is encroached, it should be split. Calculate a point
-      //   at or near the circumcenter of this subface.
-      newpoint = (point) points->alloc();
-      // Initialize this field.
-      setpoint2ppt(newpoint, NULL);
-      // 'quenumber' implies the type of the encsub.
-      ety = (enum encsubtype) quenumber;
-      switch (ety) {
-      case ACUTEVSHARPS:
-        calctyacutevsharps(encsub, newpoint);
-        break;
-      case ACUTEV:
-        calctyacutev(encsub, newpoint);
-        break;
-      case SHARPS:
-        calctysharps(encsub, newpoint);
-        break;
-      case FSVSHARPS:
-        calctyfsvsharps(encsub, newpoint);
-        break;
-      case NAVSHARPS:
-        calctynavsharps(encsub, newpoint);
-        break;
-      default: // NAVNSHARPS
-        calctynavnss(encsub, newpoint);
-      }
-      // Not interpolate its attributes.
-      for (i = 0; i < in->numberofpointattributes; i++) newpoint[i + 3] = 0.0;
-      // Set the unique index of the new point
-      ptidx = (int) points->items - (in->firstnumber == 1 ? 0 : 1);
-      setpointmark(newpoint, ptidx);
-      // Set the type of the new point.
-      setpointtype(newpoint, FREESUBVERTEX);
-
-      // Look if the newpoint encroaches upon some segments.
-      stpivot(splitsub, starttet);
-      if (starttet.tet == dummytet) {
-        sesymself(splitsub);
-        stpivot(splitsub, starttet);
-      }
-      assert(starttet.tet != dummytet);
-      recenttet = starttet;  // Used for the input of preciselocate().
-      collectcavtets(newpoint, cavtetlist);
-      assert(cavtetlist->len() > 0);
-      // Find encroaching segments from cavtetlist.
-      tallencsegs(newpoint, cavtetlist);
-      // Clear the list for the next use.
-      cavtetlist->clear();
-      reject = (encsubsegs->items > 0);
-      if (!reject) {
-
-        // Remove the encroached subface by inserting the newpoint.
-        loc = locatesub(newpoint, &(splitsub), oppo(starttet));
-        stpivot(splitsub, starttet);
-        if (starttet.tet == dummytet) {
-          sesymself(splitsub);
-          stpivot(splitsub, starttet);
-        }
-        assert(starttet.tet != dummytet);
-        if (loc != ONVERTEX) {
-          // Adjust the location of newpoint wrt. starttet.
-          epspp = b->epsilon;
-          while (1) {
-            loc = adjustlocate(newpoint, &starttet, ONFACE, epspp);
-            if (loc == ONVERTEX) {
-              checkpt = org(starttet);
-              if ((newpoint[0] != checkpt[0]) || (newpoint[1] != checkpt[1])
-                  || (newpoint[2] != checkpt[2])) {
-                epspp *= 1e-2;
-                continue;
-              }
-            }
-            break;
-          }
-        }
-        pa = org(starttet);
-        pb = dest(starttet);
-        findedge(&splitsub, pa, pb);
-
-        // Let splitsub be face abc.  ab is the current edge.
-        if (loc == ONFACE) {
-          // Split the face abc into three faces abv, bcv, cav. 
-          splittetface(newpoint, &starttet, flipqueue);
-          // Adjust splitsub be abv.
-          findedge(&splitsub, pa, pb);
-          assert(sapex(splitsub) == newpoint);
-          // Check the three new subfaces to see if they're encroached.
-          //   splitsub may be queued (it exists before split).
-          checksh = splitsub;
-          doencchecktest(&checksh); // abv;
-          senext(splitsub, checksh);
-          spivotself(checksh);
-          // It is a new created face and should not be infected.
-          assert(checksh.sh != dummysh && !sub2badface(checksh));
-          checksub4encroach(&checksh, NULL, true); // bcv
-          senext2(splitsub, checksh);
-          spivotself(checksh);
-          // It is a new created face and should not be infected.
-          assert(checksh.sh != dummysh && !sub2badface(checksh));
-          checksub4encroach(&checksh, NULL, true); // cav
-        } else if (loc == ONEDGE) {
-          // Let the adjacent subface be bad.  ab is the spliting edge.
-          //   Split two faces abc, bad into 4 faces avc, vbc, avd, vbd.
-          sspivot(splitsub, checkseg);
-          assert(checkseg.sh == dummysh);
-          // Remember the neighbor subface abd (going to be split also).
-          spivot(splitsub, neisplitsub);
-          findedge(&neisplitsub, pa, pb);
-          // Split two faces abc, abd into four faces avc, vbc, avd, vbd.
-          splittetedge(newpoint, &starttet, flipqueue);
-          // Adjust splitsub be avc, neisplitsub be avd.
-          findedge(&splitsub, pa, newpoint);
-          findedge(&neisplitsub, pa, newpoint);
-          // Check the four new subfaces to see if they're encroached.
-          //   splitsub may be an infected one (it exists before split).
-          checksh = splitsub;
-          doencchecktest(&checksh); // avc
-          //   Get vbc.
-          senext(splitsub, checksh);
-          spivotself(checksh);
-          //   vbc is newly created.
-          assert(checksh.sh != dummysh && !sub2badface(checksh));
-          checksub4encroach(&checksh, NULL, true); // vbc
-          //   neisplitsub may be an infected one (it exists before split).
-          checksh = neisplitsub;
-          doencchecktest(&checksh); // avd
-          //   Get vbd.
-          senext(neisplitsub, checksh);
-          spivotself(checksh);
-          //   vbd is newly created.
-          assert(checksh.sh != dummysh && !sub2badface(checksh));
-          checksub4encroach(&checksh, NULL, true); // vbd
-        } else {
-          printf("Internal error in splitencsub():  Point %d locates %s.\n",
-            pointmark(newpoint), loc == ONVERTEX ? "on vertex" : "outside");
-          internalerror();
-        }
-
-        // Recover Delaunay property by flipping. All existing subfaces
-        //   which are encroached by the new point will be discovered
-        //   during flips and be queued in list.
-        flip(flipqueue, NULL);
-        // There should be no encroached segments.
-        assert(encsubsegs->items == 0);
-
-      } else {
-        // 'newpoint' is rejected.  Delete it.
-        pointdealloc(newpoint);
-
-        // Put 'encsub' back into the queue.
-        if (b->verbose > 2) {
-          printf("    Requeuing encsub x%lx.\n", (unsigned long) encsub);
-        }
-        setsub2badface(encsub->ss, encsub);
-        // Queue elements are double-linked.
-        encsub->prevface = (badface *) NULL;
-        encsub->nextface = (badface *) NULL;
-        // Add the element to the end of a queue.
-        if (subquetail[quenumber] == (badface *) NULL) {
-          // This queue is empty.  It is the only element in the link.
-          subquefront[quenumber] = subquetail[quenumber] = encsub;
-        } else {
-          // Add it at the end of the queue.
-          assert(subquetail[quenumber]->nextface == (badface *) NULL);
-          subquetail[quenumber]->nextface = encsub;
-          encsub->prevface = subquetail[quenumber];
-          subquetail[quenumber] = encsub;
-        }
-
-        // Repair all the encroached segments.
-        splitencsegs(flipqueue);
-      }
-    } else {
-      // It is changed. It may still be encroached.
-      checksub4encroach(&splitsub, NULL, true);
-    }
-
-    if (!enq || (enq && !reject)) {
-      // Remove this entry from list.
-      badfacedealloc(encsubfaces, encsub);
-    }
+    splitencsub(encsub, quenumber, flipqueue, cavtetlist);
   }
 }
 
@@ -19569,10 +23924,15 @@ void tetgenmesh::splitencsubs(queue* flipqueue, list* cavtetlist)
 // In a conforming Delaunay tetrahedralization, the diametric circumballs of //
 // all subsegments and subfaces are empty.                                   //
 //                                                                           //
+// If the budget given by '-S' or '-w' switch is used up (see checkrefine-   //
+// budget()), the refinement stops early.  The mesh is still valid, but not  //
+// all encroached subsegments and subfaces are split.                        //
+//                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
 void tetgenmesh::enforcequality()
 {
+  badface *bface;
   queue *flipqueue;
   list *cavtetlist;
   int i;
@@ -19582,12 +23942,17 @@ void tetgenmesh::enforcequality()
   }
 
   // Initialize 'flipqueue', cavtetlist.
-  flipqueue = new queue(sizeof(badface));
+  flipqueue = new queue(sizeof(flipitem));
   cavtetlist = new list(sizeof(triface), NULL, 256);
   // Initialize 'rpsarray', and 'apcarray'.
   rpsarray = new REAL[points->items];
   apcarray = new REAL[insegment * 2];
   
+  // Start the budget of refinement.
+  refinestart = wallclockseconds();
+  refinepoints = points->items;
+  refinestopped = 0;
+
   // Initialize the pool of encroached subsegments.
   encsubsegs = new memorypool(sizeof(badface), BADSUBPERBLOCK, POINTER, 0);
   // Calculate the protecting spheres for all acute points.
@@ -19596,13 +23961,20 @@ void tetgenmesh::enforcequality()
   tallencsegs(NULL, NULL);
   if (encsubsegs->items > 0) {
     // Fix all encroached segments.
-    splitencsegs(flipqueue);
+    splitencsegs(flipqueue, cavtetlist);
   }
 
   // Initialize the pool of encroached subfaces.
   encsubfaces = new memorypool(sizeof(badface), BADSUBPERBLOCK, POINTER, 0);
   // Initialize the queues of encroached subfaces.
-  for (i = 0; i < 5; i++) subquefront[i] = subquetail[i] = (badface *) NULL;
+  for (i = 0; i < 6; i++) {
+    subquefront[i] = subquetail[i] = (badface *) NULL;
+    if (b->prioritysubs) {
+      subqueheap[i] = new list(sizeof(badface *), NULL, 256);
+    } else {
+      subqueheap[i] = (list *) NULL;
+    }
+  }
   // Marking sharp segments.
   marksharpsegments(89.0);
   // Calculate the protecting angles array.
@@ -19614,10 +23986,39 @@ void tetgenmesh::enforcequality()
     splitencsubs(flipqueue, cavtetlist);
   }
 
+  if (refinestopped) {
+    if (!b->quiet) {
+      printf("Warning:  Refinement is stopped after %ld Steiner points.\n",
+             points->items - refinepoints);
+      printf("  %ld encroached subsegments and %ld subfaces remain.\n",
+             encsubsegs->items, encsubfaces->items);
+    }
+    // Clear the pointers of the remaining ones in the mesh.
+    encsubsegs->traversalinit();
+    bface = badfacetraverse(encsubsegs);
+    while (bface != (badface *) NULL) {
+      if (sub2badface(bface->ss) == bface) {
+        setsub2badface(bface->ss, NULL);
+      }
+      bface = badfacetraverse(encsubsegs);
+    }
+    encsubfaces->traversalinit();
+    bface = badfacetraverse(encsubfaces);
+    while (bface != (badface *) NULL) {
+      if (sub2badface(bface->ss) == bface) {
+        setsub2badface(bface->ss, NULL);
+      }
+      bface = badfacetraverse(encsubfaces);
+    }
+  }
+
   delete [] rpsarray;
   delete [] apcarray;
   delete encsubsegs;
   delete encsubfaces;
+  if (b->prioritysubs) {
+    for (i = 0; i < 6; i++) delete subqueheap[i];
+  }
   delete cavtetlist;
   delete flipqueue;
 }
@@ -19640,6 +24041,9 @@ void tetgenmesh::enforcequality()
 // 'ymin', 'ymax', 'zmin', 'zmax') and the diameter ('longest') of the point //
 // set are calculated in this routine as well.                               //
 //                                                                           //
+// If 'in->handover' is set, 'in->pointlist' is freed after the transfer, so //
+// the two copies of the points are only kept during this routine.           //
+//                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
 void tetgenmesh::transfernodes()
@@ -19692,6 +24096,16 @@ void tetgenmesh::transfernodes()
     printf("Error:  Input point set is trivial.\n");
     exit(1);
   }
+
+  if (in->handover) {
+    // The points are handed over.  Free the input copy of them.
+    delete [] in->pointlist;
+    in->pointlist = (REAL *) NULL;
+    if (in->pointattributelist != (REAL *) NULL) {
+      delete [] in->pointattributelist;
+      in->pointattributelist = (REAL *) NULL;
+    }
+  }
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -19839,6 +24253,308 @@ void tetgenmesh::highorder()
   }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// formatblock()    Write the lines of the live items of a block of a pool.  //
+//                                                                           //
+// 'block' is a block of 'pool', it holds 'slots' items (dead or alive).     //
+// The first live one is numbered by 'number'.  The lines (see outnodes(),   //
+// outelements() and outneighbors()) are written into 'buffer', which must   //
+// be large enough, 'bufferend' is set to the end of them.  If 'buffer' is   //
+// NULL, nothing is written.  Return the number of the live items.           //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+int tetgenmesh::formatblock(memorypool* pool, enum outputlines kind,
+  void** block, int slots, int number, char* buffer, char** bufferend)
+{
+  triface tetloop, tetsym;
+  tetrahedron *tptr;
+  point pointloop, *extralist;
+  unsigned long alignptr;
+  char *item, *s;
+  int itembytes, nextras, eextras, bmark, live;
+  int i, j;
+
+  // Find the first item in the block (see memorypool::traverse()).
+  alignptr = (unsigned long) (block + 1);
+  item = (char *) (alignptr + (unsigned long) pool->alignbytes -
+                   (alignptr % (unsigned long) pool->alignbytes));
+  itembytes = pool->itemwords * (pool->itemwordtype == POINTER ?
+                                 sizeof(void *) : sizeof(REAL));
+  nextras = in->numberofpointattributes;
+  eextras = in->numberoftetrahedronattributes;
+  bmark = !b->nobound && in->pointmarkerlist;
+
+  s = buffer;
+  live = 0;
+  for (i = 0; i < slots; i++, item += itembytes) {
+    // Skip dead ones.
+    if (kind == NODELINES) {
+      pointloop = (point) item;
+      if (pointtype(pointloop) == DEADVERTEX) continue;
+    } else {
+      tptr = (tetrahedron *) item;
+      if (tptr[7] == (tetrahedron) NULL) continue;
+    }
+    live++;
+    if (buffer == (char *) NULL) continue;
+    if (kind == NODELINES) {
+      // Point number, x, y and z coordinates.
+      s = tetgenio::formatint(s, "", number, 4);
+      s = tetgenio::formatreal(s, "    ", pointloop[0]);
+      s = tetgenio::formatreal(s, "  ", pointloop[1]);
+      s = tetgenio::formatreal(s, "  ", pointloop[2]);
+      for (j = 0; j < nextras; j++) {
+        // Write an attribute.
+        s = tetgenio::formatreal(s, "  ", pointloop[3 + j]);
+      }
+      if (bmark) {
+        // Write the boundary marker.
+        s = tetgenio::formatint(s, "    ",
+          outpointmarker(pointloop, number - in->firstnumber), 0);
+      }
+    } else if (kind == ELEMENTLINES) {
+      // Tetrahedron number, indices for four points.
+      s = tetgenio::formatint(s, "", number, 5);
+      s = tetgenio::formatint(s, "   ", pointmark((point) tptr[4]), 5);
+      s = tetgenio::formatint(s, " ", pointmark((point) tptr[5]), 5);
+      s = tetgenio::formatint(s, " ", pointmark((point) tptr[6]), 5);
+      s = tetgenio::formatint(s, " ", pointmark((point) tptr[7]), 5);
+      if (b->order == 2) {
+        extralist = (point *) tptr[highorderindex];
+        // Tetrahedron number, indices for four points plus six extra points.
+        for (j = 0; j < 6; j++) {
+          s = tetgenio::formatint(s, j == 0 ? "  " : " ",
+                                  pointmark(extralist[j]), 5);
+        }
+      }
+      for (j = 0; j < eextras; j++) {
+        s = tetgenio::formatreal(s, "    ", elemattribute(tptr, j));
+      }
+    } else {
+      // Tetrahedra number, neighboring tetrahedron numbers.  The numbers
+      //   of the tetrahedra are stored at 'tet + 8' (see outneighbors()).
+      s = tetgenio::formatint(s, "", number, 4);
+      tetloop.tet = tptr;
+      tetloop.loc = 2;
+      sym(tetloop, tetsym);
+      s = tetgenio::formatint(s, "    ", * (int *) (tetsym.tet + 8), 4);
+      tetloop.loc = 3;
+      sym(tetloop, tetsym);
+      s = tetgenio::formatint(s, "  ", * (int *) (tetsym.tet + 8), 4);
+      tetloop.loc = 1;
+      sym(tetloop, tetsym);
+      s = tetgenio::formatint(s, "  ", * (int *) (tetsym.tet + 8), 4);
+      tetloop.loc = 0;
+      sym(tetloop, tetsym);
+      s = tetgenio::formatint(s, "  ", * (int *) (tetsym.tet + 8), 4);
+    }
+    *s++ = '\n';
+    number++;
+  }
+
+  if (bufferend != (char **) NULL) {
+    *bufferend = s;
+  }
+  return live;
+}
+
+#ifdef PTHREADS
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// writepoolthread()    Format a part of the blocks of a round of the        //
+//                      parallel writing of a file.                          //
+//                                                                           //
+// 'arg' is a pointer to an 'outputthread'.                                  //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void* tetgenmesh::writepoolthread(void* arg)
+{
+  outputthread *ot;
+  int i;
+
+  ot = (outputthread *) arg;
+  for (i = ot->firstone; i < ot->number; i += ot->step) {
+    ot->mesh->formatblock(ot->pool, ot->kind, ot->blocks[i],
+                          ot->blockslots[i], ot->firstnumbers[i],
+                          ot->buffers[i], &(ot->bufferends[i]));
+  }
+  return (void *) NULL;
+}
+
+#endif // #ifdef PTHREADS
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// writepool()    Write the lines of the live items of a pool to a file.     //
+//                                                                           //
+// The items are numbered from 'in->firstnumber' in the order of traversal.  //
+// The pool is written block by block.  Each block is formatted into its own //
+// buffer by formatblock().  The number of the first live item of a block is //
+// known by counting the live items of the blocks before it.                 //
+//                                                                           //
+// If 'b->numthreads' > 1, the blocks are written in rounds.  In each round, //
+// a batch of blocks is formatted by the threads in parallel, then their     //
+// buffers are written to the file in order.  So the file is the same as     //
+// written by one thread, and only a batch of buffers is kept in memory.     //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::writepool(FILE* outfile, memorypool* pool,
+                           enum outputlines kind)
+{
+#ifdef PTHREADS
+  outputthread *otlist;
+  pthread_t *threads;
+#endif
+  void ***blocks, **nowblock;
+  char **buffers, **bufferends;
+  int *blockslots, *firstnumbers;
+  long slotsleft, linesize;
+  int numthreads, maxnumber, number, nextnumber;
+  int extras, i;
+
+  numthreads = 1;
+#ifdef PTHREADS
+  if (b->numthreads > 1) {
+    numthreads = b->numthreads;
+  }
+#endif
+  maxnumber = numthreads > 1 ? 4 * numthreads : 1;
+
+  // An upper bound of the length of a line.  A number takes at most 32
+  //   characters (with its leading spaces).
+  if (kind == NODELINES) {
+    extras = in->numberofpointattributes;
+  } else if (kind == ELEMENTLINES) {
+    extras = in->numberoftetrahedronattributes;
+  } else {
+    extras = 0;
+  }
+  linesize = 32 * (12 + extras);
+  blocks = new void**[maxnumber];
+  blockslots = new int[maxnumber];
+  firstnumbers = new int[maxnumber];
+  buffers = new char*[maxnumber];
+  bufferends = new char*[maxnumber];
+  for (i = 0; i < maxnumber; i++) {
+    buffers[i] = new char[pool->itemsperblock * linesize];
+  }
+  // formatreal() initializes its tables at the first call. Do it before
+  //   the threads are started.
+  tetgenio::formatreal(buffers[0], "", 0.0);
+
+  nowblock = pool->firstblock;
+  slotsleft = pool->maxitems;
+  nextnumber = in->firstnumber;
+  while (slotsleft > 0) {
+    // Take a round of blocks. Number their first live items.
+    number = 0;
+    while ((number < maxnumber) && (slotsleft > 0)) {
+      blocks[number] = nowblock;
+      blockslots[number] = slotsleft < pool->itemsperblock ?
+                           (int) slotsleft : pool->itemsperblock;
+      firstnumbers[number] = nextnumber;
+      nextnumber += formatblock(pool, kind, nowblock, blockslots[number],
+                                nextnumber, (char *) NULL, (char **) NULL);
+      slotsleft -= blockslots[number];
+      nowblock = (void **) *nowblock;
+      number++;
+    }
+    // Format the blocks.
+#ifdef PTHREADS
+    if ((numthreads > 1) && (number > 1)) {
+      otlist = new outputthread[numthreads];
+      threads = new pthread_t[numthreads];
+      for (i = 0; i < numthreads; i++) {
+        otlist[i].mesh = this;
+        otlist[i].pool = pool;
+        otlist[i].kind = kind;
+        otlist[i].blocks = blocks;
+        otlist[i].blockslots = blockslots;
+        otlist[i].firstnumbers = firstnumbers;
+        otlist[i].buffers = buffers;
+        otlist[i].bufferends = bufferends;
+        otlist[i].number = number;
+        otlist[i].firstone = i;
+        otlist[i].step = numthreads;
+        if (pthread_create(&threads[i], (pthread_attr_t *) NULL,
+                           writepoolthread, (void *) &otlist[i]) != 0) {
+          printf("Error:  Unable to create a thread.\n");
+          exit(1);
+        }
+      }
+      for (i = 0; i < numthreads; i++) {
+        pthread_join(threads[i], (void **) NULL);
+      }
+      delete [] threads;
+      delete [] otlist;
+    } else {
+#endif
+      for (i = 0; i < number; i++) {
+        formatblock(pool, kind, blocks[i], blockslots[i], firstnumbers[i],
+                    buffers[i], &(bufferends[i]));
+      }
+#ifdef PTHREADS
+    }
+#endif
+    // Write the buffers in order.
+    for (i = 0; i < number; i++) {
+      fwrite(buffers[i], 1, bufferends[i] - buffers[i], outfile);
+    }
+  }
+
+  for (i = 0; i < maxnumber; i++) {
+    delete [] buffers[i];
+  }
+  delete [] bufferends;
+  delete [] buffers;
+  delete [] firstnumbers;
+  delete [] blockslots;
+  delete [] blocks;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// outpointmarker()    Return the boundary marker of an output point.        //
+//                                                                           //
+// 'index' is the index of the point in the output, i.e., its number minus   //
+// 'in->firstnumber'.  An input point keeps its input marker, if it is not   //
+// zero.  Otherwise, a boundary point has marker 1, others have marker 0.    //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+int tetgenmesh::outpointmarker(point pointloop, int index)
+{
+  int marker;
+
+  if (index < in->numberofpoints) {
+    // Input point's marker is directly copied to output.
+    marker = in->pointmarkerlist[index];
+    if (marker == 0) {
+      // Change the marker if it is a boundary point.
+      marker = ((pointtype(pointloop) == INPUTVERTEX) ||
+                (pointtype(pointloop) == ACUTEVERTEX) ||
+                (pointtype(pointloop) == NONACUTEVERTEX) ||
+                (pointtype(pointloop) == FACETVERTEX)) 
+             ? 1 : 0;
+    }
+  } else if ((pointtype(pointloop) == ACUTEVERTEX) ||
+             (pointtype(pointloop) == NONACUTEVERTEX) ||
+             (pointtype(pointloop) == FREESEGVERTEX) ||
+             (pointtype(pointloop) == FREESUBVERTEX)) {
+    // A booundary vertex has marker 1.
+    marker = 1;
+  } else {
+    // Free or internal point has a zero marker.
+    marker = 0;
+  }
+  return marker;
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // outnodes()    Output the points to a .node file or a tetgenio structure.  //
@@ -19855,9 +24571,10 @@ void tetgenmesh::outnodes(tetgenio* out)
   FILE *outfile;
   char outnodefilename[FILENAMESIZE];
   point pointloop;
-  int nextras, bmark, marker;
+  int nextras, bmark;
   int coordindex, attribindex;
-  int pointnumber, index, i;
+  long chunk, first, index;
+  int i;
 
   if (out == (tetgenio *) NULL) {
     strcpy(outnodefilename, b->outfilename);
@@ -19884,100 +24601,87 @@ void tetgenmesh::outnodes(tetgenio* out)
     // Number of points, number of dimensions, number of point attributes,
     //   and number of boundary markers (zero or one).
     fprintf(outfile, "%ld  %d  %d  %d\n", points->items, 3, nextras, bmark);
-  } else {
-    // Allocate space for 'pointlist';
-    out->pointlist = new REAL[points->items * 3];
-    if (out->pointlist == (REAL *) NULL) {
+    // Point number, x, y and z coordinates, attributes and boundary marker.
+    writepool(outfile, points, NODELINES);
+    fprintf(outfile, "# Generated by %s\n", b->commandline);
+    fclose(outfile);
+    return;
+  }
+
+  // The number of points kept in the arrays at once.
+  chunk = points->items;
+  if ((out->visitor != (tetgenio::outputvisitor *) NULL) &&
+      (out->visitor->chunksize > 0) && (out->visitor->chunksize < chunk)) {
+    chunk = out->visitor->chunksize;
+  }
+  // Allocate space for 'pointlist';
+  out->pointlist = new REAL[chunk * 3];
+  if (out->pointlist == (REAL *) NULL) {
+    printf("Error:  Out of memory.\n");
+    exit(1);
+  }
+  // Allocate space for 'pointattributelist' if necessary;
+  if (nextras > 0) {
+    out->pointattributelist = new REAL[chunk * nextras];
+    if (out->pointattributelist == (REAL *) NULL) {
       printf("Error:  Out of memory.\n");
       exit(1);
     }
-    // Allocate space for 'pointattributelist' if necessary;
-    if (nextras > 0) {
-      out->pointattributelist = new REAL[points->items * nextras];
-      if (out->pointattributelist == (REAL *) NULL) {
-        printf("Error:  Out of memory.\n");
-        exit(1);
-      }
-    }
-    // Allocate space for 'pointmarkerlist' if necessary;
-    if (bmark) {
-      out->pointmarkerlist = new int[points->items];
-      if (out->pointmarkerlist == (int *) NULL) {
-        printf("Error:  Out of memory.\n");
-        exit(1);
-      }
-    }
-    out->numberofpoints = points->items;
-    out->numberofpointattributes = nextras;
-    coordindex = 0;
-    attribindex = 0;
   }
-
-  points->traversalinit();
-  pointloop = pointtraverse();
-  pointnumber = in->firstnumber;
-  index = 0;
-  while (pointloop != (point) NULL) {
-    if (bmark) {
-      // Determine the boundary marker.
-      if (index < in->numberofpoints) {
-        // Input point's marker is directly copied to output.
-        marker = in->pointmarkerlist[index];
-        if (marker == 0) {
-          // Change the marker if it is a boundary point.
-          marker = ((pointtype(pointloop) == INPUTVERTEX) ||
-                    (pointtype(pointloop) == ACUTEVERTEX) ||
-                    (pointtype(pointloop) == NONACUTEVERTEX) ||
-                    (pointtype(pointloop) == FACETVERTEX)) 
-                 ? 1 : 0;
-        }
-      } else if ((pointtype(pointloop) == ACUTEVERTEX) ||
-                 (pointtype(pointloop) == NONACUTEVERTEX) ||
-                 (pointtype(pointloop) == FREESEGVERTEX) ||
-                 (pointtype(pointloop) == FREESUBVERTEX)) {
-        // A booundary vertex has marker 1.
-        marker = 1;
-      } else {
-        // Free or internal point has a zero marker.
-        marker = 0;
-      }
+  // Allocate space for 'pointmarkerlist' if necessary;
+  if (bmark) {
+    out->pointmarkerlist = new int[chunk];
+    if (out->pointmarkerlist == (int *) NULL) {
+      printf("Error:  Out of memory.\n");
+      exit(1);
     }
-    if (out == (tetgenio *) NULL) {
-      // Point number, x, y and z coordinates.
-      fprintf(outfile, "%4d    %.17g  %.17g  %.17g", pointnumber,
-              pointloop[0], pointloop[1], pointloop[2]);
-      for (i = 0; i < nextras; i++) {
-        // Write an attribute.
-        fprintf(outfile, "  %.17g", pointloop[3 + i]);
-      }
-      if (bmark) {
-        // Write the boundary marker.
-        fprintf(outfile, "    %d", marker);
-      }
-      fprintf(outfile, "\n");
-    } else {
-      // X, y, and z coordinates.
-      out->pointlist[coordindex++] = pointloop[0];
-      out->pointlist[coordindex++] = pointloop[1];
-      out->pointlist[coordindex++] = pointloop[2];
-      // Point attributes.
-      for (i = 0; i < nextras; i++) {
-        // Output an attribute.
-        out->pointattributelist[attribindex++] = pointloop[3 + i];
-      }
-      if (bmark) {
-        // Output the boundary marker.  
-        out->pointmarkerlist[index] = marker;
-      }
+  }
+  out->numberofpoints = points->items;
+  out->numberofpointattributes = nextras;
+  coordindex = 0;
+  attribindex = 0;
+
+  points->traversalinit();
+  pointloop = pointtraverse();
+  index = first = 0;
+  while (pointloop != (point) NULL) {
+    // X, y, and z coordinates.
+    out->pointlist[coordindex++] = pointloop[0];
+    out->pointlist[coordindex++] = pointloop[1];
+    out->pointlist[coordindex++] = pointloop[2];
+    // Point attributes.
+    for (i = 0; i < nextras; i++) {
+      // Output an attribute.
+      out->pointattributelist[attribindex++] = pointloop[3 + i];
+    }
+    if (bmark) {
+      // Output the boundary marker.  
+      out->pointmarkerlist[index - first] = outpointmarker(pointloop, index);
     }
     pointloop = pointtraverse();
-    pointnumber++; 
     index++;
+    if ((out->visitor != (tetgenio::outputvisitor *) NULL) &&
+        ((index - first == chunk) || (pointloop == (point) NULL))) {
+      // Stream a chunk of points.
+      out->visitor->nodes(out, (int) first, (int) (index - first));
+      first = index;
+      coordindex = 0;
+      attribindex = 0;
+    }
   }
 
-  if (out == (tetgenio *) NULL) {
-    fprintf(outfile, "# Generated by %s\n", b->commandline);
-    fclose(outfile);
+  if (out->visitor != (tetgenio::outputvisitor *) NULL) {
+    // The chunks are streamed, free the arrays.
+    delete [] out->pointlist;
+    out->pointlist = (REAL *) NULL;
+    if (out->pointattributelist != (REAL *) NULL) {
+      delete [] out->pointattributelist;
+      out->pointattributelist = (REAL *) NULL;
+    }
+    if (out->pointmarkerlist != (int *) NULL) {
+      delete [] out->pointmarkerlist;
+      out->pointmarkerlist = (int *) NULL;
+    }
   }
 }
 
@@ -19999,7 +24703,7 @@ void tetgenmesh::outelements(tetgenio* out)
   int attribindex;
   point p1, p2, p3, p4;
   point *extralist;
-  int elementnumber;
+  long chunk, first, index;
   int eextras;
   int i;
 
@@ -20026,80 +24730,86 @@ void tetgenmesh::outelements(tetgenio* out)
     // Number of tetras, points per tetra, attributes per tetra.
     fprintf(outfile, "%ld  %d  %d\n", tetrahedrons->items,
             b->order == 1 ? 4 : 10, eextras);
-  } else {
-    // Allocate memory for output tetrahedra.
-    out->tetrahedronlist = new int[tetrahedrons->items * 
-                                   (b->order == 1 ? 4 : 10)];
-    if (out->tetrahedronlist == (int *) NULL) {
+    // Tetrahedron number, indices of points and attributes.
+    writepool(outfile, tetrahedrons, ELEMENTLINES);
+    fprintf(outfile, "# Generated by %s\n", b->commandline);
+    fclose(outfile);
+    return;
+  }
+
+  // The number of tetrahedra kept in the arrays at once.
+  chunk = tetrahedrons->items;
+  if ((out->visitor != (tetgenio::outputvisitor *) NULL) &&
+      (out->visitor->chunksize > 0) && (out->visitor->chunksize < chunk)) {
+    chunk = out->visitor->chunksize;
+  }
+  // Allocate memory for output tetrahedra.
+  out->tetrahedronlist = new int[chunk * 
+                                 (b->order == 1 ? 4 : 10)];
+  if (out->tetrahedronlist == (int *) NULL) {
+    printf("Error:  Out of memory.\n");
+    exit(1);
+  }
+  // Allocate memory for output tetrahedron attributes if necessary.
+  if (eextras > 0) {
+    out->tetrahedronattributelist = new REAL[chunk * eextras];
+    if (out->tetrahedronattributelist == (REAL *) NULL) {
       printf("Error:  Out of memory.\n");
       exit(1);
     }
-    // Allocate memory for output tetrahedron attributes if necessary.
-    if (eextras > 0) {
-      out->tetrahedronattributelist = new REAL[tetrahedrons->items * eextras];
-      if (out->tetrahedronattributelist == (REAL *) NULL) {
-        printf("Error:  Out of memory.\n");
-        exit(1);
-      }
-    }
-    out->numberoftetrahedra = tetrahedrons->items;
-    out->numberofcorners = b->order == 1 ? 4 : 10;
-    out->numberoftetrahedronattributes = eextras;
-    tlist = out->tetrahedronlist;
-    talist = out->tetrahedronattributelist;
-    pointindex = 0;
-    attribindex = 0;
   }
+  out->numberoftetrahedra = tetrahedrons->items;
+  out->numberofcorners = b->order == 1 ? 4 : 10;
+  out->numberoftetrahedronattributes = eextras;
+  tlist = out->tetrahedronlist;
+  talist = out->tetrahedronattributelist;
+  pointindex = 0;
+  attribindex = 0;
+  index = first = 0;
 
   tetrahedrons->traversalinit();
   tptr = tetrahedrontraverse();
-  elementnumber = in->firstnumber;
   while (tptr != (tetrahedron *) NULL) {
     p1 = (point) tptr[4];
     p2 = (point) tptr[5];
     p3 = (point) tptr[6];
     p4 = (point) tptr[7];
-    if (out == (tetgenio *) NULL) {
-      // Tetrahedron number, indices for four points.
-      fprintf(outfile, "%5d   %5d %5d %5d %5d", elementnumber,
-              pointmark(p1), pointmark(p2), pointmark(p3), pointmark(p4));
-      if (b->order == 2) {
-        extralist = (point *) tptr[highorderindex];
-        // Tetrahedron number, indices for four points plus six extra points.
-        fprintf(outfile, "  %5d %5d %5d %5d %5d %5d",
-                pointmark(extralist[0]), pointmark(extralist[1]),
-                pointmark(extralist[2]), pointmark(extralist[3]),
-                pointmark(extralist[4]), pointmark(extralist[5]));
-      }
-      for (i = 0; i < eextras; i++) {
-        fprintf(outfile, "    %.17g", elemattribute(tptr, i));
-      }
-      fprintf(outfile, "\n");
-    } else {
-      tlist[pointindex++] = pointmark(p1);
-      tlist[pointindex++] = pointmark(p2);
-      tlist[pointindex++] = pointmark(p3);
-      tlist[pointindex++] = pointmark(p4);
-      if (b->order == 2) {
-        extralist = (point *) tptr[highorderindex];
-        tlist[pointindex++] = pointmark(extralist[0]);
-        tlist[pointindex++] = pointmark(extralist[1]);
-        tlist[pointindex++] = pointmark(extralist[2]);
-        tlist[pointindex++] = pointmark(extralist[3]);
-        tlist[pointindex++] = pointmark(extralist[4]);
-        tlist[pointindex++] = pointmark(extralist[5]);
-      }
-      for (i = 0; i < eextras; i++) {
-        talist[attribindex++] = elemattribute(tptr, i);
-      }
+    tlist[pointindex++] = pointmark(p1);
+    tlist[pointindex++] = pointmark(p2);
+    tlist[pointindex++] = pointmark(p3);
+    tlist[pointindex++] = pointmark(p4);
+    if (b->order == 2) {
+      extralist = (point *) tptr[highorderindex];
+      tlist[pointindex++] = pointmark(extralist[0]);
+      tlist[pointindex++] = pointmark(extralist[1]);
+      tlist[pointindex++] = pointmark(extralist[2]);
+      tlist[pointindex++] = pointmark(extralist[3]);
+      tlist[pointindex++] = pointmark(extralist[4]);
+      tlist[pointindex++] = pointmark(extralist[5]);
+    }
+    for (i = 0; i < eextras; i++) {
+      talist[attribindex++] = elemattribute(tptr, i);
     }
     tptr = tetrahedrontraverse();
-    elementnumber++;
+    index++;
+    if ((out->visitor != (tetgenio::outputvisitor *) NULL) &&
+        ((index - first == chunk) || (tptr == (tetrahedron *) NULL))) {
+      // Stream a chunk of tetrahedra.
+      out->visitor->tetrahedra(out, (int) first, (int) (index - first));
+      first = index;
+      pointindex = 0;
+      attribindex = 0;
+    }
   }
 
-  if (out == (tetgenio *) NULL) {
-    fprintf(outfile, "# Generated by %s\n", b->commandline);
-    fclose(outfile);
+  if (out->visitor != (tetgenio::outputvisitor *) NULL) {
+    // The chunks are streamed, free the arrays.
+    delete [] out->tetrahedronlist;
+    out->tetrahedronlist = (int *) NULL;
+    if (out->tetrahedronattributelist != (REAL *) NULL) {
+      delete [] out->tetrahedronattributelist;
+      out->tetrahedronattributelist = (REAL *) NULL;
+    }
   }
 }
 
@@ -20116,6 +24826,7 @@ void tetgenmesh::outfaces(tetgenio* out)
 {
   FILE *outfile;
   char facefilename[FILENAMESIZE];
+  char outputline[OUTPUTLINESIZE], *s;
   int *elist;
   int *emlist;
   int index;
@@ -20124,6 +24835,7 @@ void tetgenmesh::outfaces(tetgenio* out)
   point torg, tdest, tapex;
   long faces;
   int bmark, faceid, marker;
+  long chunk, first;
   int facenumber;
 
   if (out == (tetgenio *) NULL) {
@@ -20148,17 +24860,24 @@ void tetgenmesh::outfaces(tetgenio* out)
       printf("File I/O Error:  Cannot create file %s.\n", facefilename);
       exit(1);
     }
+    setvbuf(outfile, (char *) NULL, _IOFBF, OUTPUTBUFFERSIZE);
     fprintf(outfile, "%ld  %d\n", faces, bmark);
   } else {
+    // The number of faces kept in the arrays at once.
+    chunk = faces;
+    if ((out->visitor != (tetgenio::outputvisitor *) NULL) &&
+        (out->visitor->chunksize > 0) && (out->visitor->chunksize < chunk)) {
+      chunk = out->visitor->chunksize;
+    }
     // Allocate memory for 'trifacelist'.
-    out->trifacelist = new int[faces * 3];
+    out->trifacelist = new int[chunk * 3];
     if (out->trifacelist == (int *) NULL) {
       printf("Error:  Out of memory.\n");
       exit(1);
     }
     // Allocate memory for 'trifacemarkerlist' if necessary.
     if (bmark) {
-      out->trifacemarkerlist = new int[faces];
+      out->trifacemarkerlist = new int[chunk];
       if (out->trifacemarkerlist == (int *) NULL) {
         printf("Error:  Out of memory.\n");
         exit(1);
@@ -20168,6 +24887,7 @@ void tetgenmesh::outfaces(tetgenio* out)
     elist = out->trifacelist;
     emlist = out->trifacemarkerlist;
     index = 0;
+    first = 0;
   }
 
   tetrahedrons->traversalinit();
@@ -20205,28 +24925,55 @@ void tetgenmesh::outfaces(tetgenio* out)
         }
         if (out == (tetgenio *) NULL) {
           // Face number, indices of three vertices.
-          fprintf(outfile, "%5d   %4d  %4d  %4d", facenumber,
-                  pointmark(torg), pointmark(tdest), pointmark(tapex));
+          s = tetgenio::formatint(outputline, "", facenumber, 5);
+          s = tetgenio::formatint(s, "   ", pointmark(torg), 4);
+          s = tetgenio::formatint(s, "  ", pointmark(tdest), 4);
+          s = tetgenio::formatint(s, "  ", pointmark(tapex), 4);
           if (bmark) {
             // Output a boundary marker.
-            fprintf(outfile, "  %d", marker);
+            s = tetgenio::formatint(s, "  ", marker, 0);
           }
-          fprintf(outfile, "\n");
+          strcpy(s, "\n");
+          fputs(outputline, outfile);
         } else {
           // Output indices of three vertices.
           elist[index++] = pointmark(torg);
           elist[index++] = pointmark(tdest);
           elist[index++] = pointmark(tapex);
           if (bmark) {
-            emlist[facenumber - in->firstnumber] = marker;
+            emlist[facenumber - in->firstnumber - first] = marker;
           }
         }
         facenumber++;
+        if ((out != (tetgenio *) NULL) &&
+            (out->visitor != (tetgenio::outputvisitor *) NULL) &&
+            (facenumber - in->firstnumber - first == chunk)) {
+          // Stream a chunk of faces.
+          out->visitor->trifaces(out, (int) first, (int) chunk);
+          first += chunk;
+          index = 0;
+        }
       }
     }
     tface.tet = tetrahedrontraverse();
   }
 
+  if ((out != (tetgenio *) NULL) &&
+      (out->visitor != (tetgenio::outputvisitor *) NULL)) {
+    if (facenumber - in->firstnumber > first) {
+      // Stream the last chunk of faces.
+      out->visitor->trifaces(out, (int) first,
+                             (int) (facenumber - in->firstnumber - first));
+    }
+    // The chunks are streamed, free the arrays.
+    delete [] out->trifacelist;
+    out->trifacelist = (int *) NULL;
+    if (out->trifacemarkerlist != (int *) NULL) {
+      delete [] out->trifacemarkerlist;
+      out->trifacemarkerlist = (int *) NULL;
+    }
+  }
+
   if (out == (tetgenio *) NULL) {
     fprintf(outfile, "# Generated by %s\n", b->commandline);
     fclose(outfile);
@@ -20248,11 +24995,13 @@ void tetgenmesh::outhullfaces(tetgenio* out)
 {
   FILE *outfile;
   char facefilename[FILENAMESIZE];
+  char outputline[OUTPUTLINESIZE], *s;
   int *elist;
   int index;
   triface tface, tsymface;
   face checkmark;
   point torg, tdest, tapex;
+  long chunk, first;
   int facenumber;
 
   if (out == (tetgenio *) NULL) {
@@ -20274,10 +25023,17 @@ void tetgenmesh::outhullfaces(tetgenio* out)
       printf("File I/O Error:  Cannot create file %s.\n", facefilename);
       exit(1);
     }
+    setvbuf(outfile, (char *) NULL, _IOFBF, OUTPUTBUFFERSIZE);
     fprintf(outfile, "%ld  0\n", hullsize);
   } else {
+    // The number of faces kept in the arrays at once.
+    chunk = hullsize;
+    if ((out->visitor != (tetgenio::outputvisitor *) NULL) &&
+        (out->visitor->chunksize > 0) && (out->visitor->chunksize < chunk)) {
+      chunk = out->visitor->chunksize;
+    }
     // Allocate memory for 'trifacelist'.
-    out->trifacelist = new int[hullsize * 3];
+    out->trifacelist = new int[chunk * 3];
     if (out->trifacelist == (int *) NULL) {
       printf("Error:  Out of memory.\n");
       exit(1);
@@ -20285,6 +25041,7 @@ void tetgenmesh::outhullfaces(tetgenio* out)
     out->numberoftrifaces = hullsize;
     elist = out->trifacelist;
     index = 0;
+    first = 0;
   }
 
   tetrahedrons->traversalinit();
@@ -20302,9 +25059,12 @@ void tetgenmesh::outhullfaces(tetgenio* out)
         tapex = apex(tface);
         if (out == (tetgenio *) NULL) {
           // Face number, indices of three vertices.
-          fprintf(outfile, "%5d   %4d  %4d  %4d", facenumber,
-                  pointmark(torg), pointmark(tdest), pointmark(tapex));
-          fprintf(outfile, "\n");
+          s = tetgenio::formatint(outputline, "", facenumber, 5);
+          s = tetgenio::formatint(s, "   ", pointmark(torg), 4);
+          s = tetgenio::formatint(s, "  ", pointmark(tdest), 4);
+          s = tetgenio::formatint(s, "  ", pointmark(tapex), 4);
+          strcpy(s, "\n");
+          fputs(outputline, outfile);
         } else {
           // Output indices of three vertices.
           elist[index++] = pointmark(torg);
@@ -20312,11 +25072,31 @@ void tetgenmesh::outhullfaces(tetgenio* out)
           elist[index++] = pointmark(tapex);
         }
         facenumber++;
+        if ((out != (tetgenio *) NULL) &&
+            (out->visitor != (tetgenio::outputvisitor *) NULL) &&
+            (facenumber - in->firstnumber - first == chunk)) {
+          // Stream a chunk of faces.
+          out->visitor->trifaces(out, (int) first, (int) chunk);
+          first += chunk;
+          index = 0;
+        }
       }
     }
     tface.tet = tetrahedrontraverse();
   }
 
+  if ((out != (tetgenio *) NULL) &&
+      (out->visitor != (tetgenio::outputvisitor *) NULL)) {
+    if (facenumber - in->firstnumber > first) {
+      // Stream the last chunk of faces.
+      out->visitor->trifaces(out, (int) first,
+                             (int) (facenumber - in->firstnumber - first));
+    }
+    // The chunks are streamed, free the arrays.
+    delete [] out->trifacelist;
+    out->trifacelist = (int *) NULL;
+  }
+
   if (out == (tetgenio *) NULL) {
     fprintf(outfile, "# Generated by %s\n", b->commandline);
     fclose(outfile);
@@ -20338,6 +25118,7 @@ void tetgenmesh::outsubfaces(tetgenio* out)
 {
   FILE *outfile;
   char facefilename[FILENAMESIZE];
+  char outputline[OUTPUTLINESIZE], *s;
   int *elist;
   int *emlist;
   int index;
@@ -20345,6 +25126,7 @@ void tetgenmesh::outsubfaces(tetgenio* out)
   face faceloop;
   point torg, tdest, tapex;
   int bmark, faceid, marker;
+  long chunk, first;
   int facenumber;
 
   if (out == (tetgenio *) NULL) {
@@ -20368,18 +25150,25 @@ void tetgenmesh::outsubfaces(tetgenio* out)
       printf("File I/O Error:  Cannot create file %s.\n", facefilename);
       exit(1);
     }
+    setvbuf(outfile, (char *) NULL, _IOFBF, OUTPUTBUFFERSIZE);
     // Number of subfaces.
     fprintf(outfile, "%ld  %d\n", subfaces->items, bmark);
   } else {
+    // The number of faces kept in the arrays at once.
+    chunk = subfaces->items;
+    if ((out->visitor != (tetgenio::outputvisitor *) NULL) &&
+        (out->visitor->chunksize > 0) && (out->visitor->chunksize < chunk)) {
+      chunk = out->visitor->chunksize;
+    }
     // Allocate memory for 'trifacelist'.
-    out->trifacelist = new int[subfaces->items * 3];
+    out->trifacelist = new int[chunk * 3];
     if (out->trifacelist == (int *) NULL) {
       printf("Error:  Out of memory.\n");
       exit(1);
     }
     // Allocate memory for 'trifacemarkerlist', if necessary.
     if (bmark) {
-      out->trifacemarkerlist = new int[subfaces->items];
+      out->trifacemarkerlist = new int[chunk];
       if (out->trifacemarkerlist == (int *) NULL) {
         printf("Error:  Out of memory.\n");
         exit(1);
@@ -20389,6 +25178,7 @@ void tetgenmesh::outsubfaces(tetgenio* out)
     elist = out->trifacelist;
     emlist = out->trifacemarkerlist;
     index = 0;
+    first = 0;
   }
 
   subfaces->traversalinit();
@@ -20420,31 +25210,144 @@ void tetgenmesh::outsubfaces(tetgenio* out)
       marker = in->facetmarkerlist[faceid];
     }
     if (out == (tetgenio *) NULL) {
-      fprintf(outfile, "%5d   %4d  %4d  %4d", facenumber,
-              pointmark(torg), pointmark(tdest), pointmark(tapex));
+      s = tetgenio::formatint(outputline, "", facenumber, 5);
+      s = tetgenio::formatint(s, "   ", pointmark(torg), 4);
+      s = tetgenio::formatint(s, "  ", pointmark(tdest), 4);
+      s = tetgenio::formatint(s, "  ", pointmark(tapex), 4);
       if (bmark) {
-        fprintf(outfile, "    %d", marker);
+        s = tetgenio::formatint(s, "    ", marker, 0);
       }
-      fprintf(outfile, "\n");
+      strcpy(s, "\n");
+      fputs(outputline, outfile);
     } else {
       // Output three vertices of this face;
       elist[index++] = pointmark(torg);
       elist[index++] = pointmark(tdest);
       elist[index++] = pointmark(tapex);
       if (bmark) {
-        emlist[facenumber - in->firstnumber] = marker;
+        emlist[facenumber - in->firstnumber - first] = marker;
       }
     }
     facenumber++;
+    if ((out != (tetgenio *) NULL) &&
+        (out->visitor != (tetgenio::outputvisitor *) NULL) &&
+        (facenumber - in->firstnumber - first == chunk)) {
+      // Stream a chunk of faces.
+      out->visitor->trifaces(out, (int) first, (int) chunk);
+      first += chunk;
+      index = 0;
+    }
     faceloop.sh = shellfacetraverse(subfaces);
   }
 
+  if ((out != (tetgenio *) NULL) &&
+      (out->visitor != (tetgenio::outputvisitor *) NULL)) {
+    if (facenumber - in->firstnumber > first) {
+      // Stream the last chunk of faces.
+      out->visitor->trifaces(out, (int) first,
+                             (int) (facenumber - in->firstnumber - first));
+    }
+    // The chunks are streamed, free the arrays.
+    delete [] out->trifacelist;
+    out->trifacelist = (int *) NULL;
+    if (out->trifacemarkerlist != (int *) NULL) {
+      delete [] out->trifacemarkerlist;
+      out->trifacemarkerlist = (int *) NULL;
+    }
+  }
+
   if (out == (tetgenio *) NULL) {
     fprintf(outfile, "# Generated by %s\n", b->commandline);
     fclose(outfile);
   }
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// outintersections()    Output the pairs of intersecting faces found by     //
+//                       detectinterfaces() to a .inter.json file.           //
+//                                                                           //
+// For each pair in 'interpairlist', the file gives the type ("intersect" or //
+// "shareface", as recorded by interfacepair()),  the facets of the two      //
+// faces (with their markers if there are facet markers), the vertices of    //
+// the two faces (the same indices as in the .node and .face files), and the //
+// segment where they meet (computed by triangle_triangle_segment()).  The   //
+// segment is null if the two faces are coplanar.  It is meant to be read by //
+// other programs, so they don't need to test the faces in the .face file    //
+// again.                                                                    //
+//                                                                           //
+// There is no place for the report in 'tetgenio', so nothing is done if     //
+// 'out' is not NULL.                                                        //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::outintersections(tetgenio* out)
+{
+  FILE *outfile;
+  char interfilename[FILENAMESIZE];
+  interpair *pair;
+  face sface[2];
+  point p[2][3];
+  REAL S1[3], S2[3];
+  int bmark, i, j;
+
+  if ((out != (tetgenio *) NULL) || (interpairlist == (list *) NULL)) {
+    return;
+  }
+
+  strcpy(interfilename, b->outfilename);
+  strcat(interfilename, ".inter.json");
+
+  if (!b->quiet) {
+    printf("Writing %s.\n", interfilename);
+  }
+
+  bmark = !b->nobound && in->facetmarkerlist;
+
+  outfile = fopen(interfilename, "w");
+  if (outfile == (FILE *) NULL) {
+    printf("File I/O Error:  Cannot create file %s.\n", interfilename);
+    exit(1);
+  }
+  fprintf(outfile, "{\n  \"numberofpairs\": %d,\n  \"pairs\": [",
+          interpairlist->len());
+
+  for (i = 0; i < interpairlist->len(); i++) {
+    pair = (interpair *) (* interpairlist)[i];
+    for (j = 0; j < 2; j++) {
+      sface[j].sh = pair->sh[j];
+      sface[j].shver = 0;
+      p[j][0] = sorg(sface[j]);
+      p[j][1] = sdest(sface[j]);
+      p[j][2] = sapex(sface[j]);
+    }
+    fprintf(outfile, "%s\n    {\"type\": \"%s\",", i > 0 ? "," : "",
+            pair->type == SHAREFACE ? "shareface" : "intersect");
+    fprintf(outfile, " \"facets\": [%d, %d],", mark(sface[0]),
+            mark(sface[1]));
+    if (bmark) {
+      fprintf(outfile, " \"markers\": [%d, %d],",
+              in->facetmarkerlist[mark(sface[0]) - 1],
+              in->facetmarkerlist[mark(sface[1]) - 1]);
+    }
+    fprintf(outfile, "\n     \"triangles\": [[%d, %d, %d], [%d, %d, %d]],",
+            pointmark(p[0][0]), pointmark(p[0][1]), pointmark(p[0][2]),
+            pointmark(p[1][0]), pointmark(p[1][1]), pointmark(p[1][2]));
+    if ((pair->type == INTERSECT) &&
+        triangle_triangle_segment(p[0][0], p[0][1], p[0][2], p[1][0],
+                                  p[1][1], p[1][2], S1, S2)) {
+      fprintf(outfile, "\n     \"segment\": [[%.17g, %.17g, %.17g],", S1[0],
+              S1[1], S1[2]);
+      fprintf(outfile, " [%.17g, %.17g, %.17g]]}", S2[0], S2[1], S2[2]);
+    } else {
+      fprintf(outfile, "\n     \"segment\": null}");
+    }
+  }
+
+  fprintf(outfile, "\n  ]\n}\n");
+  fclose(outfile);
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // outsubsegments()    Output segments (i.e. boundary edges) to a .edge file //
@@ -20458,6 +25361,7 @@ void tetgenmesh::outsubsegments(tetgenio* out)
 {
   FILE *outfile;
   char edgefilename[FILENAMESIZE];
+  char outputline[OUTPUTLINESIZE], *s;
   int *elist;
   int index;
   face edgeloop;
@@ -20483,6 +25387,7 @@ void tetgenmesh::outsubsegments(tetgenio* out)
       printf("File I/O Error:  Cannot create file %s.\n", edgefilename);
       exit(1);
     }
+    setvbuf(outfile, (char *) NULL, _IOFBF, OUTPUTBUFFERSIZE);
     // Number of subsegments.
     fprintf(outfile, "%ld\n", subsegs->items);
   } else {
@@ -20504,8 +25409,11 @@ void tetgenmesh::outsubsegments(tetgenio* out)
     torg = sorg(edgeloop);
     tdest = sdest(edgeloop);
     if (out == (tetgenio *) NULL) {
-      fprintf(outfile, "%5d   %4d  %4d\n", edgenumber, pointmark(torg),
-              pointmark(tdest));
+      s = tetgenio::formatint(outputline, "", edgenumber, 5);
+      s = tetgenio::formatint(s, "   ", pointmark(torg), 4);
+      s = tetgenio::formatint(s, "  ", pointmark(tdest), 4);
+      strcpy(s, "\n");
+      fputs(outputline, outfile);
     } else {
       // Output three vertices of this face;
       elist[index++] = pointmark(torg);
@@ -20537,6 +25445,7 @@ void tetgenmesh::outneighbors(tetgenio* out)
   tetrahedron *tptr;
   triface tetloop, tetsym;
   int neighbor1, neighbor2, neighbor3, neighbor4;
+  long chunk, first;
   int elementnumber;
 
   if (out == (tetgenio *) NULL) {
@@ -20558,17 +25467,25 @@ void tetgenmesh::outneighbors(tetgenio* out)
       printf("File I/O Error:  Cannot create file %s.\n", neighborfilename);
       exit(1);
     }
+    setvbuf(outfile, (char *) NULL, _IOFBF, OUTPUTBUFFERSIZE);
     // Number of tetrahedra, four faces per tetrahedron.
     fprintf(outfile, "%ld  %d\n", tetrahedrons->items, 4);
   } else {
+    // The number of tetrahedra kept in the arrays at once.
+    chunk = tetrahedrons->items;
+    if ((out->visitor != (tetgenio::outputvisitor *) NULL) &&
+        (out->visitor->chunksize > 0) && (out->visitor->chunksize < chunk)) {
+      chunk = out->visitor->chunksize;
+    }
     // Allocate memory for 'neighborlist'.
-    out->neighborlist = new int[tetrahedrons->items * 4];
+    out->neighborlist = new int[chunk * 4];
     if (out->neighborlist == (int *) NULL) {
       printf("Error:  Out of memory.\n");
       exit(1);
     }
     nlist = out->neighborlist;
     index = 0;
+    first = 0;
   }
 
   tetrahedrons->traversalinit();
@@ -20581,9 +25498,16 @@ void tetgenmesh::outneighbors(tetgenio* out)
   }
   * (int *) (dummytet + 8) = -1;
 
+  if (out == (tetgenio *) NULL) {
+    // Tetrahedra number, neighboring tetrahedron numbers.
+    writepool(outfile, tetrahedrons, NEIGHBORLINES);
+    fprintf(outfile, "# Generated by %s\n", b->commandline);
+    fclose(outfile);
+    return;
+  }
+
   tetrahedrons->traversalinit();
   tetloop.tet = tetrahedrontraverse();
-  elementnumber = in->firstnumber;
   while (tetloop.tet != (tetrahedron *) NULL) {
     tetloop.loc = 2;
     sym(tetloop, tetsym);
@@ -20597,23 +25521,24 @@ void tetgenmesh::outneighbors(tetgenio* out)
     tetloop.loc = 0;
     sym(tetloop, tetsym);
     neighbor4 = * (int *) (tetsym.tet + 8);
-    if (out == (tetgenio *) NULL) {
-      // Tetrahedra number, neighboring tetrahedron numbers.
-      fprintf(outfile, "%4d    %4d  %4d  %4d  %4d\n", elementnumber,
-              neighbor1, neighbor2, neighbor3, neighbor4);
-    } else {
-      nlist[index++] = neighbor1;
-      nlist[index++] = neighbor2;
-      nlist[index++] = neighbor3;
-      nlist[index++] = neighbor4;
-    }
+    nlist[index++] = neighbor1;
+    nlist[index++] = neighbor2;
+    nlist[index++] = neighbor3;
+    nlist[index++] = neighbor4;
     tetloop.tet = tetrahedrontraverse();
-    elementnumber++;
+    if ((out->visitor != (tetgenio::outputvisitor *) NULL) &&
+        ((index == 4 * chunk) || (tetloop.tet == (tetrahedron *) NULL))) {
+      // Stream a chunk of neighbors.
+      out->visitor->neighbors(out, (int) first, index / 4);
+      first += index / 4;
+      index = 0;
+    }
   }
 
-  if (out == (tetgenio *) NULL) {
-    fprintf(outfile, "# Generated by %s\n", b->commandline);
-    fclose(outfile);
+  if (out->visitor != (tetgenio::outputvisitor *) NULL) {
+    // The chunks are streamed, free the arrays.
+    delete [] out->neighborlist;
+    out->neighborlist = (int *) NULL;
   }
 }
 
@@ -20979,6 +25904,316 @@ void tetgenmesh::outmesh2off(char* ofilename)
   fclose(outfile);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// outmesh2io()    Collect the mesh into a 'tetgenio' for a file writer.     //
+//                                                                           //
+// The nodes, elements and boundary faces are output to 'out' the same way   //
+// as they are returned to a calling program.  It is used by outmesh2binary()//
+// and outmesh2msh(), the files are then written by the 'tetgenio'.          //
+//                                                                           //
+// The points are numbered from 'in->firstnumber', the numbers are written   //
+// over the point markers (other outputs, e.g., -g, may have changed them).  //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::outmesh2io(tetgenio* out)
+{
+  point pointloop;
+  int pointnumber;
+  int quiet;
+
+  // Number the points, the elements and faces refer to these numbers.
+  points->traversalinit();
+  pointloop = pointtraverse();
+  pointnumber = in->firstnumber;
+  while (pointloop != (point) NULL) {
+    setpointmark(pointloop, pointnumber);
+    pointloop = pointtraverse();
+    pointnumber++;
+  }
+
+  out->firstnumber = in->firstnumber;
+  out->mesh_dim = 3;
+  // Do not report the intermediate steps.
+  quiet = b->quiet;
+  b->quiet = 1;
+  outnodes(out);
+  if (tetrahedrons->items > 0l) {
+    outelements(out);
+    if (b->plc || b->refine) {
+      outsubfaces(out);
+    } else {
+      outhullfaces(out);
+    }
+  }
+  b->quiet = quiet;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// outmesh2binary()    Write the mesh to a binary .tgb file.                 //
+//                                                                           //
+// The mesh is collected by outmesh2io() and written by tetgenio::save_-     //
+// binary().  Use -r to read the file back.                                  //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::outmesh2binary(char* bfilename)
+{
+  tetgenio io;
+  char binfilename[FILENAMESIZE];
+
+  if (bfilename != (char *) NULL && bfilename[0] != '\0') {
+    strcpy(binfilename, bfilename);
+  } else if (b->outfilename[0] != '\0') {
+    strcpy(binfilename, b->outfilename);
+  } else {
+    strcpy(binfilename, "unnamed");
+  }
+
+  if (!b->quiet) {
+    printf("Writing %s.tgb.\n", binfilename);
+  }
+
+  outmesh2io(&io);
+  io.save_binary(binfilename);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// outmesh2msh()    Write the mesh to a binary .msh file.                    //
+//                                                                           //
+// The mesh is collected by outmesh2io() and written by tetgenio::save_msh().//
+// The file can be opened by Gmsh, or read back with -r.                     //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::outmesh2msh(char* mfilename)
+{
+  tetgenio io;
+  char mshfilename[FILENAMESIZE];
+
+  if (mfilename != (char *) NULL && mfilename[0] != '\0') {
+    strcpy(mshfilename, mfilename);
+  } else if (b->outfilename[0] != '\0') {
+    strcpy(mshfilename, b->outfilename);
+  } else {
+    strcpy(mshfilename, "unnamed");
+  }
+
+  if (!b->quiet) {
+    printf("Writing %s.msh.\n", mshfilename);
+  }
+
+  outmesh2io(&io);
+  io.save_msh(mshfilename);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+//                                                                           //
+// outmesh2vtu()    Write the mesh to a .vtu file.                           //
+//                                                                           //
+// .vtu is the XML format of VTK for unstructured grids, it is read by       //
+// ParaView and VisIt (http://www.vtk.org).  All arrays are written as raw   //
+// binary appended data:  the XML header lists the arrays with their offsets //
+// into the data block, which follows the '_' after <AppendedData>.  Each    //
+// array is preceded by its size in bytes (a 64-bit integer).  The arrays    //
+// are, in this order, the point coordinates, the connectivity, offsets and  //
+// types of the cells, the point markers, the point attributes and the       //
+// tetrahedron attributes (the last three only if they exist).  The data are //
+// written in the byte order of this machine, which is given in the header.  //
+//                                                                           //
+// The points are numbered from zero (as VTK requires), the numbers are      //
+// written over the point markers.  For '-o2' the cells are VTK's quadratic  //
+// tetrahedra, whose edge nodes are in the same order as in the .ele file.   //
+//                                                                           //
+///////////////////////////////////////////////////////////////////////////////
+
+void tetgenmesh::outmesh2vtu(char* vfilename)
+{
+  FILE *outfile;
+  char vtufilename[FILENAMESIZE];
+  const char *realtype;
+  tetrahedron* tptr;
+  point pointloop, *extralist;
+  unsigned long long size, offset;
+  unsigned char celltype;
+  int nextras, eextras, bmark;
+  int corners, pointnumber, cellnode[10], endian;
+  int i;
+
+  if (vfilename != (char *) NULL && vfilename[0] != '\0') {
+    strcpy(vtufilename, vfilename);
+  } else if (b->outfilename[0] != '\0') {
+    strcpy(vtufilename, b->outfilename);
+  } else {
+    strcpy(vtufilename, "unnamed");
+  }
+  strcat(vtufilename, ".vtu");
+
+  if (!b->quiet) {
+    printf("Writing %s.\n", vtufilename);
+  }
+  outfile = fopen(vtufilename, "wb");
+  if (outfile == (FILE *) NULL) {
+    printf("File I/O Error:  Cannot create file %s.\n", vtufilename);
+    return;
+  }
+
+  nextras = in->numberofpointattributes;
+  eextras = in->numberoftetrahedronattributes;
+  bmark = !b->nobound && in->pointmarkerlist;
+  corners = b->order == 1 ? 4 : 10;
+  // VTK_TETRA or VTK_QUADRATIC_TETRA.
+  celltype = b->order == 1 ? 10 : 24;
+  realtype = sizeof(REAL) == 8 ? "Float64" : "Float32";
+  endian = 1;
+
+  fprintf(outfile, "<?xml version=\"1.0\"?>\n");
+  fprintf(outfile, "<!-- Generated by %s -->\n", b->commandline);
+  fprintf(outfile, "<VTKFile type=\"UnstructuredGrid\" version=\"1.0\" "
+          "byte_order=\"%s\" header_type=\"UInt64\">\n",
+          * (char *) &endian == 1 ? "LittleEndian" : "BigEndian");
+  fprintf(outfile, "  <UnstructuredGrid>\n");
+  fprintf(outfile, "    <Piece NumberOfPoints=\"%ld\" "
+          "NumberOfCells=\"%ld\">\n", points->items, tetrahedrons->items);
+  // The offset of each array is the sum of the sizes of the ones before it.
+  offset = 0;
+  fprintf(outfile, "      <Points>\n");
+  fprintf(outfile, "        <DataArray type=\"%s\" NumberOfComponents=\"3\" "
+          "format=\"appended\" offset=\"%llu\"/>\n", realtype, offset);
+  offset += 8 + (unsigned long long) points->items * 3 * sizeof(REAL);
+  fprintf(outfile, "      </Points>\n");
+  fprintf(outfile, "      <Cells>\n");
+  fprintf(outfile, "        <DataArray type=\"Int32\" Name=\"connectivity\" "
+          "format=\"appended\" offset=\"%llu\"/>\n", offset);
+  offset += 8 + (unsigned long long) tetrahedrons->items * corners * 4;
+  fprintf(outfile, "        <DataArray type=\"Int32\" Name=\"offsets\" "
+          "format=\"appended\" offset=\"%llu\"/>\n", offset);
+  offset += 8 + (unsigned long long) tetrahedrons->items * 4;
+  fprintf(outfile, "        <DataArray type=\"UInt8\" Name=\"types\" "
+          "format=\"appended\" offset=\"%llu\"/>\n", offset);
+  offset += 8 + (unsigned long long) tetrahedrons->items;
+  fprintf(outfile, "      </Cells>\n");
+  if (bmark || (nextras > 0)) {
+    fprintf(outfile, "      <PointData>\n");
+    if (bmark) {
+      fprintf(outfile, "        <DataArray type=\"Int32\" Name=\"marker\" "
+              "format=\"appended\" offset=\"%llu\"/>\n", offset);
+      offset += 8 + (unsigned long long) points->items * 4;
+    }
+    if (nextras > 0) {
+      fprintf(outfile, "        <DataArray type=\"%s\" Name=\"attribute\" "
+              "NumberOfComponents=\"%d\" format=\"appended\" "
+              "offset=\"%llu\"/>\n", realtype, nextras, offset);
+      offset += 8 + (unsigned long long) points->items * nextras *
+        sizeof(REAL);
+    }
+    fprintf(outfile, "      </PointData>\n");
+  }
+  if (eextras > 0) {
+    fprintf(outfile, "      <CellData>\n");
+    fprintf(outfile, "        <DataArray type=\"%s\" Name=\"attribute\" "
+            "NumberOfComponents=\"%d\" format=\"appended\" "
+            "offset=\"%llu\"/>\n", realtype, eextras, offset);
+    fprintf(outfile, "      </CellData>\n");
+  }
+  fprintf(outfile, "    </Piece>\n");
+  fprintf(outfile, "  </UnstructuredGrid>\n");
+  fprintf(outfile, "  <AppendedData encoding=\"raw\">\n");
+  fprintf(outfile, "_");
+
+  // Point coordinates.  Number the points from zero.
+  size = (unsigned long long) points->items * 3 * sizeof(REAL);
+  fwrite(&size, sizeof(size), 1, outfile);
+  points->traversalinit();
+  pointloop = pointtraverse();
+  pointnumber = 0;
+  while (pointloop != (point) NULL) {
+    fwrite(pointloop, sizeof(REAL), 3, outfile);
+    setpointmark(pointloop, pointnumber);
+    pointloop = pointtraverse();
+    pointnumber++;
+  }
+
+  // Connectivity of the cells.
+  size = (unsigned long long) tetrahedrons->items * corners * 4;
+  fwrite(&size, sizeof(size), 1, outfile);
+  tetrahedrons->traversalinit();
+  tptr = tetrahedrontraverse();
+  while (tptr != (tetrahedron *) NULL) {
+    for (i = 0; i < 4; i++) {
+      cellnode[i] = pointmark((point) tptr[4 + i]);
+    }
+    if (b->order == 2) {
+      extralist = (point *) tptr[highorderindex];
+      for (i = 0; i < 6; i++) {
+        cellnode[4 + i] = pointmark(extralist[i]);
+      }
+    }
+    fwrite(cellnode, sizeof(int), corners, outfile);
+    tptr = tetrahedrontraverse();
+  }
+
+  // Offsets (the end of each cell in the connectivity) and types.
+  size = (unsigned long long) tetrahedrons->items * 4;
+  fwrite(&size, sizeof(size), 1, outfile);
+  for (i = 1; i <= tetrahedrons->items; i++) {
+    cellnode[0] = i * corners;
+    fwrite(cellnode, sizeof(int), 1, outfile);
+  }
+  size = (unsigned long long) tetrahedrons->items;
+  fwrite(&size, sizeof(size), 1, outfile);
+  for (i = 0; i < tetrahedrons->items; i++) {
+    fwrite(&celltype, sizeof(unsigned char), 1, outfile);
+  }
+
+  if (bmark) {
+    // Point markers.
+    size = (unsigned long long) points->items * 4;
+    fwrite(&size, sizeof(size), 1, outfile);
+    points->traversalinit();
+    pointloop = pointtraverse();
+    pointnumber = 0;
+    while (pointloop != (point) NULL) {
+      cellnode[0] = outpointmarker(pointloop, pointnumber);
+      fwrite(cellnode, sizeof(int), 1, outfile);
+      pointloop = pointtraverse();
+      pointnumber++;
+    }
+  }
+
+  if (nextras > 0) {
+    // Point attributes.
+    size = (unsigned long long) points->items * nextras * sizeof(REAL);
+    fwrite(&size, sizeof(size), 1, outfile);
+    points->traversalinit();
+    pointloop = pointtraverse();
+    while (pointloop != (point) NULL) {
+      fwrite(&pointloop[3], sizeof(REAL), nextras, outfile);
+      pointloop = pointtraverse();
+    }
+  }
+
+  if (eextras > 0) {
+    // Tetrahedron attributes.
+    size = (unsigned long long) tetrahedrons->items * eextras * sizeof(REAL);
+    fwrite(&size, sizeof(size), 1, outfile);
+    tetrahedrons->traversalinit();
+    tptr = tetrahedrontraverse();
+    while (tptr != (tetrahedron *) NULL) {
+      fwrite(&((REAL *) tptr)[elemattribindex], sizeof(REAL), eextras,
+             outfile);
+      tptr = tetrahedrontraverse();
+    }
+  }
+
+  fprintf(outfile, "\n  </AppendedData>\n");
+  fprintf(outfile, "</VTKFile>\n");
+  fclose(outfile);
+}
+
 //
 // End of I/O rouitnes
 //
@@ -21076,6 +26311,10 @@ void tetgenmesh::checkmesh()
     }
     tetraloop.tet = tetrahedrontraverse();
   }
+  if (flip22stops > 0l) {
+    printf("  !! !! Coplanar flips were stopped %ld times.\n", flip22stops);
+    horrors++;
+  }
   if (horrors == 0) {
     if (!b->quiet) {
       printf("  In my studied opinion, the mesh appears to be consistent.\n");
@@ -21754,6 +26993,18 @@ tetgenmesh::~tetgenmesh()
   if (liftpointarray != (REAL *) NULL) {
     delete [] liftpointarray;
   }
+  if (liftaxisarray != (int *) NULL) {
+    delete [] liftaxisarray;
+  }
+  if (interpairlist != (list *) NULL) {
+    delete interpairlist;
+  }
+  if (facetvertexlist != (list *) NULL) {
+    delete facetvertexlist;
+  }
+  if (shellfacelog != (list *) NULL) {
+    delete shellfacelog;
+  }
   if (highordertable != (point *) NULL) {
     delete [] highordertable;
   }
@@ -21786,6 +27037,10 @@ tetgenmesh::tetgenmesh()
   dummyshbase = (shellface *) NULL;
 
   liftpointarray = (REAL *) NULL;
+  liftaxisarray = (int *) NULL;
+  interpairlist = (list *) NULL;
+  facetvertexlist = (list *) NULL;
+  shellfacelog = (list *) NULL;
   highordertable = (point *) NULL;
 
   xmax = xmin = ymax = ymin = zmax = zmin = 0.0; 
@@ -21797,12 +27052,19 @@ tetgenmesh::tetgenmesh()
   highorderindex = 0;
   elemattribindex = 0;
   volumeboundindex = 0;
+  sphereindex = 0;
   checksubfaces = 0;
   nonconvex = 0;
   samples = 0l;
   randomseed = 0l;
   macheps = 0.0;
   flip23s = flip32s = flip22s = flip44s = 0l;
+  flip22stops = 0l;
+  refinestart = 0.0;
+  refinepoints = 0l;
+  refinestopped = 0;
+  roundtets = (tetrahedron **) NULL;
+  roundtetsize = roundtetcount = 0;
 }
 
 //
@@ -21837,8 +27099,6 @@ tetgenmesh::tetgenmesh()
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
-#include <time.h>           // Defined type clock_t, constant CLOCKS_PER_SEC.
-
 void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out)
 {
   tetgenmesh m;
@@ -21976,6 +27236,9 @@ void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out)
     m.highorder();
   }
 
+  // The output is timed from here (not including highorder()).
+  tv8 = clock();
+
   if (!b->quiet) {
     printf("\n");
   }
@@ -22027,6 +27290,7 @@ void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out)
         if (m.subfaces->items > 0l) {
           // Only output when there are intersecting faces.
           m.outsubfaces(out);
+          m.outintersections(out);
         }
       } else if (b->plc || b->refine) {
         // Output boundary faces.
@@ -22056,13 +27320,25 @@ void tetrahedralize(tetgenbehavior *b, tetgenio *in, tetgenio *out)
     m.outmesh2off(b->outfilename); 
   }
 
+  if (!out && b->binaryout) {
+    m.outmesh2binary(b->outfilename);
+  }
+
+  if (!out && b->gmshout) {
+    m.outmesh2msh(b->outfilename);
+  }
+
+  if (!out && b->vtkview) {
+    m.outmesh2vtu(b->outfilename);
+  }
+
   if (b->neighbors) {
     m.outneighbors(out);
   }
 
   if (!b->quiet) {
     tv7 = clock();
-    printf("\nOutput seconds:  %g\n", (tv7 - tv6) / (REAL) CLOCKS_PER_SEC);
+    printf("\nOutput seconds:  %g\n", (tv7 - tv8) / (REAL) CLOCKS_PER_SEC);
     printf("Total running seconds:  %g\n",
            (tv7 - tv0) / (REAL) CLOCKS_PER_SEC);
   }
@@ -22117,7 +27393,15 @@ void tetrahedralize(char *switches, tetgenio *in, tetgenio *out)
   if (!b.parse_commandline(argc, argv)) {
     exit(1);
   }
-  if (b.refine) {
+  if (b.object == tetgenbehavior::BINMESH) {
+    if (!in.load_binary(b.infilename)) {
+      exit(1);
+    }
+  } else if (b.refine && (b.object == tetgenbehavior::GMSH)) {
+    if (!in.load_msh(b.infilename, 1)) {
+      exit(1);
+    }
+  } else if (b.refine) {
     if (!in.load_tetmesh(b.infilename)) {
       exit(1);
     }
@@ -22126,6 +27410,9 @@ void tetrahedralize(char *switches, tetgenio *in, tetgenio *out)
       exit(1);
     }
   }
+  // The input points and tetrahedra are not needed once they are copied
+  //   into the mesh.
+  in.handover = 1;
   tetrahedralize(&b, &in, NULL);
 
   return 0;
@@ -139,13 +139,27 @@
   #define REAL double
 #endif 	// not defined SINGLE
 
+// To let some stages of TetGen run in several threads (see the -t switch),
+//   define the symbol PTHREADS by using the -DPTHREADS compiler switch and
+//   link with the POSIX threads library (-pthread or -lpthread).  Without it,
+//   TetGen always runs in one thread.
+
+// #define PTHREADS
+
 // Here is the most general used head files for all C/C++ codes
 
 #include <stdio.h>                  // standard IO: FILE, NULL (*), EOF, ...
 #include <stdlib.h>        // standard lib: abort(), system(), getenv(), ...
 #include <string.h>       // declarations for string manipulation functions.
 #include <math.h>                     // math lib: sin(), sqrt(), pow(), ...
+#include <float.h>                  // LDBL_MANT_DIG, properties of REALs.
+#include <limits.h>                    // INT_MAX, limits of the integer types.
 #include <assert.h>
+#include <time.h>            // Types clock_t, time_t, constant CLOCKS_PER_SEC.
+#include <sys/time.h>                     // gettimeofday(), struct timeval.
+#ifdef PTHREADS
+#include <pthread.h>        // POSIX threads: pthread_create(), pthread_join().
+#endif
  
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
@@ -196,6 +210,12 @@ class tetgenio {
     // Maxi. numbers of chars in a line read from a file (incl. the null).
     enum {INPUTLINESIZE = 1024};
 
+    // Size of the buffer in which a line written to a file is assembled.
+    enum {OUTPUTLINESIZE = 1024};
+
+    // Size of the stdio buffer of a file which is written line by line.
+    enum {OUTPUTBUFFERSIZE = 1048576};
+
     // The polygon data structure.  A "polygon" is a planar polygon. It can
     //   be arbitrary shaped (convex or non-convex) and bounded by non-
     //   crossing segments, i.e., the number of vertices it has indictes the
@@ -231,6 +251,28 @@ class tetgenio {
       f->numberofholes = 0;
     }
 
+    // The output visitor data structure.  It receives the output of
+    //   tetrahedralize() in chunks instead of the whole arrays, so the
+    //   output is never held in memory at once.  Derive a class from it
+    //   and overwrite the routines of the items wanted.  Each routine is
+    //   called with the items 'first', ..., 'first' + 'count' - 1 (counted
+    //   from zero), at most 'chunksize' of them.  During the call, they are
+    //   in the arrays of 'io' (e.g., 'io->pointlist' for nodes()), and the
+    //   'numberof' fields of 'io' are the total numbers of the items.  The
+    //   arrays are reused for the next chunk and are freed after the last.
+    //   Points, tetrahedra, faces and neighbors are streamed.  Edges are
+    //   output to the arrays as usual.
+    class outputvisitor {
+      public:
+        int chunksize;
+        outputvisitor() {chunksize = 4096;}
+        virtual ~outputvisitor() {}
+        virtual void nodes(tetgenio*, int, int) {}
+        virtual void tetrahedra(tetgenio*, int, int) {}
+        virtual void trifaces(tetgenio*, int, int) {}
+        virtual void neighbors(tetgenio*, int, int) {}
+    };
+
   public:
 
     // Items are numbered starting from 'firstnumber' (0 or 1), default is 0.
@@ -315,6 +357,19 @@ class tetgenio {
     int *edgemarkerlist;
     int numberofedges;
 
+    // 'handover':  If it is set, the input arrays of points and tetrahedra
+    //   are handed over to TetGen.  'pointlist' and 'pointattributelist'
+    //   are freed as soon as the points are copied into the mesh, and
+    //   'tetrahedronlist', 'tetrahedronattributelist' and 'tetrahedron-
+    //   volumelist' as soon as the mesh is reconstructed (-r).  They are
+    //   set to NULL, the 'numberof' fields are kept.  Default is 0, the
+    //   arrays are kept for the caller.
+    int handover;
+
+    // 'visitor':  If it is not NULL, the output of tetrahedralize() is
+    //   streamed to it (see 'outputvisitor').  Not freed by deinitialize().
+    outputvisitor *visitor;
+
   public:
 
     // Initialize routine.
@@ -329,21 +384,33 @@ class tetgenio {
     bool load_off(char* filename);
     bool load_ply(char* filename);
     bool load_medit(char* filename);
+    bool load_stl(char* filename);
+    bool load_msh(char* filename, int mesh);
     bool load_gid(char* filename);
     bool load_plc(char* filename, int object);
     bool load_tetmesh(char* filename);
+    bool load_binary(char* filename);
     void save_nodes(char* filename);
     void save_elements(char* filename);
     void save_faces(char* filename);
     void save_edges(char* filename);
     void save_neighbors(char* filename);
     void save_poly(char* filename);
+    void save_binary(char* filename);
+    void save_msh(char* filename);
 
     // Read line and parse string functions.
     char *readline(char* string, FILE* infile, int *linenumber);
     char *findnextfield(char* string);
     char *readnumberline(char* string, FILE* infile, char* infilename);
     char *findnextnumber(char* string);
+    static bool decimal2double(unsigned long long mantissa, int exponent,
+                               double* result);
+    REAL parsereal(char* string, char** endptr);
+    int parseint(char* string, char** endptr);
+    static char *formatreal(char* string, const char* prefix, REAL value);
+    static char *formatint(char* string, const char* prefix, int value,
+                           int width);
 
     // Constructor and destructor.
     tetgenio() {initialize();}
@@ -383,12 +450,17 @@ class tetgenbehavior {
     //     - OFF, a polyhedron (.off, Geomview's file format); 
     //     - PLY, a polyhedron (.ply, file format from gatech);
     //     - MEDIT, a surface mesh (.mesh, Medit's file format); 
-    //     - GID, a surface mesh (.msh, GID's mesh file format).
+    //     - STL, a surface mesh (.stl, ASCII or binary stereolithography);
+    //     - GID, a surface mesh (GID's mesh file format).
+    //     - GMSH, a surface mesh, or a tetrahedral mesh with -r (.msh,
+    //       Gmsh's file format).
     //     - MESH, a tetrahedral mesh (.ele).
+    //     - BINMESH, a tetrahedral mesh in one binary file (.tgb).
     //   If no extension is available, the imposed commandline switch
     //   (-p or -r) implies the object. 
 
-    enum objecttype {NONE, NODES, POLY, OFF, PLY, MEDIT, GID, MESH};
+    enum objecttype {NONE, NODES, POLY, OFF, PLY, MEDIT, GID, MESH, BINMESH,
+                     STL, GMSH};
 
     // Variables of command line switches.  After each variable are the 
     //   corresponding switch and its default value.  Read the user's manul
@@ -418,6 +490,9 @@ class tetgenbehavior {
     int meditview;                                        // '-g' switch, 0.
     int gidview;                                          // '-G' switch, 0.
     int geomview;                                         // '-O' switch, 0.
+    int binaryout;                                        // '-b' switch, 0.
+    int vtkview;                                          // '-K' switch, 0.
+    int gmshout;                                          // '-m' switch, 0.
     int nobound;                                          // '-B' switch, 0.
     int nonodewritten;                                    // '-N' switch, 0.
     int noelewritten;                                     // '-E' switch, 0.
@@ -426,8 +501,14 @@ class tetgenbehavior {
     int nobisect;          // count of how often '-Y' switch is selected, 0.
     int noflip;                     // do not perform flips. '-Y' switch. 0.
     int docheck;                                          // '-C' switch, 0.
+    int prioritysubs;                                     // '-R' switch, 0.
+    int offcenter;                                        // '-u' switch, 0.
+    long steiner;                         // number after '-S' switch, -1.
+    int cachesphere;                                      // '-k' switch, 0.
+    REAL maxtime;                         // number after '-w' switch, 0.0.
     int quiet;                                            // '-Q' switch, 0.
     int verbose;           // count of how often '-V' switch is selected, 0.
+    int numthreads;                       // number after '-t' switch, 1.
     int useshelles;              // '-p', '-r', '-q', 'd', or 'c' switch, 0.
     enum objecttype object;         // determined by -p, or -r switch. NONE.
 
@@ -472,6 +553,9 @@ class tetgenbehavior {
 // these 4 points.  The task is to check if another point e lies outside, on //
 // or inside S.                                                              //
 //                                                                           //
+// The 2D versions of these tests, orient2d() and incircle(), are used for   //
+// points lying in a coordinate plane (with the dropped coordinate ignored). //
+//                                                                           //
 // The following routines use arbitrary precision floating-point arithmetic  //
 // to implement these geometric predicates. They are fast and robust. It is  //
 // provided by J. R. Schewchuk in public domain. See the following link:     //
@@ -481,6 +565,8 @@ class tetgenbehavior {
 ///////////////////////////////////////////////////////////////////////////////
 
 REAL exactinit();
+REAL orient2d(REAL *pa, REAL *pb, REAL *pc);
+REAL incircle(REAL *pa, REAL *pb, REAL *pc, REAL *pd);
 REAL orient3d(REAL *pa, REAL *pb, REAL *pc, REAL *pd);
 REAL insphere(REAL *pa, REAL *pb, REAL *pc, REAL *pd, REAL *pe);
 
@@ -517,6 +603,12 @@ class tetgenmesh {
     // Maximum number of characters in a file name (including the null).
     enum {FILENAMESIZE = 1024};
 
+    // Size of the buffer in which a line written to a file is assembled.
+    enum {OUTPUTLINESIZE = 1024};
+
+    // Size of the stdio buffer of a file which is written line by line.
+    enum {OUTPUTBUFFERSIZE = 1048576};
+
     // For efficiency, a variety of data structures are allocated in bulk.
     //   The following constants determine how many of each structure is
     //   allocated at once.
@@ -604,6 +696,11 @@ class tetgenmesh {
     //   erclockwise direction and one (CW) in clockwise direction.
     enum {CCW = 0, CW = 1};
 
+    // Labels that signify the lines written for the items of a pool by
+    //   writepool(): the points of a .node file, the tetrahedra of an .ele
+    //   file, or the tetrahedra of a .neigh file.
+    enum outputlines {NODELINES, ELEMENTLINES, NEIGHBORLINES};
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // The basic mesh element data structures                                    //
@@ -847,7 +944,9 @@ class tetgenmesh {
 // subsegment or subface. 'cent' is the diametric circumcent of the 'shface',//
 // Three vertices 'forg', 'fdest' and 'fapex' are stored so that one can     //
 // check whether a face is still the same.  'prevface' and 'nextface' are    //
-// used to implement a double link for managing many badfaces.               //
+// used to implement a double link for managing many badfaces.  'key' (the   //
+// circumradius of an encroached subface) and 'heapidx' (its position) are   //
+// used instead if the badfaces are managed by heaps (the '-R' switch).      //
 //                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
@@ -857,6 +956,18 @@ class tetgenmesh {
       REAL cent[3];
       point forg, fdest, fapex; 
       struct badface *prevface, *nextface; 
+      REAL key;
+      int heapidx;
+    };
+
+    // A compact record of a face (or an edge) in a flip queue.  It is a
+    //   'badface' without the fields only used by the conforming Delaunay
+    //   routines, which keeps the items of a flip queue small.
+
+    struct flipitem {
+      triface tt;                              // A face might be flipped.
+      face ss;                              // An edge might be flipped.
+      point forg, fdest, fapex;          // The three vertices for checking.
     };
 
     // A queue structure used to store bad tetrahedra. Each tetrahedron's
@@ -882,6 +993,49 @@ class tetgenmesh {
       struct flipstacker *prevflip;           // Previous flip in the stack.
     };
 
+    // A node of the bounding volume hierarchy (BVH) of subfaces used for
+    //   detecting intersecting facets.  'bbox' is the bounding box (xmin,
+    //   ymin, zmin, xmax, ymax, zmax) of the subfaces in the node.  If
+    //   'count' is 0, it is an interior node, its two children are the
+    //   'index'-th and ('index' + 1)-th nodes of the node array. Otherwise,
+    //   it is a leaf, which has 'count' subfaces starting from the 'index'-th
+    //   one of the subface array.
+
+    struct bvhnode {
+      REAL bbox[6];                        // The bounding box of the node.
+      int index, count;              // The children or subfaces of the node.
+    };
+
+    // A pair of intersecting subfaces found by detectinterfaces(). 'type' is
+    //   the result of the exact test, INTERSECT or SHAREFACE, so the pair
+    //   need not be tested again when it is reported and output.
+
+    struct interpair {
+      shellface *sh[2];                                    // The two subfaces.
+      enum intersectresult type;                         // How they intersect.
+    };
+
+    // A segment at a vertex, used by delaunizesegments() to find the
+    //   segments at the vertices marked by an insertion.  The segments at a
+    //   vertex are chained by 'next', the index of the next one (or -1).
+
+    struct segatvertex {
+      shellface *sh;                                            // The segment.
+      int next;                              // The next segment at the vertex.
+    };
+
+#ifdef PTHREADS
+    // The work of a thread in the parallel surface triangulation. The
+    //   facets from 'firstfacet' to 'lastfacet' - 1 (start from 0) are
+    //   triangulated by 'worker', it has its own pools of subfaces.
+
+    struct facetthread {
+      tetgenmesh *worker;                   // Holds the thread-local pools.
+      point *idx2verlist;                 // A map from indices to vertices.
+      int firstfacet, lastfacet;              // The range of facets to do.
+    };
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
 // The list, link and queue data structures                                  //
@@ -891,9 +1045,10 @@ class tetgenmesh {
 // piece of continuous memory. It allows quickly accessing each element of S,//
 // thus is suitable for storing a fix-sized set.  While a link stores its    //
 // elements incontinuously. It allows quickly inserting or deleting one item,//
-// thus is good for storing a size-changable set.  A queue is basically a    //
-// special case of a link where one data element joins the link at the end   //
-// and leaves in an ordered fashion at the other end.                        //
+// thus is good for storing a size-changable set.  A queue is a set where    //
+// one data element joins at the end and leaves in an ordered fashion at the //
+// other end.  It stores its elements in a circular buffer of continuous     //
+// memory, since it is heavily used by the flip and insertion algorithms.    //
 //                                                                           //
 // These data types are all implemented with dynamic memory re-allocation.   //
 //                                                                           //
@@ -1124,27 +1279,112 @@ class tetgenmesh {
 //                                                                           //
 // Queue data structure.                                                     //
 //                                                                           //
-// A 'queue' is a basically a link.  Following is an image of a queue.       //
+// A 'queue' stores its items in a piece of continuous memory which is used  //
+// as a circular buffer.  'head' is the index of the first item, 'items' is  //
+// the number of items in the queue, and 'maxitems' is the number of items   //
+// the buffer can hold.  When the buffer is full, its size is doubled.  The  //
+// items are never moved during pushes and pops, this avoids the per-item    //
+// allocation and pointer chasing of a link.  Following is an image of a     //
+// queue.                                                                    //
 //              ___________     ___________     ___________                  //
 //   Pop() <-- |_         _|<--|_         _|<--|_         _| <-- Push()      //
 //             |_  Data0  _|   |_  Data1  _|   |_  Data2  _|                 //
 //             |___________|   |___________|   |___________|                 //
 //              queue head                       queue tail                  //
 //                                                                           //
+// The pointer returned by pop() is valid until the next push().             //
+//                                                                           //
 ///////////////////////////////////////////////////////////////////////////////
 
-    class queue : public link {
+    class queue {
+
+      public:
+
+        char *base;
+        int  itembytes;
+        int  head, items, maxitems;
 
       public:
 
-        queue(int bytes, int count = 256) : link(bytes, NULL, count) {}
-        queue(char* str, int count = 256) : link(str, count) {}
+        queue(int bytes, int count = 256) { queueinit(bytes, count); }
+        queue(char* str, int count = 256) {
+          compfunc comp;
+          set_compfunc(str, &itembytes, &comp);
+          queueinit(itembytes, count);
+        }
+        ~queue() { free(base); }
+
+        void queueinit(int bytes, int count);
+        int  empty() { return items == 0; }
+        long len() { return items; }
+        void clear() { head = items = 0; }
+        void *push(void* newitem);
+        void *bot() { return items > 0 ? (void *) (base + head * itembytes) 
+                                       : (void *) NULL; }
+        void *pop();
+    };
+
+    // An allocation or a deallocation of a subface or a subsegment, logged
+    //   by a worker of the parallel surface triangulation, so the same ones
+    //   can be replayed on the pools of the mesh (see transfersubfaces()).
+
+    struct shellfaceevent {
+      memorypool *pool;                                // The pool of the item.
+      shellface *sh;                                               // The item.
+      int dealloc;                        // 1 if it was freed, 0 if allocated.
+    };
+
+#ifdef PTHREADS
+    // The work of a thread in the parallel detection of intersecting
+    //   facets. The thread does the tasks 'firsttask', 'firsttask' + 'step',
+    //   ..., each task is a pair of nodes of a BVH (see interbvh()).  The
+    //   intersecting pairs of subfaces found in the i-th task are saved in
+    //   'interlists[i]'.
+
+    struct interthread {
+      tetgenmesh *mesh;                         // The mesh of the subfaces.
+      bvhnode *nodes;                                      // The BVH nodes.
+      shellface **subfacearray;                  // The subfaces of the BVH.
+      int *tris;                              // The subfaces of the leaves.
+      REAL *triboxes;                          // The boxes of the subfaces.
+      list *tasklist;                    // The pairs of nodes to be tested.
+      list **interlists;                    // The found pairs of each task.
+      int firsttask, step;                               // The tasks to do.
+    };
+
+    // The work of a thread in a round of the parallel splitting of
+    //   encroached subfaces.  The thread does the candidates 'firstone',
+    //   'firstone' + 'step', ..., less than 'number'.  For the i-th one, it
+    //   collects the cavity of 'newpoints[i]' into 'cavtetlists[i]', and
+    //   sets 'rejects[i]' if the point encroaches upon some segments.
+
+    struct cavitythread {
+      tetgenmesh *mesh;                         // The mesh of the cavities.
+      point *newpoints;                         // The points to be inserted.
+      triface *starttets;              // The tets at the encroached subfaces.
+      list **cavtetlists;                    // The cavities of the points.
+      int *rejects;                       // Are the points to be rejected?
+      int number, firstone, step;                   // The candidates to do.
+    };
 
-        int  empty() { return linkitems == 0; }
-        void *push(void* newitem) { return link::add(newitem); }
-        void *bot() { return link::getnitem(1); }
-        void *pop() { return link::del(1); }
+    // The work of a thread in a round of the parallel writing of a file.
+    //   The thread formats the blocks 'firstone', 'firstone' + 'step', ...,
+    //   less than 'number'.  The i-th block 'blocks[i]' has 'blockslots[i]'
+    //   items (dead or alive), its first live one is numbered by
+    //   'firstnumbers[i]'.  Its lines are written into 'buffers[i]', which
+    //   end at 'bufferends[i]' (see writepool()).
+
+    struct outputthread {
+      tetgenmesh *mesh;                           // The mesh to be written.
+      memorypool *pool;                            // The pool of the items.
+      enum outputlines kind;                     // The lines to be written.
+      void ***blocks;                                    // The pool blocks.
+      int *blockslots;                           // The items of the blocks.
+      int *firstnumbers;                  // The numbers of the first items.
+      char **buffers, **bufferends;                    // The written lines.
+      int number, firstone, step;                       // The blocks to do.
     };
+#endif
 
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
@@ -1187,6 +1427,16 @@ class tetgenmesh {
 
     // Array of lifting points of facets used for surface triangulation.
     REAL *liftpointarray;
+    // Array of the coordinate planes of facets (see incrflipinitsub()).
+    int *liftaxisarray;
+    // List of the pairs of intersecting subfaces found by detectinterfaces().
+    list *interpairlist;
+    // If it is not NULL, triangulatefacet() saves the isolated vertices in
+    //   it instead of setting their types (used by the worker threads).
+    list *facetvertexlist;
+    // If it is not NULL, makeshellface() and shellfacedealloc() log the
+    //   subfaces and subsegments they allocate and free in it.
+    list *shellfacelog;
 
     // Array for storing the radius of the protecting spheres (of the acute
     //   vertices);
@@ -1204,6 +1454,10 @@ class tetgenmesh {
     //   Type NAVNSHARPS has the lowest priority.  These queues are ordered
     //   from 0 (highest priority) to 5 (lowest priority).
     badface *subquefront[6], *subquetail[6]; 
+    // If '-R' switch is used, the queues are heaps (lists of pointers to
+    //   badfaces) ordered by the circumradii of the subfaces, the largest
+    //   one is at the top.
+    list *subqueheap[6];
 
     // Array (size = numberoftetrahedra * 6) for storing high-order nodes of
     //   tetrahedra (only used when -o2 switch is selected).
@@ -1218,12 +1472,22 @@ class tetgenmesh {
     int highorderindex; // Index to find extra nodes for highorder elements.
     int elemattribindex;       // Index to find attributes of a tetrahedron.
     int volumeboundindex;    // Index to find volume bound of a tetrahedron.
+    int sphereindex;  // Index to find cached circumsphere of a tetrahedron.
     int checksubfaces;                // Are there subfaces in the mesh yet?
     int nonconvex;                            // Is current mesh non-convex?
     long samples;            // Number of random samples for point location.
     unsigned long randomseed;                 // Current random number seed.
     REAL macheps;                                    // The machine epsilon.
     long flip23s, flip32s, flip22s, flip44s;   // Number of flips performed.
+    long flip22stops;                   // Times flip() stopped coplanar flips.
+    REAL refinestart;                    // When the quality stage starts (-w).
+    long refinepoints;          // Number of points before refinement (-S).
+    int refinestopped;       // Is the refinement stopped by '-S' or '-w'?
+    // The tets changed in a round of splitencsubsparallel() (a hash table
+    //   of 'roundtetsize' slots, 'roundtetcount' of them are used).  It is
+    //   NULL out of such a round.
+    tetrahedron **roundtets;
+    int roundtetsize, roundtetcount;
 
 ///////////////////////////////////////////////////////////////////////////////
 //                                                                           //
@@ -1381,6 +1645,7 @@ class tetgenmesh {
     inline void setelemattribute(tetrahedron* ptr, int attnum, REAL value);
     inline REAL volumebound(tetrahedron* ptr);
     inline void setvolumebound(tetrahedron* ptr, REAL value);
+    inline REAL* tet2sphere(tetrahedron* ptr);
  
     // Primitives for subfaces and subsegments.
     inline void sdecode(shellface sptr, face& s);
@@ -1436,6 +1701,7 @@ class tetgenmesh {
     inline point point2ppt(point pt);
     inline void setpoint2ppt(point pt, point value);
     inline point getliftpoint(int facetmark);
+    inline int getliftaxis(int facetmark);
     
     // Advanced primitives.
     inline void adjustedgering(triface& t, int direction);
@@ -1502,6 +1768,9 @@ class tetgenmesh {
                                              REAL*);
     enum intersectresult triangle_triangle_inter(REAL*, REAL*, REAL*, REAL*,
                                                  REAL*, REAL*);
+    int triangle_triangles_filter(REAL*, REAL*, REAL*, REAL**, int, int*);
+    bool triangle_triangle_segment(REAL*, REAL*, REAL*, REAL*, REAL*, REAL*,
+                                   REAL*, REAL*);
 
     // Degenerate cases tests
     bool iscollinear(REAL*, REAL*, REAL*, REAL epspp);
@@ -1530,6 +1799,7 @@ class tetgenmesh {
     REAL facedihedral(REAL* pa, REAL* pb, REAL* pc1, REAL* pc2);
     void tetalldihedral(point, point, point, point, REAL dihed[6]);
     bool circumsphere(REAL*, REAL*, REAL*, REAL*, REAL* cent, REAL* radius);
+    REAL tetinsphere(triface* testtet, point testpt);
     void inscribedsphere(REAL*, REAL*, REAL*, REAL*, REAL* cent, REAL* radius);
     void rotatepoint(REAL* p, REAL rotangle, REAL* p1, REAL* p2);
     void spherelineint(REAL* p1, REAL* p2, REAL* C, REAL R, REAL p[7]);
@@ -1555,6 +1825,9 @@ class tetgenmesh {
     void makeindex2pointmap(point*& idx2verlist);
     void makesegmentmap(int*& idx2seglist, shellface**& segsperverlist);
     void makesubfacemap(int*& idx2facelist, shellface**& facesperverlist);
+    int edgemapindex(point e1, point e2, int mapsize);
+    void makeedgemap(int& mapsize, int*& edge2facelist,
+                     face*& facesperedgelist);
     void maketetrahedronmap(int*& idx2tetlist, tetrahedron**& tetsperverlist);
 
     // Point location routines.
@@ -1605,6 +1878,9 @@ class tetgenmesh {
     long incrflipdelaunay();
 
     // Surface triangulation routines.
+    REAL orientsub(point pa, point pb, point pc, point liftpoint, int axis);
+    REAL incirclesub(point pa, point pb, point pc, point pd, point liftpoint,
+                     int axis);
     enum locateresult locatesub(point searchpt, face* searchsh, point abovept);
     long flipsub(queue* flipqueue);
     bool incrflipinitsub(int facetidx, list* ptlist, point* idx2verlist);
@@ -1623,14 +1899,31 @@ class tetgenmesh {
     void carveholessub(int holes, REAL* holelist);
     void triangulatefacet(int facetidx, list* ptlist, list* conlist,
                           point* idx2verlist, queue* flipqueue);
-    void unifysegments();
-    void mergefacets(queue* flipqueue);
+    void unifysegments(int mapsize, int* edge2facelist,
+                       face* facesperedgelist);
+    void mergefacets(queue* flipqueue, int mapsize, int* edge2facelist,
+                     face* facesperedgelist);
+#ifdef PTHREADS
+    static void *triangulatefacetsthread(void* arg);
+    void initsurfaceworker(tetgenmesh* worker);
+    void transfersubfaces(tetgenmesh* worker);
+    void triangulatefacetsparallel(point* idx2verlist);
+#endif
     long meshsurface();
 
     // Detect intersecting facets of PLC.
-    void interecursive(shellface** subfacearray, int arraysize, int axis,
-                       REAL bxmin, REAL bxmax, REAL bymin, REAL bymax,
-                       REAL bzmin, REAL bzmax, int* internum);
+    void buildbvh(bvhnode* nodes, int nodeidx, int* nodecount, int* tris,
+                  REAL* triboxes, int first, int count);
+    void interfacepair(face* sface1, face* sface2, list* interlist);
+    int splitbvhpair(bvhnode* nodes, int node1, int node2, int* pairs);
+    void interbvh(bvhnode* nodes, int node1, int node2,
+                  shellface** subfacearray, int* tris, REAL* triboxes,
+                  list* interlist);
+#ifdef PTHREADS
+    static void *interbvhthread(void* arg);
+    void interbvhparallel(bvhnode* nodes, shellface** subfacearray,
+                          int* tris, REAL* triboxes, list* interlist);
+#endif
     void detectinterfaces(); 
 
     // Segments recovery routines.
@@ -1641,6 +1934,14 @@ class tetgenmesh {
     point scoutrefpoint(triface* searchtet, point tend);
     point getsegmentorigin(face* splitseg);
     point getsplitpoint(face* splitseg, point refpoint);
+    void collectstartets(point newpoint, triface* searchtet,
+                         list* startetlist);
+    void markstarvertices(point newpoint, triface* searchtet, list* ptmarklist,
+                          list* markedlist, int stamp);
+    void addsegatvertex(list* segheads, list* segrecs, point pt,
+                        shellface* sh);
+    void replacesegatvertex(list* segheads, list* segrecs, point pt,
+                            shellface* oldsh, shellface* newsh);
     void delaunizesegments();
 
     // Constrained Delaunay triangulation routines.
@@ -1683,7 +1984,9 @@ class tetgenmesh {
     void initializerpsarray();
     bool checkseg4encroach(face* testseg, point testpt, bool enqflag);
     void tallencsegs(point testpt, list* cavtetlist);
-    void splitencsegs(queue* flipqueue);
+    REAL wallclockseconds();
+    bool checkrefinebudget();
+    void splitencsegs(queue* flipqueue, list* cavtetlist);
 
     void marksharpsegments(REAL acuteangle);
     void initializeapcarray();
@@ -1691,6 +1994,9 @@ class tetgenmesh {
     REAL getrpc(face* encsub);
     enum encsubtype categorizeencsub(face* encsub);
     bool checksub4encroach(face* testsub, point testpt, bool enqflag);
+    void enqueueencsub(badface* encsub, int quenumber);
+    badface* dequeueencsub(int* quenumber);
+    void removeencsub(badface* encsub);
     void doencchecktest(face* testsub);
     void calctynavnss(badface* bface, point newpoint);
     void calctyacutevsharps(badface* bface, point newpoint);
@@ -1699,6 +2005,23 @@ class tetgenmesh {
     void calctyfsvsharps(badface* bface, point newpoint);
     void calctynavsharps(badface* bface, point newpoint);
     void tallencsubs();
+    void checkstar4encroach(point newpoint, triface* searchtet,
+                            list* cavtetlist);
+    void calcsubsplitpoint(badface* encsub, int quenumber, point newpoint);
+    point getsubsplitpoint(badface* encsub, int quenumber);
+    void insertsubsplitpoint(face* splitsub, point newpoint,
+                             triface* starttet, queue* flipqueue,
+                             list* cavtetlist);
+    void markroundtets(list* cavtetlist);
+    bool roundtetsmarked(list* cavtetlist);
+    void splitencsub(badface* encsub, int quenumber, queue* flipqueue,
+                     list* cavtetlist);
+#ifdef PTHREADS
+    bool checkcav4encroach(point newpoint, triface* searchtet,
+                           list* cavtetlist);
+    static void *splitencsubsthread(void* arg);
+    void splitencsubsparallel(queue* flipqueue, list* cavtetlist);
+#endif
     void splitencsubs(queue* flipqueue, list* cavtetlist);
 
     void enforcequality();
@@ -1706,16 +2029,28 @@ class tetgenmesh {
     // I/O routines
     void transfernodes();
     void highorder();
+    int formatblock(memorypool* pool, enum outputlines kind, void** block,
+                    int slots, int number, char* buffer, char** bufferend);
+#ifdef PTHREADS
+    static void *writepoolthread(void* arg);
+#endif
+    void writepool(FILE* outfile, memorypool* pool, enum outputlines kind);
+    int outpointmarker(point pointloop, int index);
     void outnodes(tetgenio* out);
     void outelements(tetgenio* out);
     void outfaces(tetgenio* out);
     void outhullfaces(tetgenio* out);
     void outsubfaces(tetgenio* out);
+    void outintersections(tetgenio* out);
     void outsubsegments(tetgenio* out);
     void outneighbors(tetgenio* out);
     void outmesh2medit(char* mfilename);
     void outmesh2gid(char* gfilename);
     void outmesh2off(char* ofilename);
+    void outmesh2io(tetgenio* out);
+    void outmesh2binary(char* bfilename);
+    void outmesh2msh(char* mfilename);
+    void outmesh2vtu(char* vfilename);
 
     // User interaction routines.
     void internalerror();